@@ -232,7 +232,7 @@ int main(int argc, char *argv[])
 
 void WriteAdverbInfo(BYTE C)
    {
-   BOOL DefaultFlag;
+   BOOL DefaultFlag = FALSE;
    int iIndex;
 
    while (!feof(TextStream))
@@ -6,9 +6,9 @@
 *  Task CANDY
 *
 * This template is for processing files directly from disk.
-* Data values are read in one at a time, processed,
-* and then written out. Files of any size can be managed since
-* little memory is required.
+* Data values are read in blocks through a record stream, processed
+* one at a time, and then written out. Files of any size can be managed
+* since little memory is required.
 *
 * The default outclass is cdy
 *
@@ -37,6 +37,9 @@ char tempfileName[_MAX_PATH];
 FILE *infileStream  = (FILE *)NIL;
 FILE *outfileStream = (FILE *)NIL;
 
+struct ZSTREAM *inputRecords  = (struct ZSTREAM *)NIL;  // Buffered record streams on the two files
+struct ZSTREAM *outputRecords = (struct ZSTREAM *)NIL;
+
 const char szTask[]="CANDY";
 
 int main(int argc, char *argv[])
@@ -74,6 +77,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,infileName);
    CatList = ZCatFiles(infileName);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -98,7 +102,10 @@ int main(int argc, char *argv[])
 
       if (Zputhead(outfileStream,&FileHeader)) BombOff(1);
 
-      while (Zread(infileStream,buffer,FileHeader.type))
+      if (!(inputRecords  = zStreamOpen(infileStream,  FileHeader.type, O_readb)))  BombOff(1);
+      if (!(outputRecords = zStreamOpen(outfileStream, FileHeader.type, O_writeb))) BombOff(1);
+
+      while (zStreamRead(inputRecords,buffer))
          {
          if (extractValues(buffer, &FileHeader, timeIndex, &timeVal, &Rval, &Zval, &flag))
             {
@@ -122,13 +129,16 @@ int main(int argc, char *argv[])
 
          insertValues(buffer, &FileHeader, timeVal, Rval, Zval, flag);
 
-         if (Zwrite(outfileStream,buffer,FileHeader.type)) BombOff(1);
+         if (zStreamWrite(outputRecords,buffer)) BombOff(1);
 
          ++timeIndex;           // Must update after all the processing...
          } /* end while */
 
       if (ferror(infileStream)) BombOff(1);
 
+      if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the file is closed
+      outputRecords = (struct ZSTREAM *)NIL;
+
       zTaskMessage(2,"%ld points processed.\n",(long)timeIndex);
 
       fcloseall();
@@ -195,6 +205,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
+   if (inputRecords) zStreamClose(inputRecords);
+   inputRecords = (struct ZSTREAM *)NIL;
+
+   if (outputRecords) zStreamClose(outputRecords);
+   outputRecords = (struct ZSTREAM *)NIL;
+
    if (infileStream) Zclose(infileStream);
    infileStream = (FILE *)NIL;
    
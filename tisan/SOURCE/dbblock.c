@@ -58,7 +58,7 @@ int main(int argc, char *argv[])
    char infileName[_MAX_PATH], outfileName[_MAX_PATH];
    double time, timeIndex=0.;
    
-   double blockRval, blockTime, blockTimeIndex = 0.0;
+   double blockRval=0., blockTime, blockTimeIndex = 0.0;
    struct complex blockZval;
    double blockCount = 0.0;
    
@@ -91,6 +91,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,infileName);
    CatList = ZCatFiles(infileName);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (I = 0, pChar = CatList->pList;
         (I < CatList->N) && !ERRFLAG;
@@ -90,6 +90,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,InputFile);
    CatList = ZCatFiles(InputFile);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
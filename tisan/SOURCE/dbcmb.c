@@ -21,6 +21,7 @@
 *       5 -> APPEND DB2 TO DB1
 *       6 -> INTERLEAVE DB1 WITH DB2
 *       7 -> CONVOLVE DB1 and DB2
+*       8 -> CORRELATE DB1 with DB2
 *
 * The in2file accepts wild cards. To use this feature, make the outfile the same as the infile and give infile a name that does not match the secondary files.
 * The code will then apply the new secondary file to the output of each previous run.
@@ -45,6 +46,9 @@
 void appendFiles();
 void interleaveFiles();
 void convolveFiles();
+void correlateFiles();
+double *readSeries(FILE *stream, short type, long N, long L, double delta_t);
+BOOL fftMultiply(double *f, double *g, long L, BOOL bReal, BOOL bCorrelate);
 void addFiles();
 void multiplyFiles();
 void divideFiles();
@@ -108,7 +112,7 @@ int main(int argc, char *argv[])
    TXDataPntr1 = (struct TXData *)BUFF1;
    TXDataPntr2 = (struct TXData *)BUFF2;
 
-   if ((CODE < 0) || (CODE > 7))
+   if ((CODE < 0) || (CODE > 8))
       {
       zTaskMessage(10,"CODE Out of Range\n");
       Zexit(1);
@@ -179,7 +183,7 @@ int main(int argc, char *argv[])
          BombOff(1);
          }
 
-      if ((CODE == 7) && (F1Header.type != R_Data) && (F1Header.type != X_Data)) // Cannot convolve time labeled files since the time intervals MUST be the same between points.
+      if ((CODE >= 7) && (F1Header.type != R_Data) && (F1Header.type != X_Data)) // Cannot convolve time labeled files since the time intervals MUST be the same between points.
          {
          zTaskMessage(10,"Cannot convolve time labeled files.\n");
          BombOff(1);
@@ -201,7 +205,7 @@ int main(int argc, char *argv[])
       FLAG1=0;
       FLAG2=0;
 
-      if ((CODE == 5) || (CODE == 6) || (CODE ==7))
+      if ((CODE == 5) || (CODE == 6) || (CODE == 7) || (CODE == 8))
          {
          switch (CODE)           /* Select Action */
             {
@@ -215,7 +219,11 @@ int main(int argc, char *argv[])
             
             case 7:  // Convolve
                convolveFiles();
-            } /* End SWITCH over 5, 6 and 7*/
+               break;
+
+            case 8:  // Correlate
+               correlateFiles();
+            } /* End SWITCH over 5, 6, 7 and 8*/
          }
       else
          {
@@ -264,7 +272,7 @@ int main(int argc, char *argv[])
    /* If both N1 and N2 are not NULL then message */
          if (!N1) N2 = Zread(IN2STR,BUFF2,F2Header.type);
          if (N1 != N2) zTaskMessage(8,"WARNING!!! Files are of Different Lengths\n");
-         } // if ((CODE == 5) || (CODE == 6) || (CODE ==7))
+         } // if ((CODE == 5) || (CODE == 6) || (CODE == 7) || (CODE == 8))
 
       fcloseall();
       ERRFLAG = zNameOutputFile(OUTFILE,TMPFILE);
@@ -326,7 +334,7 @@ void interleaveFiles() // shuffle files together
    }
 
 /*
-** Brute force convolution (no Fourier transforms)
+** Convolution by FFT.
 ** The data must be evenly spaced, so it cannot process time labeled files.
 ** The time information for the final output (m and b in the header) will come from file #2.
 **
@@ -339,19 +347,21 @@ void interleaveFiles() // shuffle files together
 ** h[y] = ∑f[x]g[y-x] ∆x
 **
 ** where x and y are now integer array index values and ∆x is the time interval.
-** The time interval ∆x is inside the sum to account for flagged data points in a time series (we might skip over a few time stamps)
+** The time interval ∆x is inside the sum to account for flagged data points in a time series (we might skip over a few time stamps).
+** A flagged point of file #1 adds its interval to the next good point, while flagged points of file #2 count as zero.
 **
 ** The value of [y] goes from 0 to N-1 and [x] thus must be limited to sum from [0] to [y]
 **
 ** The number if points in each file need not be the same, but the sums will be limited to the number of points in the
 ** smaller file.
 **
+** Both files are zero padded to L >= 2N-1 points so the circular convolution of the FFT has no wrap around.
 */ 
 void convolveFiles()
    {
-   long N, N1, N2, x, y;
-   double Rval1, Rval2, Rsum, delta_t, baseDelta_t;
-   struct complex Zval1, Zval2, Zval, Zsum;
+   long N, N1, N2, L, y;
+   double *f, *g;
+   BOOL bReal = (FHeader.type == R_Data);
 
 /*
 ** Determined the value of N based on which file has fewer points $$$$
@@ -364,94 +374,181 @@ void convolveFiles()
    zTaskMessage(4,"Number of data Points in File #2: %ld\n", N2);
    if (N1 != N2) zTaskMessage(8,"WARNING!!! Files are of Different Lengths\n");
 
-/*
-** Now perform the loops (outer loop is the second file)
-*/
-   printPercentComplete(0L, 0L, 0);
+   for (L = zSmoothLength(2L * N); L % 2L; L = zSmoothLength(L + 1L));   // Even, so real data can use the real transform
 
-   for (y=0; y < N; ++y)
+   f = readSeries(INSTR, F1Header.type, N, L, F1Header.m);
+   g = readSeries(IN2STR, F2Header.type, N, L, 0.);
+
+   if (fftMultiply(f, g, L, bReal, FALSE))
       {
-      Rsum = Zsum.x = Zsum.y = 0.;
-
-      Zgethead(INSTR,&F1Header); // Rewind the first data file
-      baseDelta_t = F1Header.m;   // Get the base time interval
-      delta_t = baseDelta_t;      // This is the time interval used in the calculations
+      zTaskMessage(10,"Unable to allocate memory for the transform of %ld points.\n", L);
+      BombOff(1);
+      }
 
-      Zread(IN2STR, BUFF2, F2Header.type);
-      switch (F2Header.type) // Get data from input file #2
+   for (y = 0L; y < N; ++y)
+      {
+      switch (FHeader.type)  /* Output Data */
          {
          case R_Data:
-            Rval2 = RDataPntr2->y;
-            FLAG2 = RDataPntr2->f;
+            RDataPntr->y = f[y];
+            RDataPntr->f = 0;
             break;
          case X_Data:
-            Zval2 = XDataPntr2->z;
-            FLAG2 = XDataPntr2->f;
+            XDataPntr->z.x = f[2L*y];
+            XDataPntr->z.y = f[2L*y+1];
+            XDataPntr->f = 0;
             break;
          }
+
+      if (Zwrite(OUTSTR,BUFF,FHeader.type)) BombOff(1);
+      }
 
-      for (x=0; x <= y; ++x)
-         {
-         Zread(INSTR,  BUFF1, F1Header.type); // Data from File #1
-
-         switch (F1Header.type)
-            {
-            case R_Data:
-               Rval1 = RDataPntr1->y;
-               FLAG1 = RDataPntr1->f;
-               break;
-            case X_Data:
-               Zval1 = XDataPntr1->z;
-               FLAG1 = XDataPntr1->f;
-               break;
-            }
-
-         FLAG = FLAG1 | FLAG2;
-
-         if (FLAG)
-            delta_t += baseDelta_t; // Bad data point, so need to make the time interval larger for the next calculation
-         else
-            {
-            switch (FHeader.type)
-               {
-               case R_Data:
-                  Rsum += (Rval1 * Rval2) * delta_t;
-                  break;
-               case X_Data:
-                  Zval = c_mul(Zval1, Zval2);
-                  Zval.x *= delta_t;
-                  Zval.y *= delta_t;
-                  Zsum = c_add(Zsum, Zval);
-                  break;
-               }
-
-            delta_t = baseDelta_t; // Reset the time interval for the next calculation
-            }
-         } // for (x=0; x <= y; ++x)
-
-      switch (FHeader.type)  /* Output Data */
+   free(f);
+   free(g);
+
+   return;
+   }
+
+/*
+** Cross correlation by FFT, the same as the convolution but with file #1 conjugated and not reversed:
+**
+** c[k] = ∑f*[x]g[x+k] ∆x
+**
+** for every lag k where the files overlap, -(N1-1) to N2-1. The output has N1+N2-1 points, and b in the header
+** is set so the time of each point is its lag. Correlating a file with itself gives its auto-correlation.
+** Flagged points are handled as in the convolution.
+*/
+void correlateFiles()
+   {
+   long N1, N2, L, k;
+   double *f, *g;
+   BOOL bReal = (FHeader.type == R_Data);
+
+   N1 = countDataRecords(INSTR);
+   N2 = countDataRecords(IN2STR);
+
+   zTaskMessage(4,"Number of data Points in File #1: %ld\n", N1);
+   zTaskMessage(4,"Number of data Points in File #2: %ld\n", N2);
+
+   for (L = zSmoothLength(N1 + N2); L % 2L; L = zSmoothLength(L + 1L));  // At least N1+N2-1 and even
+
+   f = readSeries(INSTR, F1Header.type, N1, L, F1Header.m);
+   g = readSeries(IN2STR, F2Header.type, N2, L, 0.);
+
+   if (fftMultiply(f, g, L, bReal, TRUE))
+      {
+      zTaskMessage(10,"Unable to allocate memory for the transform of %ld points.\n", L);
+      BombOff(1);
+      }
+
+   for (k = -(N1 - 1L); k < N2; ++k)
+      {
+      switch (FHeader.type)  /* Output Data, negative lags wrap to the end of the transform */
          {
          case R_Data:
-            RDataPntr->y = Rsum;
+            RDataPntr->y = f[(k + L) % L];
             RDataPntr->f = 0;
             break;
          case X_Data:
-            XDataPntr->z = Zsum;
+            XDataPntr->z.x = f[2L*((k + L) % L)];
+            XDataPntr->z.y = f[2L*((k + L) % L)+1];
             XDataPntr->f = 0;
             break;
          }
 
-      if (Zwrite(OUTSTR,BUFF,FHeader.type)) BombOff(1);
-
-      printPercentComplete(y, N, PROGRESS);
-
-      } // for (y=0; y < N; ++y)
-
-   printPercentComplete(y, N, PROGRESS); // 100% Complete
+      if (Zwrite(OUTSTR,BUFF,FHeader.type)) BombOff(1);
+      }
+
+   FHeader.b = -(double)(N1 - 1L) * FHeader.m;
+   if (Zputhead(OUTSTR,&FHeader)) BombOff(1);
+
+   free(f);
+   free(g);
 
    return;
    }
 
+/*
+** Read the next N records of a time series into a zeroed array of L points, L+2 doubles for real data
+** and 2L for complex data. Flagged points are zero. With delta_t > 0 each good point is multiplied by
+** delta_t plus the intervals of the flagged points just before it, as the brute force sums did.
+*/
+double *readSeries(FILE *stream, short type, long N, long L, double delta_t)
+   {
+   double *pData, weight;
+   struct RData *pR = (struct RData *)BUFF1;
+   struct XData *pX = (struct XData *)BUFF1;
+   long I;
+
+   pData = (double *)calloc((type == R_Data) ? L + 2L : 2L * L, sizeof(double));
+   if (!pData)
+      {
+      zTaskMessage(10,"Unable to allocate memory for %ld points.\n", L);
+      BombOff(1);
+      }
+
+   weight = delta_t;
+   for (I = 0L; I < N; ++I)
+      {
+      if (!Zread(stream, BUFF1, type)) BombOff(1);
+
+      if ((type == R_Data) ? pR->f : pX->f)
+         {
+         weight += delta_t;   // Bad data point, so need to make the time interval larger for the next one
+         continue;
+         }
+
+      if (delta_t <= 0.) weight = 1.;
+
+      if (type == R_Data)
+         pData[I] = pR->y * weight;
+      else
+         {
+         pData[2L*I]   = pX->z.x * weight;
+         pData[2L*I+1] = pX->z.y * weight;
+         }
+
+      weight = delta_t;       // Reset the time interval for the next point
+      }
+
+   return(pData);
+   }
+
+/*
+** f times the transform of g, or times its conjugate for a correlation, transformed back and left in f.
+** For real data f and g hold L real values (L even), otherwise L complex values.
+** Returns TRUE if zFFT could not get its scratch memory.
+*/
+BOOL fftMultiply(double *f, double *g, long L, BOOL bReal, BOOL bCorrelate)
+   {
+   double re, im, fi;
+   long J, nBins;
+
+   if (bReal)
+      {
+      if (zRealFFT(f, L, -1) || zRealFFT(g, L, -1)) return(TRUE);
+      nBins = L / 2L + 1L;
+      }
+   else
+      {
+      if (zFFT(f, L, -1) || zFFT(g, L, -1)) return(TRUE);
+      nBins = L;
+      }
+
+   for (J = 0L; J < nBins; ++J)
+      {
+      fi = bCorrelate ? -f[2L*J+1] : f[2L*J+1];
+      re = (f[2L*J] * g[2L*J]   - fi * g[2L*J+1]) / (double)L;
+      im = (f[2L*J] * g[2L*J+1] + fi * g[2L*J])   / (double)L;
+      f[2L*J]   = re;
+      f[2L*J+1] = im;
+      }
+
+   if (bReal) return(zRealIFFT(f, L, 1));
+
+   return(zFFT(f, L, 1));
+   }
+
 void addFiles() // DB1 + FACTOR * DB2
    {
    switch(FHeader.type)
@@ -106,6 +106,7 @@ int main(int argc, char *argv[])
 
    CatList = ZCatFiles(INFILE);   // Find matching files for the input name
    if (CatList->N == 0) Zexit(1); // Quit if there are none
+   zParallelFiles(CatList);       // Spread the files over worker processes (WORKERS in TISAN.CFG)
 /*
 ** For Each Matching File, Perform the Conversion.
 ** For this simple task it is not necessary to reload the
@@ -550,10 +551,7 @@ short STOB()
    
    if (!Zgethead(INSTR,&FH)) return(1);           /* Read Header      */
 
-   while (Zread(INSTR,CONBUF,FH.type)) ++TOTAL; /* Find File Length */
-
-   if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) /* Rewind file  */
-      return(1);
+   TOTAL += (double)countDataRecords(INSTR);     /* Find File Length */
 
    fputc(0xFD,OUTSTR); /* Always FD for a BSAVE file */
    fputc(0xDF,OUTSTR); /* Write out rest of BASIC header info */
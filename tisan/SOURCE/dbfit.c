@@ -5,7 +5,7 @@
 *
 *  Task DBFIT
 *
-* Task to do a least squares fit using steepest descent
+* Task to do a least squares fit using Levenberg-Marquardt (or steepest descent)
 * The entire file must fit into memory in order to be processed.
 * This is a nonstandard task in that it reads the data records into a "point" array.
 * The point data type is structurally the same as the TRData structure, but the
@@ -29,6 +29,25 @@
 *
 *   Default -> Just report the results.
 *
+*   Add 4 to the CODE to use steepest descent instead of Levenberg-Marquardt.
+*
+*   Add 8 to the CODE for a batch fit: every file matching INNAME is fit from the same PARMS[],
+*   the files are spread over WORKERS processes, and the q[] values and RMS error of each file
+*   are written to summary files named by OUTNAME with classes Q0, Q1, ... and RMS (PARMS[] is
+*   not updated and no fit files are made). A file that cannot be fit is skipped and has an
+*   RMS error of -1.
+*
+* ZMAJOR - STARTS, JITTER
+*   The fit is repeated from STARTS starting points, PARMS[] and STARTS-1 copies of it with each
+*   value moved by up to ±JITTER of itself, and the fit with the lowest error is kept.
+*
+* Levenberg-Marquardt
+*  POINT   - LOOPMAX,        MINERROR
+*  ZFACTOR - DAMPINGSTART,   MAXDAMPING
+*  TMAJOR -  DAMPINGUP,      DAMPINGDOWN
+*  YMAJOR -  (unused),       TOLERANCE
+*
+* Steepest Descent
 *  POINT   - LOOPMAX,        MINERROR
 *  ZFACTOR - LAMBDASTART,    MINLAMBDA
 *  TMAJOR -  LAMBDADECREASE, LAMBDAINCREASE
@@ -54,7 +73,15 @@
 * c = (-∑(x) ∑(x^2 y) ∑(x^3) + ∑(x) ∑(x^4) ∑(x y) + (∑(x^2))^2 ∑(x^2 y) - ∑(x^2) ∑(x^3) ∑(x y) - ∑(x^2) ∑(x^4) ∑(y) + (∑(x^3))^2 ∑(y)) / D
 *
 *
-* In general the fit is performed through steepest descent:
+* In general the fit is performed with Levenberg-Marquardt using the analytic derivatives of each function:
+* E = ½∑(Y[t] - f(q[];t))²
+* α[i][j] = ∑ ∂f(q[];t)/∂q[i] ∂f(q[];t)/∂q[j]
+* β[i] = ∑(Y[t] - f(q[];t)) ∂f(q[];t)/∂q[i]
+* (α + μ diag(α)) ∆q = β
+* The damping factor μ is reduced after each step that lowers E and raised after each step that does not.
+* The fit has converged when a step lowers E by less than TOLERANCE times E.
+*
+* With CODE + 4 the fit is performed through steepest descent:
 * E = ½∑(Y[t] - f(q[];t))²
 * ∆q[i] = -λ ∂E/∂q[i]
 * ∂E/∂q[i] = -∑(Y[t] - f(q[];t)) ∂f(q[];t)/∂q[i]
@@ -62,6 +89,10 @@
 *
 * If the dynamic range of the values in the fit is too large, it will not converge. In that case you will need to perform some scaling.
 *
+* The sums over the data are done in blocks of FITBLOCK points. Each block is one call of the function's
+* block form and gives one set of partial sums; the blocks are spread over THREADS threads and the partial
+* sums are added pairwise in block order, so the result does not depend on the number of threads.
+*
 * The infile of this task accepts wild cards.
 *
 */
@@ -87,23 +118,65 @@
 #define LAMBDAINCREASEDEFAULT 1.0001    // Increase when we go down hill
 #define DQVALUEDEFAULT        1.0e-6    // How big is delta-q for taking the derivatives
 
+#define DAMPINGSTARTDEFAULT   0.001     // Levenberg-Marquardt damping factor to start with
+#define MAXDAMPINGDEFAULT     1.0e10    // Stop if the damping factor grows past this value (no step lowers the error)
+#define DAMPINGUPDEFAULT      10.0      // Increase the damping factor if we go up hill
+#define DAMPINGDOWNDEFAULT    10.0      // Decrease it when we go down hill
+#define TOLERANCEDEFAULT      1.0e-10   // Stop when a step lowers the error by less than this fraction
+
+#define STARTSDEFAULT         1         // Number of starting points for the fit
+#define JITTERDEFAULT         0.1       // Largest relative change of a parameter for the other starting points
+
 #define MAXPOLY 9 // maximum polynomial fit power
 
+#define FITBLOCK 1024   // Number of points handed to a block function at a time, and summed as one partial sum
+
+#define FIT_ERROR    0  // What a pass over the data sums up: ∑r²
+#define FIT_GRADIENT 1  // ∑r² and ∑r ∂f/∂q[i] with numerical derivatives (steepest descent)
+#define FIT_NORMAL   2  // ∑r², β and α with analytic derivatives (Levenberg-Marquardt)
+
+#define FIT_SKIPPED (-1)  // End code of a batch file that could not be fit
+
 struct configOptions {long   loopMax;         // A set of configuration options used by least squares
                       double minError;
                       double minLambda;
                       double lambdaDecrease;  // must be >= 1.0
                       double lambdaIncrease;  // must be >= 1.0
                       double lambdaStart;
-                      double dqValue;};
+                      double dqValue;
+                      double maxLambda;       // Levenberg-Marquardt only
+                      double tolerance;       // Levenberg-Marquardt only
+                      int    nStarts;
+                      double jitter;};
 
 typedef struct pointStruct {double x,y;} point;    // Same as TRData structure, but this type is compatible with the fit routines.
 
+struct FITRESULT {char   szName[_MAX_PATH];    // Result of one file of a batch fit (CODE 8), as kept in the results file
+                  double q[PARMSCOUNT];
+                  double rms;
+                  long   nPoints;
+                  int    iEndCode;};
+
+struct FITWORK {point  *data;          // Work shared by the threads of one pass over the data
+                long   dataCount;
+                long   nBlocks;
+                double *q;
+                int    qCount;
+                int    iMode;          // FIT_ERROR, FIT_GRADIENT or FIT_NORMAL
+                double dq;             // FIT_GRADIENT only
+                int    width;          // Number of partial sums for each block
+                double *pPartials;};   // nBlocks * width partial sums
+
 double (*function)(double, double*);    // Global Pointer to the function that will be used for the fit.
+void (*blockFunction)(double*, long, double*, double*, double (*)[FITBLOCK]);  // Global Pointer to the block form of the same function.
 
 void reportResults(int qCount, int iEndCode);
+void saveResult(char *pName, int qCount, int iEndCode, long dataCount);
+short writeSummary(int qCount, int nFiles);
+int compareResults(const void *pA, const void *pB);
+int multiStartFit(point data[], long dataCount, int qCount, struct configOptions *options);
 void writeOutputFile(struct TRData* data, long lRecordCount);
-long readDataPoints(FILE* infileStream, point* pDataBuffer, long lDataCount);
+long readDataPoints(struct ZMAP* inputMap, point* pDataBuffer, long lDataCount);
 point* getXYdata(char* data, long index, short type);
 int setFunctionPointer(struct configOptions* options);
 int findLinearFit(point data[], long dataCount);
@@ -111,8 +184,13 @@ int findQuadFit(point data[], long dataCount);
 int findFit(point data[], long dataCount, int qCount, struct configOptions *options);
 double errorFunction(point data[], long dataCount, double q[]);
 double rmsError(double error, long dataCount);
-double partialDerivative(double x, int qIndex, double q[], double dq);
+double partialStep(double originalq, double dq);
+double fitPass(point data[], long dataCount, double q[], int qCount, int iMode, double dq, double sums[]);
+void FITTHREAD(int iThread, int nThreads, void *pData);
 BOOL calculateNewParameters(point data[], long dataCount, double q[], double lambda, int qCount, double dq, struct configOptions *options);
+int findMarquardtFit(point data[], long dataCount, int qCount, struct configOptions *options);
+double normalEquations(point data[], long dataCount, double q[], int qCount, double alpha[][PARMSCOUNT], double beta[]);
+BOOL solveLinearSystem(double a[][PARMSCOUNT], double b[], int n);
 
 double polynomial(double x, double q[]);
 double gaussian(double x, double q[]);
@@ -120,14 +198,29 @@ double doubleGaussian(double x, double q[]);
 double exponential(double x, double q[]);
 double sineFunction(double x, double q[]);
 
+void polynomialBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK]);
+void gaussianBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK]);
+void doubleGaussianBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK]);
+void addGaussian(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK]);
+void exponentialBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK]);
+void sineBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK]);
+
 int iFactor;   // Order of a polynomial fit
+BOOL bSteepestDescent;  // Use steepest descent rather than Levenberg-Marquardt (CODE + 4)
+int nThreads;           // THREADS in TISAN.CFG
+
+double *pPartials = (double *)NIL;   // Partial sums of each block of data, kept between passes
+long lPartialsSize = 0L;
+
+BOOL bBatch;                         // CODE 8
+char resultsName[_MAX_PATH] = "";    // Scratch file the batch results of every process are appended to
 
 point* pDataBuffer = (point *)NIL;     // Global data buffer. Needs to be global in case we have to bail and free it.
 struct FILEHDR FileHeader;
 
 char tempfileName[_MAX_PATH];
 
-FILE *infileStream  = (FILE *)NIL;
+struct ZMAP *inputMap = (struct ZMAP *)NIL;
 FILE *outfileStream = (FILE *)NIL;
 
 const char szTask[]="DBFIT";
@@ -136,9 +229,10 @@ int main(int argc, char *argv[])
    {
    char infileName[_MAX_PATH], outfileName[_MAX_PATH];
    long lDataCount, lValidRecords;
-   int qCount, iEndCode;
+   int qCount, iEndCode, nFiles, i;
    struct configOptions options;
    BOOL bCreateOutputFile;
+   double startParms[PARMSCOUNT];
    // declarations need to manage wild cards
    struct CATSTRUCT *CatList;
    char Drive[_MAX_DRIVE], Dir[_MAX_DIR], Fname[_MAX_FNAME], Ext[_MAX_EXT];
@@ -153,28 +247,72 @@ int main(int argc, char *argv[])
 
    if (isEmptyString(OUTCLASS)) strcpy(OUTCLASS,"dbfit");
 
+   nThreads = zThreadCount();
+   zTaskMessage(2,"Using %d thread(s).\n", nThreads);
+
    zBuildFileName(M_inname,infileName);
    CatList = ZCatFiles(infileName);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
 
 /*
-** Fit as function using steepest descent and set up the options for the fit
+** Select the function to fit and set up the options for the fit
 */
    qCount = setFunctionPointer(&options);   // Also populates the options structure
 /*
-** Just a little feedback of we are using steepest descent to find the fit
+** Just a little feedback on how we are going to find the fit
 */
    if ((ITYPE != 0) || ((iFactor != 1) && (iFactor != 2))) // don't need this output for linear and quadratic fits
       {
       zTaskMessage(4,"Maximum number of iterations: %ld\n",options.loopMax);
       zTaskMessage(4,"Minimum error for fitting: %lg\n",options.minError);
-      zTaskMessage(4,"Minimum learning factor: %lg\n",options.minLambda);
-      zTaskMessage(4,"Initial learning factor: %lg\n",options.lambdaStart);
-      zTaskMessage(4,"Learning factor decreased by: %lg\n",options.lambdaDecrease);
-      zTaskMessage(4,"Learning factor increased by: %lg\n",options.lambdaIncrease);
-      zTaskMessage(4,"Differential: %lg\n",options.dqValue);
+
+      if (bSteepestDescent)
+         {
+         zTaskMessage(4,"Minimum learning factor: %lg\n",options.minLambda);
+         zTaskMessage(4,"Initial learning factor: %lg\n",options.lambdaStart);
+         zTaskMessage(4,"Learning factor decreased by: %lg\n",options.lambdaDecrease);
+         zTaskMessage(4,"Learning factor increased by: %lg\n",options.lambdaIncrease);
+         zTaskMessage(4,"Differential: %lg\n",options.dqValue);
+         }
+      else
+         {
+         zTaskMessage(4,"Initial damping factor: %lg\n",options.lambdaStart);
+         zTaskMessage(4,"Maximum damping factor: %lg\n",options.maxLambda);
+         zTaskMessage(4,"Damping factor increased by: %lg\n",options.lambdaDecrease);
+         zTaskMessage(4,"Damping factor decreased by: %lg\n",options.lambdaIncrease);
+         zTaskMessage(4,"Convergence tolerance: %lg\n",options.tolerance);
+         }
+
+      zTaskMessage(4,"Starting points: %d\n",options.nStarts);
+      if (options.nStarts > 1) zTaskMessage(4,"Starting point jitter: %lg\n",options.jitter);
       zTaskMessage(4,"\n");
       }
+/*
+** A batch fit gathers the results of every file into the summary files. The original process
+** creates the results file, the workers append to it, and the summary is written once they are done.
+*/
+   bBatch = (CODE & 8) ? TRUE : FALSE;
+   nFiles = CatList->N;
+
+   for (i = 0; i < PARMSCOUNT; ++i) startParms[i] = PARMS[i];   // Every file of a batch starts from the same guess
+
+   if (bBatch)
+      {
+      if (isEmptyString(OUTNAME))
+         {
+         zTaskMessage(10,"A batch fit (CODE 8) needs OUTNAME for the summary files.\n");
+         BombOff(1);
+         }
+
+      zBuildFileName(M_tmpname,resultsName);
+
+      zTaskMessage(2,"Opening Results File '%s'\n",resultsName);
+      if ((outfileStream = zOpen(resultsName,O_writeb)) == NULL) BombOff(1);
+      Zclose(outfileStream);
+      outfileStream = (FILE *)NIL;
+
+      zParallelCatalog(CatList);   // Spread the files over worker processes (WORKERS in TISAN.CFG)
+      }
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -189,17 +327,27 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,tempfileName);
 
       zTaskMessage(2,"Opening Input File '%s'\n",infileName);
-      if ((infileStream = zOpen(infileName,O_readb)) == NULL) Zexit(1);
-      
-      if (!Zgethead(infileStream,&FileHeader)) BombOff(1);
+      if ((inputMap = zMapOpen(infileName,&FileHeader,O_mapb)) == NULL)
+         {
+         if (!bBatch) Zexit(1);
+
+         zTaskMessage(5,"Skipping '%s', it cannot be read.\n",infileName);   // One bad file should not lose the rest of the batch
+         saveResult(pWild, qCount, FIT_SKIPPED, 0L);
+         continue;
+         }
 
       if ((FileHeader.type != R_Data) && (FileHeader.type != TR_Data))
          {
          zTaskMessage(5,"Only real data files can be fit at this time.\n");
-         BombOff(1);
+         if (!bBatch) BombOff(1);
+
+         zTaskMessage(5,"Skipping '%s'.\n",infileName);
+         saveResult(pWild, qCount, FIT_SKIPPED, 0L);
+         fcloseall();
+         continue;
          }
 
-      if ((CODE == 2) || (CODE == 3))  // Try and create an output file
+      if ((CODE & 2) && !bBatch)  // Try and create an output file (CODE 2 or 3)
          {
          if (!strcmp(infileName,outfileName))  // However don't overwrite the input file
             {
@@ -217,16 +365,9 @@ int main(int argc, char *argv[])
          bCreateOutputFile = FALSE;
 
    /*
-   ** Read the input file data into memory
+   ** Extract the data from the input file map
    */
-      lDataCount = countDataRecords(infileStream);
-
-      if (ferror(infileStream))
-         {
-         zTaskMessage(10,"Error getting number of data records.\n");
-         zError();
-         BombOff(1);
-         }
+      lDataCount = inputMap->nRecords;
 
       pDataBuffer = malloc(lDataCount * sizeof(point));   // Allocate enough space for all the possible X-Y data pairs
 
@@ -236,28 +377,36 @@ int main(int argc, char *argv[])
          BombOff(1);
          }
       
-      lValidRecords = readDataPoints(infileStream, pDataBuffer, lDataCount);      // Read TISAN records into the X-Y data point array buffer
+      lValidRecords = readDataPoints(inputMap, pDataBuffer, lDataCount);      // Copy TISAN records into the X-Y data point array buffer
+
+      zTaskMessage(3,"Fitting to %ld Records\n",lValidRecords);
 
-      if (ferror(infileStream))
+      zMapClose(inputMap);
+      inputMap = (struct ZMAP *)NIL;
+
+      if (lValidRecords < (long)qCount)   // Not enough points to pin down the parameters
          {
-         zTaskMessage(10,"Error reading file data.\n");
-         zError();
-         BombOff(1);
-         }
+         zTaskMessage(bBatch ? 5 : 10,"%ld unflagged records cannot fit %d parameters.\n", lValidRecords, qCount);
+         if (!bBatch) BombOff(1);
 
-      zTaskMessage(3,"Fitting to %ld Records\n",lValidRecords);
+         zTaskMessage(5,"Skipping '%s'.\n",infileName);
+         saveResult(pWild, qCount, FIT_SKIPPED, lValidRecords);
+         fcloseall();
+         continue;
+         }
 
-      Zclose(infileStream);
-      infileStream = (FILE *)NIL;
+      if (bBatch) for (i = 0; i < PARMSCOUNT; ++i) PARMS[i] = startParms[i];
 
       if ((ITYPE == 0) && (iFactor == 1))      // Special processing for a simple linear fit
          iEndCode = findLinearFit(pDataBuffer, lValidRecords);
       else if ((ITYPE == 0) && (iFactor == 2)) // Special processing for a not-as-simple quadratic fit
          iEndCode = findQuadFit(pDataBuffer, lValidRecords);
       else
-         iEndCode = findFit(pDataBuffer, lValidRecords, qCount, &options);
+         iEndCode = multiStartFit(pDataBuffer, lValidRecords, qCount, &options);
 
       reportResults(qCount, iEndCode);
+
+      if (bBatch) saveResult(pWild, qCount, iEndCode, lValidRecords);
       
       if (bCreateOutputFile)
          {
@@ -268,6 +417,15 @@ int main(int argc, char *argv[])
       fcloseall();
       } // for (iwc = 0, pWild = CatList->pList;
 
+   if (bBatch && !isWorker())
+      {
+      ERRFLAG = zWaitWorkers(ERRFLAG);   // All the results are in once the workers are done
+
+      if (!ERRFLAG) ERRFLAG = writeSummary(qCount, nFiles);
+
+      unlink(resultsName);
+      }
+
    ZCatFiles((char*)NIL); // free catalog memory
 
    Zexit(ERRFLAG);
@@ -294,6 +452,12 @@ void reportResults(int qCount, int iEndCode)
          case 3:
             zTaskMessage(3,"Error function below minimum value.\n");
             break;
+         case 4:
+            zTaskMessage(3,"Converged: change in the error function below tolerance.\n");
+            break;
+         case 5:
+            zTaskMessage(3,"Damping factor above maximum value, no step lowers the error function.\n");
+            break;
          }
       } // if ((ITYPE != 0) || ((iFactor != 1) && (iFactor != 2)))
 
@@ -305,7 +469,7 @@ void reportResults(int qCount, int iEndCode)
       }
    zTaskMessage(5, "\n");
 
-   if ((CODE == 1) || (CODE == 3))
+   if ((CODE & 1) && !bBatch)  // CODE 1 or 3, a batch fit has the summary file instead
       {
       if (zPutAdverbs(TASKNAME)) zTaskMessage(9, "Unable to update inputs file for task '%s'\n", TASKNAME);
       }
@@ -313,6 +477,160 @@ void reportResults(int qCount, int iEndCode)
    return;
    } // main
 
+/*****************************************************
+** Append the result of a batch fit to the results file.
+** A file that was skipped (FIT_SKIPPED) gets an RMS error of -1.
+**
+** Every process appends whole records to the same file, which is
+** opened for each record so each one goes out in a single write.
+*/
+void saveResult(char *pName, int qCount, int iEndCode, long dataCount)
+   {
+   struct FITRESULT result;
+   int i;
+
+   memset(&result, 0, sizeof(result));
+   strncpy(result.szName, pName, _MAX_PATH - 1);
+
+   if (iEndCode == FIT_SKIPPED)
+      result.rms = -1.0;
+   else
+      {
+      for (i = 0; i < qCount; ++i) result.q[i] = PARMS[i];
+
+      result.rms = rmsError(errorFunction(pDataBuffer, dataCount, PARMS), dataCount);
+      }
+
+   result.nPoints  = dataCount;
+   result.iEndCode = iEndCode;
+
+   if ((outfileStream = zOpen(resultsName,O_appendb)) == NULL) BombOff(1);
+
+   fwrite(&result, sizeof(result), 1, outfileStream);
+
+   if (ferror(outfileStream))
+      {
+      zTaskMessage(10,"Error writing the results file.\n");
+      zError();
+      BombOff(1);
+      }
+
+   Zclose(outfileStream);
+   outfileStream = (FILE *)NIL;
+
+   return;
+   }
+
+/*****************************************************
+** Write the summary files of a batch fit
+**
+** The files are numbered in name order starting at 1. There is one time
+** labeled file for each quantity, OUTNAME with class Q0 to Qn-1 for the
+** parameters and RMS for the RMS error, each with one record per file at
+** its file number. A file that was skipped has no parameter records and
+** an RMS error of -1.
+*/
+short writeSummary(int qCount, int nFiles)
+   {
+   struct FITRESULT *pResults;
+   struct TRData record;
+   struct FILEHDR SummaryHeader;
+   char summaryName[_MAX_PATH];
+   char szClass[_MAX_EXT];
+   long nResults;
+   short ERRFLAG = 0;
+   int i, j;
+
+   if ((outfileStream = zOpen(resultsName,O_readb)) == NULL) BombOff(1);
+
+   pResults = (struct FITRESULT *)malloc(nFiles * sizeof(struct FITRESULT));
+   if (!pResults)
+      {
+      zTaskMessage(10,"Memory allocation of %ld bytes failed.\n", nFiles * sizeof(struct FITRESULT));
+      BombOff(1);
+      }
+
+   nResults = (long)fread(pResults, sizeof(struct FITRESULT), nFiles, outfileStream);
+   Zclose(outfileStream);
+   outfileStream = (FILE *)NIL;
+
+   if (nResults != nFiles)
+      {
+      zTaskMessage(10,"Only %ld of %d files were fit.\n", nResults, nFiles);
+      free(pResults);
+      return(1);
+      }
+
+   qsort(pResults, nFiles, sizeof(struct FITRESULT), compareResults);
+
+   strcpy(szClass, OUTCLASS);
+
+   for (j = 0; (j <= qCount) && !ERRFLAG; ++j)
+      {
+      memset(&SummaryHeader, 0, sizeof(SummaryHeader));
+      strcpy(SummaryHeader.szTitle, "DBFIT Summary");
+      strcpy(SummaryHeader.szTlabel, "File Number");
+      SummaryHeader.type = TR_Data;
+      SummaryHeader.m = 1.0;
+      zSetSorted(&SummaryHeader, TRUE);
+
+      if (j < qCount)
+         {
+         sprintf(OUTCLASS, "Q%d", j);
+         sprintf(SummaryHeader.szYlabel, "q[%d]", j);
+         }
+      else
+         {
+         strcpy(OUTCLASS, "RMS");
+         strcpy(SummaryHeader.szYlabel, "RMS Error");
+         }
+
+      zBuildFileName(M_outname,summaryName);
+      zBuildFileName(M_tmpname,tempfileName);
+
+      zTaskMessage(2,"Opening Scratch File '%s'\n",tempfileName);
+      if ((outfileStream = zOpen(tempfileName,O_writeb)) == NULL) BombOff(1);
+
+      if (Zputhead(outfileStream,&SummaryHeader)) BombOff(1);
+
+      for (i = 0; i < nFiles; ++i)
+         {
+         if ((j < qCount) && (pResults[i].iEndCode == FIT_SKIPPED)) continue;   // Nothing to report for a file that was not fit
+
+         record.t = (double)(i + 1);
+         record.y = (j < qCount) ? pResults[i].q[j] : pResults[i].rms;
+         if (Zwrite(outfileStream,(char *)&record,TR_Data)) BombOff(1);
+         }
+
+      Zclose(outfileStream);
+      outfileStream = (FILE *)NIL;
+
+      ERRFLAG = zNameOutputFile(summaryName,tempfileName);
+      }
+
+   strcpy(OUTCLASS, szClass);
+
+   zTaskMessage(3,"\n");
+   zTaskMessage(3,"File  RMS Error     Name\n");
+
+   for (i = 0; i < nFiles; ++i)
+      {
+      if (pResults[i].iEndCode == FIT_SKIPPED)
+         zTaskMessage(3,"%4d  %-12s  %s\n", i + 1, "skipped", pResults[i].szName);
+      else
+         zTaskMessage(3,"%4d  %-12lG  %s\n", i + 1, pResults[i].rms, pResults[i].szName);
+      }
+
+   free(pResults);
+
+   return(ERRFLAG);
+   }
+
+int compareResults(const void *pA, const void *pB)
+   {
+   return(strcmp(((struct FITRESULT *)pA)->szName, ((struct FITRESULT *)pB)->szName));
+   }
+
 /*****************************************************
 ** Write data to the output file
 **
@@ -343,21 +661,19 @@ void writeOutputFile(struct TRData* data, long lRecordCount)
 
 /************************************************
 **
-** Read the data file in as X-Y pairs
-** Returns the number of data points actually read into the buffer.
+** Extract the mapped data file as X-Y pairs
+** Returns the number of data points actually copied into the buffer.
 **
 */
-long readDataPoints(FILE* infileStream, point* pDataBuffer, long lDataCount)
+long readDataPoints(struct ZMAP* inputMap, point* pDataBuffer, long lDataCount)
    {
    long i, index = 0L;
-   char BUFFER[sizeof(struct TXData)]; // Largest data size (just in case) for a single data record
+   char *record = inputMap->records;
    point* pp;
    
-   for (i = 0L; i < lDataCount; ++i)                           // Loop through all the records in the TISAN file
+   for (i = 0L; i < lDataCount; ++i, record += inputMap->size)  // Loop through all the records in the TISAN file
       {
-      zGetData(1L, infileStream, BUFFER, FileHeader.type);     // Read in a single record
-
-      pp = getXYdata(BUFFER, i, FileHeader.type);              // Extract X-Y data pair from the TISAN record
+      pp = getXYdata(record, i, FileHeader.type);              // Extract X-Y data pair from the TISAN record
       
       if (pp)        // Pointer is valid so we might keep this point
          {
@@ -440,23 +756,48 @@ int setFunctionPointer(struct configOptions* options)
    options->lambdaDecrease = LAMBDADECREASEDEFAULT;     // Decrease the learning factor by two if we go up hill
    options->lambdaIncrease = LAMBDAINCREASEDEFAULT;     // Increase by 1.5 wqhen we go down hill
    options->dqValue        = DQVALUEDEFAULT;            // How big is delta-q for taking the derivatives
+
+   options->maxLambda      = MAXDAMPINGDEFAULT;         // Levenberg-Marquardt gives up when the damping factor gets this big
+   options->tolerance      = TOLERANCEDEFAULT;          // and has converged when a step barely lowers the error
+
+   bSteepestDescent = (CODE & 4) ? TRUE : FALSE;
+
+   if (!bSteepestDescent)  // Levenberg-Marquardt uses a damping factor that goes the other way
+      {
+      options->lambdaStart    = DAMPINGSTARTDEFAULT;
+      options->lambdaDecrease = DAMPINGUPDEFAULT;      // Going up hill increases the damping factor
+      options->lambdaIncrease = DAMPINGDOWNDEFAULT;    // Going down hill decreases it
+      }
    
 /*
 **  POINT   - LOOPMAX, MINERROR
-**  ZFACTOR - LAMBDASTART, MINLAMBDA
+**  ZFACTOR - LAMBDASTART, MINLAMBDA (MAXDAMPING)
 **  TMAJOR -  LAMBDADECREASE, LAMBDAINCREASE
-**  YMAJOR -  DQVALUE
+**  YMAJOR -  DQVALUE, TOLERANCE
 */
    if (POINT[0] > 0.0) options->loopMax  = POINT[0];
    if (POINT[1] > 0.0) options->minError = POINT[1];
 
    if (ZFACTOR[0] > 0.0) options->lambdaStart = ZFACTOR[0];
-   if (ZFACTOR[1] > 0.0) options->minLambda   = ZFACTOR[1];
+   if (ZFACTOR[1] > 0.0)
+      {
+      if (bSteepestDescent)
+         options->minLambda = ZFACTOR[1];
+      else
+         options->maxLambda = ZFACTOR[1];
+      }
 
    if (TMAJOR[0] >= 1.0) options->lambdaDecrease = TMAJOR[0];
    if (TMAJOR[1] >= 1.0) options->lambdaIncrease = TMAJOR[1];
 
-   if (YMAJOR[0] > 0.0) options->dqValue = YMAJOR[0];
+   if (YMAJOR[0] > 0.0) options->dqValue   = YMAJOR[0];
+   if (YMAJOR[1] > 0.0) options->tolerance = YMAJOR[1];
+
+/*
+**  ZMAJOR -  STARTS, JITTER
+*/
+   options->nStarts = (ZMAJOR[0] >= 1.0) ? (int)ZMAJOR[0] : STARTSDEFAULT;
+   options->jitter  = (ZMAJOR[1] > 0.0) ? ZMAJOR[1] : JITTERDEFAULT;
 
    switch (ITYPE)
       {
@@ -469,26 +810,31 @@ int setFunctionPointer(struct configOptions* options)
             }
          qCount = iFactor + 1;                              // Number of parameters for the polynomial is one more than the order
          function = polynomial;
+         blockFunction = polynomialBlock;
          zTaskMessage(3,"Fitting Polynomial of Order %d\n",iFactor);
          break;
       case 1: // Gaussian
          qCount = 4;
          function = gaussian;
+         blockFunction = gaussianBlock;
          zTaskMessage(3,"Fitting Gaussian with %d Parameters\n",qCount);
          break;
       case 2: // Double Gaussian
          qCount = 7;
          function = doubleGaussian;
+         blockFunction = doubleGaussianBlock;
          zTaskMessage(3,"Fitting Double Gaussian with %d Parameters\n",qCount);
          break;
       case 3: // Exponential
          qCount = 3;
          function = exponential;
+         blockFunction = exponentialBlock;
          zTaskMessage(3,"Fitting Exponential with %d Parameters\n",qCount);
          break;
       case 4: // A Sin(w t + phi) + B
          qCount = 4;
          function = sineFunction;
+         blockFunction = sineBlock;
          zTaskMessage(3,"Fitting Sine Function with %d Parameters\n",qCount);
          break;
       default:
@@ -623,6 +969,63 @@ int findQuadFit(point data[], long dataCount)
    return(0);
    }
 
+/************************************************
+**
+** Fit from PARMS[] and from options->nStarts - 1 jittered copies of it, and keep
+** the fit with the lowest error in PARMS[]. Each value of a jittered start is moved
+** by up to ±jitter of itself (or by up to ±jitter if it is zero). The random
+** numbers are seeded the same way every time, so every file of a batch gets the
+** same starting points. Returns the end code of the fit that was kept.
+**
+*/
+int multiStartFit(point data[], long dataCount, int qCount, struct configOptions *options)
+   {
+   double start[PARMSCOUNT], best[PARMSCOUNT];
+   double error, bestError = 0.0, u;
+   int iStart, iBest = 0, i, iEndCode, bestCode = 0;
+
+   for (i = 0; i < PARMSCOUNT; ++i) start[i] = best[i] = PARMS[i];
+
+   srand(1);
+
+   for (iStart = 0; iStart < options->nStarts; ++iStart)
+      {
+      for (i = 0; i < PARMSCOUNT; ++i) PARMS[i] = start[i];
+
+      if (iStart > 0)
+         {
+         for (i = 0; i < qCount; ++i)
+            {
+            u = 2.0 * ((double)rand() / (double)RAND_MAX) - 1.0;   // -1 to 1
+            PARMS[i] += options->jitter * u * ((start[i] != 0.0) ? fabs(start[i]) : 1.0);
+            }
+         }
+
+      if (options->nStarts > 1) zTaskMessage(3,"Starting Point %d of %d\n", iStart + 1, options->nStarts);
+
+      if (bSteepestDescent)
+         iEndCode = findFit(data, dataCount, qCount, options);
+      else
+         iEndCode = findMarquardtFit(data, dataCount, qCount, options);
+
+      error = errorFunction(data, dataCount, PARMS);
+
+      if ((iStart == 0) || (error < bestError))
+         {
+         bestError = error;
+         bestCode = iEndCode;
+         iBest = iStart;
+         for (i = 0; i < PARMSCOUNT; ++i) best[i] = PARMS[i];
+         }
+      }
+
+   for (i = 0; i < PARMSCOUNT; ++i) PARMS[i] = best[i];
+
+   if (options->nStarts > 1) zTaskMessage(3,"Keeping starting point %d, RMS error = %lG\n", iBest + 1, rmsError(bestError, dataCount));
+
+   return(bestCode);
+   }
+
 /************************************************
 **
 ** Function to find the fit. Return value depends on how the function ended
@@ -679,22 +1082,7 @@ int findFit(point data[], long dataCount, int qCount, struct configOptions *opti
 */
 double errorFunction(point data[], long dataCount, double q[])
    {
-   long i;
-   double error = 0.0;
-   double v;
-   
-   for (i = 0L; i < dataCount; ++i)
-      {
-//      printf("DEBUG errorFunction:%d\t (%lG, %lG), %lG\n", i, data[i].x, data[i].y, function(data[i].x, q));
-
-      v = data[i].y - function(data[i].x, q);
-      error += (v * v);
-      
-      }
-   
-   error /= 2.0;
-   
-   return(error);
+   return(fitPass(data, dataCount, q, 0, FIT_ERROR, 0.0, (double *)NIL));
    }
 
 /*
@@ -706,54 +1094,30 @@ double rmsError(double error, long dataCount)
    }
 
 /*
-** Partial Derivative with respect to a parameter in the q[] array
+** Step in a parameter of the q[] array for taking a partial derivative
 **
 ** ∂f/∂q = (f(x, q + ∆q) - f(x, q - ∆q))/(2 ∆q)
 **
-** x is the current x-value for the function evaluation
-** qIndex is the index of the parameter being tested
-** q[] if the array of parameters
+** originalq is the current value of the parameter being tested
 ** dq is a scaling factor (less than 1) for determining the offset on either side of q for the derivative
 **
-*/
-double partialDerivative(double x, int qIndex, double q[], double dq)
-   {
-   double dfdq;
-   double deltaq;
-   double originalq;
-   
-   originalq = q[qIndex];           // Need a copy of the current q value that is being tested
-   deltaq = originalq * dq;         // Get the delta q based on the dq argument
-
-/*
 ** The derivative is taken by getting a delta on either side of the current point,
 ** but the delta value is scaled based on the value of the current point. If that value is
 ** zero we have a problem because we divide by 2*deltaq so we force the value to be non-zero.
 ** We also make sure that deltaq is positive while we are at it.
 */
+double partialStep(double originalq, double dq)
+   {
+   double deltaq;
+
+   deltaq = originalq * dq;         // Get the delta q based on the dq argument
 
    if (deltaq == 0.0)
       deltaq = dq * dq;                           // Make deltaq non-zero (this works pretty well)
    else
       deltaq = (deltaq < 0.0) ? -deltaq : deltaq; // ensure deltaq is non-negative
-   
-   q[qIndex] = originalq + deltaq;  // Bump up the q value by a small amount
-   dfdq = function(x,q);            // Get the value of the function
-
-//   printf("DEBUG: partialDerivative-1: %lG,\t", dfdq);
-
-   q[qIndex] = originalq - deltaq;  // Now go down a bit
-   dfdq -= function(x,q);           // Get the difference
-
-// printf("%lG,\t", dfdq);
-   
-   dfdq /= (2.0 * deltaq);          // And now we have a derivative
 
-//printf("%lG,\n", dfdq);
-   
-   q[qIndex] = originalq;           // Restore the q[] array for the next derivative (if any)
-
-   return(dfdq);
+   return(deltaq);
    }
 
 /*
@@ -772,35 +1136,19 @@ double partialDerivative(double x, int qIndex, double q[], double dq)
 */
 BOOL calculateNewParameters(point data[], long dataCount, double q[], double lambda, int qCount, double dq, struct configOptions *options)
    {
-   double partialE;
    double newq[qCount];
+   double sums[1 + qCount];
    double oldError, newError;
-   double pDer;
-   long i;
    int j;
    BOOL worse = TRUE;
 
 /*
-** Get the current (old) value of the error function so we can test if things get worse
+** Get the current (old) value of the error function so we can test if things get worse,
+** along with the partial derivative of the error function for each delta q
 */
-   oldError = errorFunction(data, dataCount, q);
+   oldError = fitPass(data, dataCount, q, qCount, FIT_GRADIENT, dq, sums);
 
-/*
-** Take the partial derivative of the error function and find each delta q
-*/
-   for (j = 0; j < qCount; ++j)
-      {
-      partialE = 0.0;
-      for (i = 0L; i < dataCount; ++i)
-         {
-         pDer = partialDerivative(data[i].x, j, q, dq);
-         partialE += (data[i].y - function(data[i].x, q)) * pDer;   //  ∂E/∂q[i] = ∑(Y[t] - f(q[];t)) ∂f(q[];t)/∂q[i]
-
-// printf("DEBUG: calculateNewParameters: %d, %d\t, %lG, %lG\n", j, i, pDer, partialE);
-         }
-
-      newq[j] = q[j] + lambda * partialE;
-      }
+   for (j = 0; j < qCount; ++j) newq[j] = q[j] + lambda * sums[1 + j];   //  ∂E/∂q[i] = ∑(Y[t] - f(q[];t)) ∂f(q[];t)/∂q[i]
 /*
 ** Now get the new value of the error function. If it is larger than before then we are going up hill.
 ** The calling routine should reduce the size of the lambda factor and try again.
@@ -828,6 +1176,287 @@ BOOL calculateNewParameters(point data[], long dataCount, double q[], double lam
    return(worse);
    }
 
+/************************************************
+**
+** Levenberg-Marquardt fit. Return value depends on how the function ended
+** 1 -> Reached the max loop count
+** 3 -> Error function got too small
+** 4 -> A step lowered the error function by less than the tolerance (converged)
+** 5 -> Damping factor got too big (no step lowers the error function)
+**
+** Each iteration solves (α + μ diag(α)) ∆q = β, where α and β are built from the
+** analytic derivatives of the function. Only the error function is evaluated for a
+** step that goes up hill; α and β are rebuilt after a step is taken.
+**
+*/
+int findMarquardtFit(point data[], long dataCount, int qCount, struct configOptions *options)
+   {
+   int returnCode = 0;
+   long iteration = 0L;
+   int i, j;
+   double q[PARMSCOUNT], newq[PARMSCOUNT];
+   double alpha[PARMSCOUNT][PARMSCOUNT], a[PARMSCOUNT][PARMSCOUNT];
+   double beta[PARMSCOUNT], dq[PARMSCOUNT];
+   double error, newError, mu;
+
+   mu = options->lambdaStart;
+
+   for (i = 0; i < PARMSCOUNT; ++i) q[i] = newq[i] = PARMS[i];  // Need a local copy of the parameters since we will be tweaking them
+
+   error = normalEquations(data, dataCount, q, qCount, alpha, beta);
+   zTaskMessage(3, "Initial RMS error = %lG\n", rmsError(error, dataCount));
+
+   do {
+      for (i = 0; i < qCount; ++i)
+         {
+         for (j = 0; j < qCount; ++j) a[i][j] = alpha[i][j];
+         a[i][i] += mu * ((alpha[i][i] > 0.0) ? alpha[i][i] : 1.0);  // A parameter with no effect still needs a non-zero diagonal
+         dq[i] = beta[i];
+         }
+
+      newError = error;
+
+      if (solveLinearSystem(a, dq, qCount))
+         {
+         for (i = 0; i < qCount; ++i) newq[i] = q[i] + dq[i];
+         newError = errorFunction(data, dataCount, newq);
+         }
+
+      if (newError < error)    // Went down hill, so take the step and trust the linear model a little more
+         {
+         for (i = 0; i < qCount; ++i) q[i] = newq[i];
+
+         if ((error - newError) <= options->tolerance * error) returnCode = 4;   // Barely moved, so we are at the bottom
+
+         error = normalEquations(data, dataCount, q, qCount, alpha, beta);
+         mu /= options->lambdaIncrease;
+         }
+      else                     // Up hill (or no usable step), so lean more toward steepest descent
+         {
+         mu *= options->lambdaDecrease;
+         if (mu > options->maxLambda) returnCode = 5;
+         }
+
+      if (returnCode)                                                ;               // Already have a reason to stop
+      else if (++iteration >= options->loopMax)                       returnCode = 1; // We hit the max number of iterations
+      else if (rmsError(error, dataCount) <= options->minError)       returnCode = 3; // Success! The RMS error is below the stated minimum
+      }
+   while (!returnCode);
+
+   zTaskMessage(3, "Stopping after %ld iterations\n", iteration);
+   zTaskMessage(3, "Final damping factor = %lG\n", mu);
+   zTaskMessage(3, "Final RMS error = %lG\n", rmsError(error, dataCount));
+
+   for (i = 0; i < qCount; ++i) PARMS[i] = q[i];     // Need to make the results visible to the rest of the TASK
+
+   return(returnCode);
+   }
+
+/*
+** Build the normal equations for the current parameters using the analytic derivatives
+**
+** α[i][j] = ∑ ∂f/∂q[i] ∂f/∂q[j]
+** β[i] = ∑(Y[t] - f(q[];t)) ∂f/∂q[i]
+**
+** Returns the error function E = ½∑(Y[t] - f(q[];t))²
+*/
+double normalEquations(point data[], long dataCount, double q[], int qCount, double alpha[][PARMSCOUNT], double beta[])
+   {
+   double sums[1 + PARMSCOUNT + PARMSCOUNT * PARMSCOUNT];
+   double error;
+   int i, j;
+
+   error = fitPass(data, dataCount, q, qCount, FIT_NORMAL, 0.0, sums);
+
+   for (i = 0; i < qCount; ++i)
+      {
+      beta[i] = sums[1 + i];
+      for (j = 0; j <= i; ++j) alpha[i][j] = alpha[j][i] = sums[1 + qCount + i * qCount + j];  // Only the lower half is summed
+      }
+
+   return(error);
+   }
+
+/*
+** One pass over the data. Returns the error function E = ½∑(Y[t] - f(q[];t))²
+** and for FIT_GRADIENT and FIT_NORMAL fills sums[1...] as laid out in FITTHREAD.
+**
+** Each block of FITBLOCK points gives one set of partial sums. The threads take
+** every nThreads'th block and the partial sums are then added pairwise in block order,
+** which keeps the rounding error down and the answer independent of the thread count.
+*/
+double fitPass(point data[], long dataCount, double q[], int qCount, int iMode, double dq, double sums[])
+   {
+   struct FITWORK work;
+   long lSize, b, stride;
+   int k;
+
+   work.data      = data;
+   work.dataCount = dataCount;
+   work.nBlocks   = (dataCount + FITBLOCK - 1) / FITBLOCK;
+   work.q         = q;
+   work.qCount    = qCount;
+   work.iMode     = iMode;
+   work.dq        = dq;
+
+   switch (iMode)
+      {
+      case FIT_GRADIENT:
+         work.width = 1 + qCount;
+         break;
+      case FIT_NORMAL:
+         work.width = 1 + qCount + qCount * qCount;
+         break;
+      default:
+         work.width = 1;
+         break;
+      }
+
+   if (work.nBlocks == 0L)   // No data, so every sum is zero
+      {
+      if (sums) for (k = 0; k < work.width; ++k) sums[k] = 0.0;
+      return(0.0);
+      }
+
+   lSize = work.nBlocks * work.width;
+   if (lSize > lPartialsSize)
+      {
+      if (pPartials) free(pPartials);
+      if ((pPartials = (double *)malloc(lSize * sizeof(double))) == NULL)
+         {
+         lPartialsSize = 0L;
+         zTaskMessage(10,"Memory allocation of %ld bytes failed.\n", lSize * sizeof(double));
+         BombOff(1);
+         }
+      lPartialsSize = lSize;
+      }
+   work.pPartials = pPartials;
+
+   zRunThreads(Min(nThreads, work.nBlocks), FITTHREAD, &work);
+
+   for (stride = 1L; stride < work.nBlocks; stride *= 2L)
+      {
+      for (b = 0L; b + stride < work.nBlocks; b += 2L * stride)
+         {
+         for (k = 0; k < work.width; ++k) pPartials[b * work.width + k] += pPartials[(b + stride) * work.width + k];
+         }
+      }
+
+   if (sums) for (k = 0; k < work.width; ++k) sums[k] = pPartials[k];
+
+   return(pPartials[0] / 2.0);
+   }
+
+/***************************************************************
+**
+** Thread work function: every nThreads'th block of the data
+**
+** The partial sums of a block are
+** [0]                       ∑r²
+** [1 + i]                   ∑r ∂f/∂q[i]                 (FIT_GRADIENT and FIT_NORMAL)
+** [1 + qCount + i*qCount + j] ∑∂f/∂q[i] ∂f/∂q[j], j <= i  (FIT_NORMAL)
+**
+** where r = Y[t] - f(q[];t)
+*/
+void FITTHREAD(int iThread, int nThreads, void *pData)
+   {
+   struct FITWORK *pWork = (struct FITWORK *)pData;
+   double x[FITBLOCK], r[FITBLOCK], y[FITBLOCK];
+   double dfdq[PARMSCOUNT][FITBLOCK];
+   double qq[PARMSCOUNT];
+   double *pSums, deltaq;
+   point *pp;
+   long b, n, k;
+   int i, j, qCount = pWork->qCount;
+
+   for (b = iThread; b < pWork->nBlocks; b += nThreads)
+      {
+      pp = pWork->data + b * FITBLOCK;
+      n = Min(FITBLOCK, pWork->dataCount - b * FITBLOCK);
+      pSums = pWork->pPartials + b * pWork->width;
+
+      for (k = 0L; k < n; ++k) x[k] = pp[k].x;
+
+      blockFunction(x, n, pWork->q, y, (pWork->iMode == FIT_NORMAL) ? dfdq : NULL);
+
+      for (k = 0L; k < n; ++k) r[k] = pp[k].y - y[k];
+
+      pSums[0] = zDot(r, r, n);
+
+      switch (pWork->iMode)
+         {
+         case FIT_GRADIENT:   // ∂f(q[];t)/∂q[i] = (f(q[], q[i] + δ q[i];t) - f(q[], q[i] - δ q[i];t))/ (2 δ q[i])
+            for (i = 0; i < PARMSCOUNT; ++i) qq[i] = pWork->q[i];
+
+            for (i = 0; i < qCount; ++i)
+               {
+               deltaq = partialStep(qq[i], pWork->dq);
+
+               qq[i] = pWork->q[i] + deltaq;
+               blockFunction(x, n, qq, y, NULL);
+               qq[i] = pWork->q[i] - deltaq;
+               blockFunction(x, n, qq, dfdq[0], NULL);
+               qq[i] = pWork->q[i];
+
+               for (k = 0L; k < n; ++k) y[k] -= dfdq[0][k];
+
+               pSums[1 + i] = zDot(r, y, n) / (2.0 * deltaq);
+               }
+            break;
+         case FIT_NORMAL:
+            for (i = 0; i < qCount; ++i)
+               {
+               pSums[1 + i] = zDot(r, dfdq[i], n);
+               for (j = 0; j <= i; ++j) pSums[1 + qCount + i * qCount + j] = zDot(dfdq[i], dfdq[j], n);
+               }
+            break;
+         }
+      }
+
+   return;
+   }
+
+/*
+** Solve a x = b by Gaussian elimination with partial pivoting.
+** The solution replaces b and a is destroyed.
+** Returns FALSE if the matrix is singular.
+*/
+BOOL solveLinearSystem(double a[][PARMSCOUNT], double b[], int n)
+   {
+   int i, j, k, pivot;
+   double v;
+
+   for (k = 0; k < n; ++k)
+      {
+      pivot = k;
+      for (i = k + 1; i < n; ++i) if (fabs(a[i][k]) > fabs(a[pivot][k])) pivot = i;
+
+      if (a[pivot][k] == 0.0) return(FALSE);
+
+      if (pivot != k)
+         {
+         for (j = k; j < n; ++j) {v = a[k][j]; a[k][j] = a[pivot][j]; a[pivot][j] = v;}
+         v = b[k]; b[k] = b[pivot]; b[pivot] = v;
+         }
+
+      for (i = k + 1; i < n; ++i)
+         {
+         v = a[i][k] / a[k][k];
+         for (j = k; j < n; ++j) a[i][j] -= v * a[k][j];
+         b[i] -= v * b[k];
+         }
+      }
+
+   for (k = n - 1; k >= 0; --k)
+      {
+      for (j = k + 1; j < n; ++j) b[k] -= a[k][j] * b[j];
+      b[k] /= a[k][k];
+      if (!isfinite(b[k])) return(FALSE);
+      }
+
+   return(TRUE);
+   }
+
 /************************************************
 **
 ** ITYPE = 0
@@ -855,6 +1484,34 @@ double polynomial(double x, double q[])
    return(y);
    }
 
+/*
+** Block form of the polynomial, with the partial derivatives ∂f/∂q[n-i] = x^i if dfdq is not NULL
+*/
+void polynomialBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK])
+   {
+   long k;
+   int i;
+
+   for (k = 0L; k < n; ++k) y[k] = q[0];
+
+   for (i = 1; i <= iFactor; ++i)
+      {
+      for (k = 0L; k < n; ++k) y[k] = y[k] * x[k] + q[i];   // Horner's rule
+      }
+
+   if (dfdq)
+      {
+      for (k = 0L; k < n; ++k) dfdq[iFactor][k] = 1.0;
+
+      for (i = iFactor - 1; i >= 0; --i)
+         {
+         for (k = 0L; k < n; ++k) dfdq[i][k] = dfdq[i + 1][k] * x[k];
+         }
+      }
+
+   return;
+   }
+
 /************************************************
 **
 ** ITYPE = 1
@@ -875,6 +1532,55 @@ double gaussian(double x, double q[])
    return(y);
    }
 
+/*
+** Block form of the Gaussian, with the partial derivatives if dfdq is not NULL
+*/
+void gaussianBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK])
+   {
+   long k;
+
+   for (k = 0L; k < n; ++k) y[k] = q[3];
+
+   addGaussian(x, n, q, y, dfdq);
+
+   if (dfdq) for (k = 0L; k < n; ++k) dfdq[3][k] = 1.0;
+
+   return;
+   }
+
+/*
+** Add q[0] exp((-(x - q[1])^2)*(q[2]^2)) to y[] and put its partial derivatives in dfdq[0] to dfdq[2]
+*/
+void addGaussian(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK])
+   {
+   double w, e;
+   long k;
+
+   if (dfdq)
+      {
+      for (k = 0L; k < n; ++k)
+         {
+         w = (x[k] - q[1]) * q[2];
+         e = exp(-(w * w));
+
+         y[k] += q[0] * e;
+         dfdq[0][k] = e;
+         dfdq[1][k] = 2.0 * q[0] * e * w * q[2];
+         dfdq[2][k] = -2.0 * q[0] * e * w * (x[k] - q[1]);
+         }
+      }
+   else
+      {
+      for (k = 0L; k < n; ++k)
+         {
+         w = (x[k] - q[1]) * q[2];
+         y[k] += q[0] * exp(-(w * w));
+         }
+      }
+
+   return;
+   }
+
 /************************************************
 **
 ** ITYPE = 2
@@ -899,6 +1605,23 @@ double doubleGaussian(double x, double q[])
    return(y);
    }
 
+/*
+** Block form of the double Gaussian, with the partial derivatives if dfdq is not NULL
+*/
+void doubleGaussianBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK])
+   {
+   long k;
+
+   for (k = 0L; k < n; ++k) y[k] = q[6];
+
+   addGaussian(x, n, q, y, dfdq);
+   addGaussian(x, n, q + 3, y, dfdq ? dfdq + 3 : NULL);
+
+   if (dfdq) for (k = 0L; k < n; ++k) dfdq[6][k] = 1.0;
+
+   return;
+   }
+
 /************************************************
 **
 ** ITYPE = 3
@@ -915,6 +1638,34 @@ double exponential(double x, double q[])
    return(y);
    }
 
+/*
+** Block form of the exponential, with the partial derivatives if dfdq is not NULL
+*/
+void exponentialBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK])
+   {
+   double e;
+   long k;
+
+   if (dfdq)
+      {
+      for (k = 0L; k < n; ++k)
+         {
+         e = exp(-x[k] * q[1]);
+
+         y[k] = q[0] * e + q[2];
+         dfdq[0][k] = e;
+         dfdq[1][k] = -x[k] * q[0] * e;
+         dfdq[2][k] = 1.0;
+         }
+      }
+   else
+      {
+      for (k = 0L; k < n; ++k) y[k] = q[0] * exp(-x[k] * q[1]) + q[2];
+      }
+
+   return;
+   }
+
 /************************************************
 **
 ** ITYPE = 4
@@ -931,6 +1682,36 @@ double sineFunction(double x, double q[])
    return(y);
    }
 
+/*
+** Block form of the sine function, with the partial derivatives if dfdq is not NULL
+*/
+void sineBlock(double x[], long n, double q[], double y[], double dfdq[][FITBLOCK])
+   {
+   double s, c;
+   long k;
+
+   if (dfdq)
+      {
+      for (k = 0L; k < n; ++k)
+         {
+         s = sin(q[1] * x[k] + q[2]);
+         c = q[0] * cos(q[1] * x[k] + q[2]);
+
+         y[k] = q[0] * s + q[3];
+         dfdq[0][k] = s;
+         dfdq[1][k] = c * x[k];
+         dfdq[2][k] = c;
+         dfdq[3][k] = 1.0;
+         }
+      }
+   else
+      {
+      for (k = 0L; k < n; ++k) y[k] = q[0] * sin(q[1] * x[k] + q[2]) + q[3];
+      }
+
+   return;
+   }
+
 
 /***************************************************************
 **
@@ -953,20 +1734,25 @@ void BombOff(int a)
    {
    fcloseall();
    unlink(tempfileName);
+   if (*resultsName && !isWorker()) unlink(resultsName);   // The results file belongs to the original process
    ZCatFiles((char*)NIL); // free catalog memory
    Zexit(a);
    }
 
 void fcloseall()
    {
-   if (infileStream) Zclose(infileStream);
-   infileStream = (FILE *)NIL;
+   if (inputMap) zMapClose(inputMap);
+   inputMap = (struct ZMAP *)NIL;
    
    if (outfileStream) Zclose(outfileStream);
    outfileStream = (FILE *)NIL;
 
    if (pDataBuffer) free(pDataBuffer);
    pDataBuffer = (point *)NIL;
+
+   if (pPartials) free(pPartials);
+   pPartials = (double *)NIL;
+   lPartialsSize = 0L;
    
    return;
    }
@@ -65,6 +65,9 @@ char szTemporaryFile[_MAX_PATH];  /* Must be global so BREAKREQ can see it */
 FILE *inputFile  = (FILE *)NIL;
 FILE *outputFile = (FILE *)NIL;
 
+struct ZSTREAM *inputRecords  = (struct ZSTREAM *)NIL;
+struct ZSTREAM *outputRecords = (struct ZSTREAM *)NIL;
+
 const char szTask[]="DBMOD";
 
 int main(int argc, char *argv[])
@@ -107,6 +110,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,szInputFile);
    CatList = ZCatFiles(szInputFile);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -145,9 +149,12 @@ int main(int argc, char *argv[])
    */
       if (CODE == 8) calculateMean(&FileHeader, &FACTOR, &Zfactor);
 
+      if (!(inputRecords  = zStreamOpen(inputFile,  FileHeader.type, O_readb)))  BombOff(1);
+      if (!(outputRecords = zStreamOpen(outputFile, FileHeader.type, O_writeb))) BombOff(1);
+
       TCNT=0.;
 
-      while (Zread(inputFile, BUFFER, FileHeader.type))     // Read until EOF or error. Prints a message in the event of an error.
+      while (zStreamRead(inputRecords, BUFFER))     // Read until EOF or error. Prints a message in the event of an error.
          {
          if (extractValues(BUFFER, &FileHeader, TCNT, &TIME, &Rval, &Zval, &FLAG))
             {
@@ -209,13 +216,16 @@ int main(int argc, char *argv[])
                }
             } /* End IF */
 
-         if (Zwrite(outputFile, BUFFER, FileHeader.type)) BombOff(1);
+         if (zStreamWrite(outputRecords, BUFFER)) BombOff(1);
 
          ++TCNT;  /* Count number of writes */
          } /* End WHILE */
 
       if (ferror(inputFile)) BombOff(1);
 
+      if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the file is closed
+      outputRecords = (struct ZSTREAM *)NIL;
+
       zTaskMessage(2,"%ld Data Points Processed\n",(long)TCNT);
 
       fcloseall();
@@ -446,23 +456,24 @@ void subtractFactor(short type, double factor, struct complex Zfactor, double *R
    }
 
 /*
-** Assume we are just past the header and ready to read in values DEBUG
+** Assume we are just past the header and ready to read in values.
+** The file is left positioned at the first record again when done.
 */
 void calculateMean(struct FILEHDR *fileHeader, double *factor, struct complex *Zfactor)
    {
-   fpos_t lCurrent;
+   struct ZSTREAM *meanRecords;
    char BUFFER[sizeof(struct TXData)];
    double TCNT=0., time, Rval;
    struct complex Zval;
    short FLAG;
    double count = 0;;
    
-   fgetpos(inputFile, &lCurrent); // Needed to restore file pointer for the next read cycle
+   if (!(meanRecords = zStreamOpen(inputFile, fileHeader->type, O_readb))) BombOff(1);
 
    *factor = 0.0;                 // We will be accumulating values in these variables
    *Zfactor = cmplx(0.0, 0.0);
    
-   while (Zread(inputFile, BUFFER, fileHeader->type))     // Read until EOF or error. Prints a message in the event of an error.
+   while (zStreamRead(meanRecords, BUFFER))     // Read until EOF or error. Prints a message in the event of an error.
       {
       extractValues(BUFFER, fileHeader, TCNT, &time, &Rval, &Zval, &FLAG);
 
@@ -484,9 +495,13 @@ void calculateMean(struct FILEHDR *fileHeader, double *factor, struct complex *Z
 
          } //if (!FLAG)
       ++TCNT;                                      // Number of actual reads needed for the time in time series files
-      } //while (Zread(inputFile, BUFFER, type))
+      } //while (zStreamRead(meanRecords, BUFFER))
+
+   if (ferror(inputFile)) BombOff(1);
 
-   fseek(inputFile, lCurrent, SEEK_SET);           // Restore the file pointer
+   zStreamClose(meanRecords);
+
+   if (!Zgethead(inputFile,(struct FILEHDR *)NIL)) BombOff(1);   // Back to the first record for the next read cycle
 
    if (count)
       {
@@ -549,6 +564,12 @@ void BombOff(int a)
 
 void fcloseall()           // Declared in tisan.h
    {
+   if (inputRecords) zStreamClose(inputRecords);
+   inputRecords = (struct ZSTREAM *)NIL;
+
+   if (outputRecords) zStreamClose(outputRecords);
+   outputRecords = (struct ZSTREAM *)NIL;
+
    if (inputFile) Zclose(inputFile);
    inputFile = (FILE *)NIL;
    
@@ -46,6 +46,12 @@
 *        1's  SET POINT COLOR (1-6)
 *
 * FACTOR: Data skip interval (2 = every other point, ect.)
+*
+* The data points are gathered in blocks of PLOTBLOCK and drawn by THREADS threads (TISAN.CFG). Each thread draws its
+* share of the block with its own PEN into its own tile, a mask of the canvas, and the tiles are then copied into the
+* image in COLOR. A line is clipped once by VECTOR and LINE, so PSET only checks the clip window for lines that poke out
+* of it. With a line type the pixels of each share are counted first, which gives every PEN the line type counters
+* and last pixel it would have had drawing the whole block in order, so dashes and symbols come out the same.
 */
 #include <unistd.h>
 
@@ -73,6 +79,13 @@
 #define TRUECOLOR 32
 
 #define BACKSLASH ((char)92) // the '\' character
+
+#define PLOTBLOCK 1048576L  // Points gathered before they are drawn
+#define PLOTCHUNK 65536L    // Fewest points worth a thread of their own
+
+#define PLOT_COUNT     0    // What a threaded pass does with its share of the points: count the pixels for the line type
+#define PLOT_DRAW      1    // Draw into the tile
+#define PLOT_COMPOSITE 2    // Copy its part of the canvas from every tile into the image
 
 /*
  * Bitmaps on disk have the following basic structure
@@ -211,6 +224,27 @@ struct BITMAPINFOHEADER {DWORD biSize;
 struct BITMAP {struct BITMAPINFOHEADER bmpinfoHeader;
                LONG                    imageArray[1];};  // 44 bytes
 
+/*
+** Drawing state that PSET, LINE, VECTOR and the symbols carry from one pixel to the next.
+** ScreenPen draws straight into the image; the threads each draw with their own PEN.
+*/
+struct PEN {short  lastX, lastY;    // Last pixel set, a repeat of it is skipped
+            short  slt1, slt2;      // Line type counters
+            BOOL   bClip;           // Check each pixel against the clip window
+            BOOL   bDraw;           // FALSE to only count the pixels
+            BYTE  *pTile;           // Mask of the canvas to draw into, NIL for the image
+            long   lLow, lHigh;     // Part of the tile drawn into
+            long   lPixels;         // Pixels that got past the repeat and clip tests
+            BOOL   bAny;            // Any such pixel, the first being firstX, firstY
+            short  firstX, firstY;
+            BOOL   bStarted;        // A point has been plotted, ending at lastVX, lastVY
+            double lastVX, lastVY;};
+
+struct PLOTWORK {int  iPass;        // Work shared by the threads of one pass over the points
+                 long lPoints;
+                 int  nChunks;
+                 struct PEN *pPens;};
+
 void MAININIT(void);
 void PLOT1(FILE *);
 void PLOT2(FILE *,FILE *);
@@ -219,7 +253,7 @@ void FRAMEIT(void);
 void PUTLAB(void);
 void PUTTICS(void);
 void PLTALPHA(char *,short,short,short);
-void PLTSYM(double,double);
+void PLTSYM(struct PEN *,double,double);
 void ROTATE(short *,short *,double);
 short GETRNG(double *,double *,double *,double *,FILE *,struct FILEHDR *,int);
 short GTEXT(short *,short *);
@@ -229,9 +263,18 @@ void PTXTICS(short,short);
 void PTYTICS(short,short);
 void PTSETUP(short *,short *);
 void LINE(short,short,short,short);
-void VECTOR(double,double,double,double,short);
-
-void PSET(short,short);     /* Pixel Setting Functions (hardware level)*/
+void PENLINE(struct PEN *,short,short,short,short);
+void PENALPHA(struct PEN *,char *,short,short,short);
+void VECTOR(struct PEN *,double,double,double,double,short);
+void QUEUEPOINT(double,double);
+void DRAWPOINTS(void);
+void PLOTPOINT(struct PEN *,double,double);
+void CHUNKPEN(struct PEN *,int,int,long);
+void PLOTTHREAD(int, int, void *);
+BOOL LINETYPE(struct PEN *);
+
+void PSET(struct PEN *,short,short);     /* Pixel Setting Functions (hardware level)*/
+BOOL INCLIP(short,short);
 
 BOOL isBitmapImage(FILE *inputStream);
 void readBitmapFileHeader(FILE *inputStream, struct BITMAPFILEHEADER *fileHeader);
@@ -246,7 +289,7 @@ short CWIDTH=8, CHEIGHT=8, XTICBASE=6, YTICBASE=8;
 short canvasWidth, canvasHeight; // Canvas dimensions
 
 short SCLIPXL,SCLIPYL,SCLIPXH,SCLIPYH,NOCLIP=0;
-short LT1=0, LT2=0, SLT1=0, SLT2=0, IYV, ITV, IIYA, IITA;
+short LT1=0, LT2=0, IYV, ITV, IIYA, IITA;
 short W0, W1, W2, W3, T2FLAG=0;
 short GF1, GF2, GF3, CS1, CS2;
 char BUFFER[256];
@@ -276,9 +319,17 @@ double TCNTS, TCNTE;
 double TIME, DATA;
 short FLAG=0;
 double TOTAL=0.;
-short FirstPointFlag;
 long lScaleCount = 0L;
 
+struct PEN ScreenPen = {-1, -1, 0, 0, TRUE, TRUE, (BYTE *)NIL, 0L, 0L, 0L, FALSE, 0, 0, FALSE, 0., 0.};
+
+struct PLOTPOINT {double x, y;};
+struct PLOTPOINT *pPoints = (struct PLOTPOINT *)NIL;   // Points waiting to be drawn
+long lPoints = 0L;
+
+BYTE *pTiles = (BYTE *)NIL;   // One mask of the canvas per thread
+int nThreads;                 // THREADS in TISAN.CFG
+
 
 struct BITMAPFILEHEADER bmpFileHeader;
 struct BITMAP *pBitMap = (struct BITMAP *)NIL;
@@ -300,7 +351,7 @@ int main(int argc, char *argv[])
    char Drive[_MAX_DRIVE], Dir[_MAX_DIR], Fname[_MAX_FNAME], Ext[_MAX_EXT];
    char INFILE[_MAX_PATH], IN2FILE[_MAX_PATH], OUTFILE[_MAX_PATH];
    int AutoAmpScale = 0, AutoTimeScale = 0, SecondFile = 0, OutPutFile = 1;
-   BOOL isBitmap;
+   BOOL isBitmap = FALSE;
    LONG plotColor;
    char szOpenCommand[512];
    char szBMPviewer[256];
@@ -319,6 +370,9 @@ int main(int argc, char *argv[])
    T0 = TRANGE[0];
    T1 = TRANGE[1];
 
+   nThreads = zThreadCount();
+   zTaskMessage(2,"Using %d thread(s).\n", nThreads);
+
    MAININIT();
 
    if (YRANGE[0] >= YRANGE[1]) AutoAmpScale = 1;
@@ -545,8 +599,8 @@ int main(int argc, char *argv[])
    YSLOPE = ((double)(WINDOW[3] - WINDOW[1]))/(YR2 - YR1);
    YINTER = (double)WINDOW[1] - YSLOPE*YR1;
 
-   SLT2 = LT2 = PARMS[4]/10;
-   SLT1 = LT1 = (short)PARMS[4]%10;
+   ScreenPen.slt2 = LT2 = PARMS[4]/10;
+   ScreenPen.slt1 = LT1 = (short)PARMS[4]%10;
    YPL1 = YRANGE[0];
    YPL2 = YRANGE[1];
    TPL1 = TRANGE[0];
@@ -556,7 +610,7 @@ int main(int argc, char *argv[])
 
    for (I = 0; I < CatList->N; ++I)
       {
-      FirstPointFlag = 0;
+      ScreenPen.bStarted = FALSE;
       TCNT = 0.;
       LFPS1 = LFPE1 = 0L;  // Long File Pointer Start and End
 
@@ -619,6 +673,8 @@ int main(int argc, char *argv[])
 
          if (ferror(INSTREAM) || ferror(IN2STREAM)) BombOff(1);
          }
+
+      DRAWPOINTS();   // The rest of the file
       Zclose(INSTREAM);
       INSTREAM = (FILE *)NIL;
 
@@ -668,6 +724,12 @@ int main(int argc, char *argv[])
 
    if (pBitMap) free(pBitMap);
    pBitMap = (struct BITMAP *)NIL;
+
+   if (pPoints) free(pPoints);
+   pPoints = (struct PLOTPOINT *)NIL;
+
+   if (pTiles) free(pTiles);
+   pTiles = (BYTE *)NIL;
 
    ZCatFiles((char*)NIL); // free catalog memory
 
@@ -793,20 +855,7 @@ void PLOT1(FILE *INSTREAM)
       if (PARMS[6]) DATA = PLOG(DATA,6);
       XLOC = Tpnt(TSLOPE*TIME + TINTER);
       YLOC = Ypnt(YSLOPE*DATA + YINTER);
-
-      if (PARMS[3]>0)
-         PLTSYM(XLOC,YLOC);
-      else if (!FirstPointFlag)               /* First point */
-         {
-         if (PARMS[3]) PLTSYM(XLOC,YLOC);
-         VECTOR(XLOC,YLOC,XLOC,YLOC,0);
-         FirstPointFlag = 1;
-         }
-      else                                    /* Rest of points */
-         {
-         VECTOR(0.,0.,XLOC,YLOC,1);
-         if (PARMS[3]) PLTSYM(XLOC,YLOC);
-         }
+      QUEUEPOINT(XLOC,YLOC);
       }
    return;
    }
@@ -863,19 +912,7 @@ void PLOT2(FILE *INSTREAM, FILE *IN2STREAM)
       if (PARMS[6]) DATA = PLOG(DATA,6);
       XLOC = Tpnt(TSLOPE*TIME + TINTER);
       YLOC = Ypnt(YSLOPE*DATA + YINTER);
-      if (PARMS[3]>0)
-         PLTSYM(XLOC,YLOC);
-      else if (!FirstPointFlag)
-         {
-         if (PARMS[3]) PLTSYM(XLOC,YLOC);
-         VECTOR(XLOC,YLOC,XLOC,YLOC,0);
-         FirstPointFlag = 1;
-         }
-      else
-         {
-         VECTOR(0.,0.,XLOC,YLOC,1);
-         if (PARMS[3]) PLTSYM(XLOC,YLOC);
-         }
+      QUEUEPOINT(XLOC,YLOC);
       }
      return;
      }
@@ -1065,8 +1102,8 @@ void PTSETUP(short *X, short *Y)
    {
    double N, XP, YP;
    short IPARM, DSFLG, TBFLGY=0, TBFLGT=0, IOFLG;
-   short XLOC, YLOC, I;
-   double YY, V1T, V2T, V1Y=0., V2Y=0., XX;
+   short XLOC=0, YLOC=0, I;
+   double YY, V1T=0., V2T=0., V1Y=0., V2Y=0., XX;
    short BLENY=0, BLENT=0;
 
 
@@ -1557,6 +1594,12 @@ void PTYTICS(short XLOC, short YLOC)
 *
 */
 void PLTALPHA(char *LABEL, short XLOC, short YLOC, short ANGLE)
+   {
+   PENALPHA(&ScreenPen,LABEL,XLOC,YLOC,ANGLE);
+   return;
+   }
+
+void PENALPHA(struct PEN *pPen, char *LABEL, short XLOC, short YLOC, short ANGLE)
    {
    short X0, Y0, X1, Y1;
    char *PNTR;
@@ -1587,7 +1630,7 @@ void PLTALPHA(char *LABEL, short XLOC, short YLOC, short ANGLE)
          switch (PEN)
             {
             case '1':
-               LINE(XLOC+X0,YLOC+Y0,XLOC+X1,YLOC+Y1);
+               PENLINE(pPen,XLOC+X0,YLOC+Y0,XLOC+X1,YLOC+Y1);
             case '0':
             case '\0':
                X0 = X1;
@@ -1625,12 +1668,20 @@ void ROTATE(short *X, short *Y, double ANGLE)
 *
 * Find the MAX, MIN of a File
 *
+* If the file is in time order and only part of it is plotted, the
+* first point in TRANGE is found with a binary search and the scan
+* stops at the end of TRANGE.
+*
 */
 short GETRNG(double *TMIN, double *TMAX, double *YMIN, double *YMAX, FILE *INSTREAM, struct FILEHDR *FHP, int NotFirstCall)
    {
    short ERRFLAG=0;
+   BOOL bSorted = (TRANGE[0] < TRANGE[1]) && isSortedHeader(FHP);
+   long lFirst = 0L;
 
-   TCNT = 0.;
+   if (bSorted && ((lFirst = zFindTime(INSTREAM, FHP, TRANGE[0])) < 0L)) BombOff(1);
+
+   TCNT = (double)lFirst;
    while (Zread(INSTREAM,BUFFER1,FHP->type))
       {
       switch (FHP->type)
@@ -1657,6 +1708,8 @@ short GETRNG(double *TMIN, double *TMAX, double *YMIN, double *YMAX, FILE *INSTR
             break;
          }
 
+      if (bSorted && (TIME > TRANGE[1])) break;   // The rest of the file is past the plot
+
       if (((TIME >= TRANGE[0]) && (TIME <= TRANGE[1])) ||
            (TRANGE[0] >= TRANGE[1]))
          {
@@ -1691,7 +1744,7 @@ short GETRNG(double *TMIN, double *TMAX, double *YMIN, double *YMAX, FILE *INSTR
 * Plot a Symbol
 *
 */
-void PLTSYM(double FXLOC, double FYLOC)
+void PLTSYM(struct PEN *pPen, double FXLOC, double FYLOC)
      {
      char C[2];
      short XLOC, YLOC;
@@ -1706,9 +1759,9 @@ void PLTSYM(double FXLOC, double FYLOC)
      C[0] = (char)fabs(PARMS[3]);
      C[1] = (char)0;
      if (C[0] != (char)255)
-          PLTALPHA(C,XLOC-CWIDTH/2,YLOC+CHEIGHT/2,0);
+          PENALPHA(pPen,C,XLOC-CWIDTH/2,YLOC+CHEIGHT/2,0);
      else
-          LINE(XLOC,YLOC,XLOC,YLOC);
+          PENLINE(pPen,XLOC,YLOC,XLOC,YLOC);
      return;
      }
 
@@ -1726,20 +1779,19 @@ double PLOG(double V, short B)
 **
 ** Vector Clipping Routine
 */
-void VECTOR(double X1, double Y1, double X2, double Y2, short notFirstCall)
+void VECTOR(struct PEN *pPen, double X1, double Y1, double X2, double Y2, short notFirstCall)
    {
    short VFLAG=0, HFLAG=0, FL=0;
-   double M, B, ZXL, ZXH, ZYL, ZYH;
-   static double LASTX, LASTY;
+   double M, B, ZXL=0., ZXH=0., ZYL=0., ZYH=0.;
 
    if (notFirstCall)
       {
-      X1=LASTX;
-      Y1=LASTY;
+      X1=pPen->lastVX;
+      Y1=pPen->lastVY;
       }
 
-   LASTX = X2;
-   LASTY = Y2;
+   pPen->lastVX = X2;
+   pPen->lastVY = Y2;
 
    if ((X2 != X1) && (Y2 != Y1))
       {
@@ -1815,7 +1867,7 @@ void VECTOR(double X1, double Y1, double X2, double Y2, short notFirstCall)
         (Y2<(double)SCLIPYL) || (Y2>(double)SCLIPYH)) ||
        ((X1 == X2) && (Y1 == Y2) && (FL == 1))) return;
 
-   LINE((short)X1,(short)Y1,(short)X2,(short)Y2);
+   PENLINE(pPen,(short)X1,(short)Y1,(short)X2,(short)Y2);
    return;
    }
 
@@ -1824,10 +1876,18 @@ void VECTOR(double X1, double Y1, double X2, double Y2, short notFirstCall)
 * Line drawing Primitive
 */
 void LINE(short X1, short Y1, short X2, short Y2)
+   {
+   PENLINE(&ScreenPen,X1,Y1,X2,Y2);
+   return;
+   }
+
+void PENLINE(struct PEN *pPen, short X1, short Y1, short X2, short Y2)
    {
    short DELX, DELY, DXI, DYI, SXI, SYI, SHRTDIS, LNGDIS;
    short SC, DC, TF;
 
+   pPen->bClip = !INCLIP(X1,Y1) || !INCLIP(X2,Y2);   // The line stays in the box of its end points
+
    DELY = Y2-Y1;
    if (DELY < 0)
       {
@@ -1865,7 +1925,7 @@ void LINE(short X1, short Y1, short X2, short Y2)
    ++LNGDIS;
 
    do {
-      PSET(X1,Y1);
+      PSET(pPen,X1,Y1);
       if (TF<0)
          {
          X1 += SXI;
@@ -1889,42 +1949,315 @@ void LINE(short X1, short Y1, short X2, short Y2)
 * Pixel Setting Routine
 *
 */
-void PSET(short X, short Y)
+void PSET(struct PEN *pPen, short X, short Y)
    {
-   static short LASTX=-1, LASTY=-1;
+   long k;
+
+   if ((X==pPen->lastX) && (Y==pPen->lastY)) return;
+
+   if (pPen->bClip && !INCLIP(X,Y)) return;
+
+   pPen->lastX = X;
+   pPen->lastY = Y;
+
+   if (!pPen->bAny)
+      {
+      pPen->bAny = TRUE;
+      pPen->firstX = X;
+      pPen->firstY = Y;
+      }
+   ++pPen->lPixels;
 
-   if ((X==LASTX) && (Y==LASTY)) return;
+   if (!pPen->bDraw || !LINETYPE(pPen)) return;
 
-   if ((!NOCLIP &&
-       ((X<SCLIPXL) || (Y<SCLIPYL) || (X>SCLIPXH) || (Y>SCLIPYH))) ||
-        ((X<0) || (Y<0) || (X>=canvasWidth) || (Y>=canvasHeight))) return;
+// A color pel is made by (red << 16) | (green << 8) | blue;
 
-   LASTX = X;
-   LASTY = Y;
+   k = (long)(canvasHeight - Y) * canvasWidth + X;
 
-   if (!SLT1)              // Line Type
+   if (pPen->pTile)
       {
-      if (!SLT2)
+      pPen->pTile[k] = 1;
+      pPen->lLow  = Min(pPen->lLow,k);
+      pPen->lHigh = Max(pPen->lHigh,k);
+      }
+   else
+      pBitMap->imageArray[k] = COLOR;
+
+   return;
+   }
+
+/*
+** TRUE if PSET may set the pixel
+*/
+BOOL INCLIP(short X, short Y)
+   {
+   return(!((!NOCLIP &&
+            ((X<SCLIPXL) || (Y<SCLIPYL) || (X>SCLIPXH) || (Y>SCLIPYH))) ||
+             ((X<0) || (Y<0) || (X>=canvasWidth) || (Y>=canvasHeight))));
+   }
+
+/*
+** Step the line type counters, TRUE if the pixel is drawn
+*/
+BOOL LINETYPE(struct PEN *pPen)
+   {
+   if (!pPen->slt1)              // Line Type
+      {
+      if (!pPen->slt2)
          {
-         SLT1 = LT1;
-         SLT2 = LT2;
+         pPen->slt1 = LT1;
+         pPen->slt2 = LT2;
          }
       else
          {
-         --SLT2;
-         return;
+         --pPen->slt2;
+         return(FALSE);
          }
       }
    else
-      --SLT1;
+      --pPen->slt1;
 
-// A color pel is made by (red << 16) | (green << 8) | blue;
+   return(TRUE);
+   }
+
+/************************************************************
+*
+* Add a point to the block waiting to be drawn
+*
+*/
+void QUEUEPOINT(double XLOC, double YLOC)
+   {
+   if (!pPoints)
+      {
+      pPoints = (struct PLOTPOINT *)malloc((size_t)PLOTBLOCK * sizeof(struct PLOTPOINT));
+
+      if (!pPoints)   // Just draw it
+         {
+         PLOTPOINT(&ScreenPen,XLOC,YLOC);
+         return;
+         }
+      }
 
-   pBitMap->imageArray[(canvasHeight - Y) * canvasWidth + X] = COLOR;
+   pPoints[lPoints].x = XLOC;
+   pPoints[lPoints].y = YLOC;
+
+   if (++lPoints == PLOTBLOCK) DRAWPOINTS();
 
    return;
    }
 
+/************************************************************
+*
+* Plot a point with its symbol and the vector from the last point
+*
+*/
+void PLOTPOINT(struct PEN *pPen, double XLOC, double YLOC)
+   {
+   if (PARMS[3]>0)
+      PLTSYM(pPen,XLOC,YLOC);
+   else if (!pPen->bStarted)               /* First point */
+      {
+      if (PARMS[3]) PLTSYM(pPen,XLOC,YLOC);
+      VECTOR(pPen,XLOC,YLOC,XLOC,YLOC,0);
+      pPen->bStarted = TRUE;
+      }
+   else                                    /* Rest of points */
+      {
+      VECTOR(pPen,0.,0.,XLOC,YLOC,1);
+      if (PARMS[3]) PLTSYM(pPen,XLOC,YLOC);
+      }
+
+   return;
+   }
+
+/************************************************************
+*
+* Draw the points of the block
+*
+* With one thread (or a small block) the points are drawn into the image
+* in order. Otherwise the block is split into one share per thread and
+* each is drawn into the thread's tile, then the tiles are copied into
+* the image. The pixels all have the same COLOR, so the order in which
+* the tiles are copied does not matter.
+*
+*/
+void DRAWPOINTS()
+   {
+   struct PLOTWORK work;
+   struct PEN pens[64];
+   long i, n = 0L;
+   int j;
+   short lastX, lastY, nextX = -1, nextY = -1;
+
+   if (!lPoints) return;
+
+   work.lPoints = lPoints;
+   work.nChunks = (int)Min((long)Min(nThreads,64), lPoints / PLOTCHUNK);
+   work.pPens = pens;
+
+   if ((work.nChunks > 1) && !pTiles)
+      pTiles = (BYTE *)calloc((size_t)Min(nThreads,64) * (canvasHeight + 1) * canvasWidth, 1);
+
+   if ((work.nChunks <= 1) || !pTiles)
+      {
+      for (i = 0L; i < lPoints; ++i) PLOTPOINT(&ScreenPen,pPoints[i].x,pPoints[i].y);
+      lPoints = 0L;
+      return;
+      }
+
+/*
+** With a line type, count the pixels of every share to find the
+** line type counters and the last pixel each share starts with.
+*/
+   if (LT1 || LT2)
+      {
+      for (j = 0; j < work.nChunks; ++j) CHUNKPEN(&pens[j], j, work.nChunks, lPoints);
+
+      work.iPass = PLOT_COUNT;
+      zRunThreads(work.nChunks, PLOTTHREAD, &work);
+      }
+
+   lastX = ScreenPen.lastX;
+   lastY = ScreenPen.lastY;
+   for (j = 0; j < work.nChunks; ++j)
+      {
+      if (LT1 || LT2)
+         {
+         n = pens[j].lPixels;
+         if (pens[j].bAny && (pens[j].firstX == lastX) && (pens[j].firstY == lastY)) --n;   // A repeat of the last pixel of the share before
+         if (pens[j].bAny)
+            {
+            nextX = pens[j].lastX;
+            nextY = pens[j].lastY;
+            }
+         else
+            {
+            nextX = lastX;
+            nextY = lastY;
+            }
+         }
+
+      CHUNKPEN(&pens[j], j, work.nChunks, lPoints);
+      pens[j].bDraw = TRUE;
+      pens[j].pTile = pTiles + (long)j * (canvasHeight + 1) * canvasWidth;
+      pens[j].slt1 = ScreenPen.slt1;
+      pens[j].slt2 = ScreenPen.slt2;
+      pens[j].lastX = lastX;
+      pens[j].lastY = lastY;
+
+      if (LT1 || LT2)
+         {
+         for (n %= (long)(LT1 + LT2 + 1); n > 0L; --n) LINETYPE(&ScreenPen);   // The counters go round every LT1 + LT2 + 1 pixels
+         lastX = nextX;
+         lastY = nextY;
+         }
+      }
+
+   work.iPass = PLOT_DRAW;
+   zRunThreads(work.nChunks, PLOTTHREAD, &work);
+
+   work.iPass = PLOT_COMPOSITE;
+   zRunThreads(work.nChunks, PLOTTHREAD, &work);
+
+   for (j = 0; j < work.nChunks; ++j)
+      if (pens[j].bAny)
+         {
+         ScreenPen.lastX = pens[j].lastX;
+         ScreenPen.lastY = pens[j].lastY;
+         }
+
+   ScreenPen.bStarted = TRUE;
+   ScreenPen.lastVX = pens[work.nChunks - 1].lastVX;
+   ScreenPen.lastVY = pens[work.nChunks - 1].lastVY;
+
+   lPoints = 0L;
+
+   return;
+   }
+
+/************************************************************
+*
+* Ready the PEN of share j of the block for counting. The share
+* carries on the vector from the point before it, or from the
+* last point drawn for the first share.
+*
+*/
+void CHUNKPEN(struct PEN *pPen, int j, int nChunks, long n)
+   {
+   long lFirst = n * j / nChunks;
+
+   pPen->lastX = pPen->lastY = -1;
+   pPen->slt1 = LT1;
+   pPen->slt2 = LT2;
+   pPen->bClip = TRUE;
+   pPen->bDraw = FALSE;
+   pPen->pTile = (BYTE *)NIL;
+   pPen->lLow = (long)(canvasHeight + 1) * canvasWidth;
+   pPen->lHigh = -1L;
+   pPen->lPixels = 0L;
+   pPen->bAny = FALSE;
+   pPen->firstX = pPen->firstY = -1;
+
+   if (j)
+      {
+      pPen->bStarted = TRUE;
+      pPen->lastVX = pPoints[lFirst - 1].x;
+      pPen->lastVY = pPoints[lFirst - 1].y;
+      }
+   else
+      {
+      pPen->bStarted = ScreenPen.bStarted;
+      pPen->lastVX = ScreenPen.lastVX;
+      pPen->lastVY = ScreenPen.lastVY;
+      }
+
+   return;
+   }
+
+/************************************************************
+*
+* One thread's share of a pass over the block
+*
+*/
+void PLOTTHREAD(int iThread, int nThreads, void *pData)
+   {
+   struct PLOTWORK *pWork = (struct PLOTWORK *)pData;
+   struct PEN *pPen = pWork->pPens + iThread;
+   long i, lFirst, lLast, lSize;
+   BYTE *pTile;
+   int j;
+
+   if (pWork->iPass != PLOT_COMPOSITE)
+      {
+      lFirst = pWork->lPoints * iThread / pWork->nChunks;
+      lLast  = pWork->lPoints * (iThread + 1) / pWork->nChunks;
+
+      for (i = lFirst; i < lLast; ++i) PLOTPOINT(pPen,pPoints[i].x,pPoints[i].y);
+
+      return;
+      }
+
+/*
+** Every thread copies its part of the canvas out of all the tiles
+*/
+   lSize = (long)(canvasHeight + 1) * canvasWidth;
+   lFirst = lSize * iThread / nThreads;
+   lLast  = lSize * (iThread + 1) / nThreads;
+
+   for (j = 0; j < pWork->nChunks; ++j)
+      {
+      pTile = pWork->pPens[j].pTile;
+
+      for (i = Max(lFirst,pWork->pPens[j].lLow); i <= Min(lLast - 1,pWork->pPens[j].lHigh); ++i)
+         if (pTile[i])
+            {
+            pBitMap->imageArray[i] = COLOR;
+            pTile[i] = 0;
+            }
+      }
+
+   return;
+   }
 /***************************************************************************
 **
 ** Test if the file is a 32 bit color bitmap, which is what DBPLOT generates
@@ -93,6 +93,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);     // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);   // Quit if there are none
+   zParallelFiles(CatList);         // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -118,6 +119,12 @@ int main(int argc, char *argv[])
 
       if (Zputhead(OUTSTR,&FileHeader)) BombOff(1);   // Needed to hold space for the actual header values
 
+   /*
+   ** Offsets, positive scale factors and the linear scaling keep the points in time order. Dividing into the time does not.
+   */
+      zSetSorted(&FileHeader, isSortedHeader(&FileHeader) &&
+                              ((CODE == 0) || (CODE == 1) || (CODE == 5) || (((CODE == 2) || (CODE == 3)) && (TRANGE[0] >= 0.))));
+
    /*
    ** Find existing min/max
    */
@@ -277,17 +284,20 @@ int main(int argc, char *argv[])
 double getDataScales(struct FILEHDR *pHeader, FILE *stream, double *pTmin, double *pTmax, double *pRmin, double *pRmax)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords;
    double timeIndex = 0.0;
    double time;
    double Rval;
    struct complex Zval;
    short flag;
    BOOL bFirstPass = TRUE;
-   double TMAX, TMIN, YMAX, YMIN;
+   double TMAX=0., TMIN=0., YMAX=0., YMIN=0.;
 
    if (!Zgethead(stream,(struct FILEHDR *)NIL)) BombOff(1); /* back to the start of the file */
 
-   while (Zread(stream,buffer,pHeader->type))
+   if (!(inputRecords = zStreamOpen(stream, pHeader->type, O_readb))) BombOff(1);
+
+   while (zStreamRead(inputRecords,buffer))
       {
       if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
          {
@@ -316,6 +326,9 @@ double getDataScales(struct FILEHDR *pHeader, FILE *stream, double *pTmin, doubl
       ++timeIndex;
       } /* End WHILE */
 
+   if (ferror(stream)) BombOff(1);
+   zStreamClose(inputRecords);
+
    if (!Zgethead(stream,(struct FILEHDR *)NULL)) BombOff(1); /* back to the start of the file */
 
    *pTmin = TMIN;
@@ -344,6 +357,7 @@ double getDataScales(struct FILEHDR *pHeader, FILE *stream, double *pTmin, doubl
 void scaleValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStream, double Tmin, double Tmax, double Rmin, double Rmax)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords, *outputRecords;
    double mTime, bTime, mRval, bRval;
    double timeIndex = 0.0;
    double time, Rval;
@@ -392,7 +406,10 @@ void scaleValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStrea
       bRval = YRANGE[0] - Rmin * mRval;
       }
 
-   while (Zread(infileStream,buffer,pHeader->type))
+   if (!(inputRecords  = zStreamOpen(infileStream, pHeader->type, O_readb)))  BombOff(1);
+   if (!(outputRecords = zStreamOpen(outfileStream, pHeader->type, O_writeb))) BombOff(1);
+
+   while (zStreamRead(inputRecords,buffer))
       {
       if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
          {
@@ -414,11 +431,14 @@ void scaleValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStrea
          insertValues(buffer, pHeader, newTime, newRval, newZval, flag);
          }
 
-      if (Zwrite(outfileStream, buffer, pHeader->type)) BombOff(1);
+      if (zStreamWrite(outputRecords, buffer)) BombOff(1);
          
       ++timeIndex;
       } /* End WHILE */
 
+   zStreamClose(inputRecords);
+   if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the header is rewritten
+
    if (((pHeader->type == R_Data) || (pHeader->type == X_Data)) &&   // Time scaling for a time series files
        (TRANGE[0] < TRANGE[1]))
       {
@@ -449,13 +469,17 @@ void scaleValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStrea
 void offsetValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStream)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords, *outputRecords;
    double timeIndex = 0.0;
    double time;
    double Rval;
    struct complex Zval;
    short flag;
    
-   while (Zread(infileStream,buffer,pHeader->type))
+   if (!(inputRecords  = zStreamOpen(infileStream, pHeader->type, O_readb)))  BombOff(1);
+   if (!(outputRecords = zStreamOpen(outfileStream, pHeader->type, O_writeb))) BombOff(1);
+
+   while (zStreamRead(inputRecords,buffer))
       {
       if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
          {
@@ -475,11 +499,14 @@ void offsetValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStre
          insertValues(buffer, pHeader, time, Rval, Zval, flag);
          }
 
-      if (Zwrite(outfileStream, buffer, pHeader->type)) BombOff(1);
+      if (zStreamWrite(outputRecords, buffer)) BombOff(1);
          
       ++timeIndex;
       } /* End WHILE */
 
+   zStreamClose(inputRecords);
+   if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the header is rewritten
+
    if ((pHeader->type == R_Data) || (pHeader->type == X_Data)) pHeader->b += TRANGE[0];   // Time offset for a time series file
 
    return;
@@ -495,6 +522,7 @@ void offsetValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStre
 void multiplyValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStream)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords, *outputRecords;
    double timeIndex = 0.0;
    double time;
    double Rval;
@@ -504,7 +532,10 @@ void multiplyValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileSt
 
    zMultiplier = cmplx(ZRANGE[0], ZRANGE[1]);
    
-   while (Zread(infileStream,buffer,pHeader->type))
+   if (!(inputRecords  = zStreamOpen(infileStream, pHeader->type, O_readb)))  BombOff(1);
+   if (!(outputRecords = zStreamOpen(outfileStream, pHeader->type, O_writeb))) BombOff(1);
+
+   while (zStreamRead(inputRecords,buffer))
       {
       if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
          {
@@ -523,11 +554,14 @@ void multiplyValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileSt
          insertValues(buffer, pHeader, time, Rval, Zval, flag);
          }
 
-      if (Zwrite(outfileStream, buffer, pHeader->type)) BombOff(1);
+      if (zStreamWrite(outputRecords, buffer)) BombOff(1);
          
       ++timeIndex;
       } /* End WHILE */
 
+   zStreamClose(inputRecords);
+   if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the header is rewritten
+
    if (TRANGE[0] && ((pHeader->type == R_Data) || (pHeader->type == X_Data)))
       {
       pHeader->m *= TRANGE[0];   // Time series files
@@ -546,6 +580,7 @@ void multiplyValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileSt
 void divideValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStream)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords, *outputRecords;
    double timeIndex = 0.0;
    double time;
    double Rval;
@@ -557,7 +592,10 @@ void divideValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStre
    zDivisor = cmplx(ZRANGE[0], ZRANGE[1]);
    bNotZero = c_abs(zDivisor) ? TRUE : FALSE;
    
-   while (Zread(infileStream,buffer,pHeader->type))
+   if (!(inputRecords  = zStreamOpen(infileStream, pHeader->type, O_readb)))  BombOff(1);
+   if (!(outputRecords = zStreamOpen(outfileStream, pHeader->type, O_writeb))) BombOff(1);
+
+   while (zStreamRead(inputRecords,buffer))
       {
       if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
          {
@@ -576,11 +614,14 @@ void divideValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStre
          insertValues(buffer, pHeader, time, Rval, Zval, flag);
          }
 
-      if (Zwrite(outfileStream, buffer, pHeader->type)) BombOff(1);
+      if (zStreamWrite(outputRecords, buffer)) BombOff(1);
          
       ++timeIndex;
       } /* End WHILE */
 
+   zStreamClose(inputRecords);
+   if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the header is rewritten
+
    if (TRANGE[0] && ((pHeader->type == R_Data) || (pHeader->type == X_Data)))
       {
       pHeader->m /= TRANGE[0];   // Time series files
@@ -600,6 +641,7 @@ void divideValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStre
 void divideintoValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStream)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords, *outputRecords;
    double timeIndex = 0.0;
    double time;
    double Rval;
@@ -627,7 +669,10 @@ void divideintoValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfile
    zDivided = cmplx(ZRANGE[0], ZRANGE[1]);
    zDividedMagnitude = c_abs(zDivided);
    
-   while (Zread(infileStream,buffer,pHeader->type))
+   if (!(inputRecords  = zStreamOpen(infileStream, pHeader->type, O_readb)))  BombOff(1);
+   if (!(outputRecords = zStreamOpen(outfileStream, newFileHeader.type, O_writeb))) BombOff(1);
+
+   while (zStreamRead(inputRecords,buffer))
       {
       if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
          {
@@ -648,11 +693,14 @@ void divideintoValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfile
          insertValues(buffer, &newFileHeader, time, Rval, Zval, flag);
          }
 
-      if (Zwrite(outfileStream, buffer, newFileHeader.type)) BombOff(1);
+      if (zStreamWrite(outputRecords, buffer)) BombOff(1);
          
       ++timeIndex;
       } /* End WHILE */
 
+   zStreamClose(inputRecords);
+   if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the header is rewritten
+
    pHeader->type = newFileHeader.type; // needed by the calling routine when it updates the output file header
 
    return;
@@ -661,6 +709,7 @@ void divideintoValues(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfile
 void zeroStartTime(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStream, double Tmin)
    {
    char buffer[sizeof(struct TXData)]; /* Largest Data Type Processed */
+   struct ZSTREAM *inputRecords, *outputRecords;
    double timeIndex = 0.0;
    double time;
    double Rval;
@@ -673,7 +722,10 @@ void zeroStartTime(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStr
       }
    else
       {
-      while (Zread(infileStream,buffer,pHeader->type))
+      if (!(inputRecords  = zStreamOpen(infileStream, pHeader->type, O_readb)))  BombOff(1);
+      if (!(outputRecords = zStreamOpen(outfileStream, pHeader->type, O_writeb))) BombOff(1);
+
+      while (zStreamRead(inputRecords,buffer))
          {
          if (extractValues(buffer, pHeader, timeIndex, &time, &Rval, &Zval, &flag))
             {
@@ -685,10 +737,13 @@ void zeroStartTime(struct FILEHDR *pHeader, FILE *infileStream, FILE *outfileStr
 
          insertValues(buffer, pHeader, time, Rval, Zval, flag);
 
-         if (Zwrite(outfileStream, buffer, pHeader->type)) BombOff(1);
+         if (zStreamWrite(outputRecords, buffer)) BombOff(1);
             
          ++timeIndex;
          } /* End WHILE */
+
+      zStreamClose(inputRecords);
+      if (zStreamClose(outputRecords)) BombOff(1);  // Flush the last block before the header is rewritten
       }
       
    return;
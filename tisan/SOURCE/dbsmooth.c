@@ -34,6 +34,9 @@ double *DBUFF;
 FILE *INSTR  = (FILE *)NIL;
 FILE *OUTSTR = (FILE *)NIL;
 
+struct ZSTREAM *INRECS  = (struct ZSTREAM *)NIL;
+struct ZSTREAM *OUTRECS = (struct ZSTREAM *)NIL;
+
 const char szTask[]="DBSMOOTH";
 
 int main(int argc, char *argv[])
@@ -43,9 +46,9 @@ int main(int argc, char *argv[])
    struct RData *RDataPntr;
    struct TRData *TRDataPntr;
    double IDATA, ODATA;
-   double SUM=0., LASTVAL, YINMAX, YINMIN, YOUTMAX, YOUTMIN;
+   double SUM=0., LASTVAL, YINMAX=0., YINMIN=0., YOUTMAX=0., YOUTMIN=0.;
    double COUNT=0.,TOTAL=0., TCNT=0., TIME;
-   long J=0L, nBOX, K;
+   long J=0L, nBOX=0L, K;
    short IFLAG=1, OFLAG=1, FFLAG=1, FLAG=0;
    char INFILE[_MAX_PATH], OUTFILE[_MAX_PATH];
    struct complex Zval;
@@ -99,6 +102,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -131,6 +135,9 @@ int main(int argc, char *argv[])
       if (((OUTSTR = zOpen(TMPFILE,O_writeb)) == NULL) ||
           (Zputhead(OUTSTR,&FileHeader))) BombOff(1);
 
+      if (!(INRECS  = zStreamOpen(INSTR,  FileHeader.type, O_readb)))  BombOff(1);
+      if (!(OUTRECS = zStreamOpen(OUTSTR, FileHeader.type, O_writeb))) BombOff(1);
+
       SUM = 0.;
       COUNT = 0.;
       TOTAL = 0.;
@@ -141,7 +148,7 @@ int main(int argc, char *argv[])
       FFLAG = 1;
       FLAG = 0;
 
-      while (Zread(INSTR,BUFFER,FileHeader.type))
+      while (zStreamRead(INRECS,BUFFER))
          {
          if (extractValues(BUFFER, &FileHeader, TCNT, &TIME, &IDATA, &Zval, &FLAG))
             {
@@ -218,11 +225,14 @@ int main(int argc, char *argv[])
             ++TOTAL;
             } /* End if FLAG */
 
-         if (Zwrite(OUTSTR,BUFFER,FileHeader.type)) BombOff(1);
+         if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
          } /* End WHILE */
 
       if (ferror(INSTR)) BombOff(1);
 
+      if (zStreamClose(OUTRECS)) BombOff(1);  // Flush the last block before the file is closed
+      OUTRECS = (struct ZSTREAM *)NIL;
+
       zTaskMessage(2,"%ld Data Points Processed\n",(long)TOTAL);
       zTaskMessage(3,"Old Amplitude Range %lG,%lG\n",YINMIN,YINMAX);
       zTaskMessage(3,"New Amplitude Range %lG,%lG\n",YOUTMIN,YOUTMAX);
@@ -264,6 +274,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
+   if (INRECS) zStreamClose(INRECS);
+   INRECS = (struct ZSTREAM *)NIL;
+
+   if (OUTRECS) zStreamClose(OUTRECS);
+   OUTRECS = (struct ZSTREAM *)NIL;
+
    if (INSTR) Zclose(INSTR);
    INSTR = (FILE *)NIL;
    
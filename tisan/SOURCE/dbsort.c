@@ -5,11 +5,20 @@
 *
 *  Task DBSORT
 *
-* Task to do a quick sort on time labeled data files
+* Task to sort time labeled data files on time
 *
 * By default this task overwrites the original input file.
 *
-* The entire file must fit into memory in order to be sorted.
+* The input file is mapped and sorted with a parallel LSD radix sort
+* on the time stamps (THREADS in TISAN.CFG). The sort is stable, so
+* points with the same time keep their order in the file. A file that is
+* already sorted is left alone, and data in only a few ascending runs
+* (such as two sorted files appended by DBCMB) are merged. The output
+* header is marked as sorted (see isSortedHeader), and a file whose
+* header says it is sorted is not scanned again. Files larger than
+* MEMORY in TISAN.CFG are sorted externally: pieces that fit are sorted
+* and written to run files, and the runs are then merged ZMERGEWAY at a
+* time into the output.
 *
 * The infile of this task accepts wild cards.
 *
@@ -28,15 +37,48 @@
 #include "tisan.h"
 
 int qsortCompare(const void *v1, const void *v2);
-
-BYTE *pDataBuffer = (BYTE *)NIL;    // Pointer to all the data
+void sortRecords(BYTE *pRecords, long N, FILE *stream);
+void SORTTHREAD(int iThread, int nThreads, void *pData);
+int mergeCompare(int iRun1, int iRun2, char **pRecord);
+void heapPush(int *heap, int *pnHeap, int iRun, char **pRecord);
+void heapNext(int *heap, int *pnHeap, char **pRecord, BOOL bDone);
+void mergeSortedRuns(BYTE *pRecords, long N, long *pStart, int nRuns, FILE *stream);
+BOOL isSorted(FILE *stream);
+void copyRecords(long N);
+double recordTime(BYTE *pRecord);
+void externalSort(long lDataCount);
+void mergeRuns(long firstRun, long nRuns, FILE *stream);
+PSTR runFileName(long iRun, PSTR runName);
+
+#define ZMERGEWAY 64                // Most runs merged in one pass, each one holds a stream block
+
+struct SORTKEY {unsigned long long key;   // time stamp bits, flipped so they order as unsigned integers
+                long index;};             // record number in the input
+
+#define SORTBYTES(size) ((double)(size) + 2. * (double)sizeof(struct SORTKEY))   // Memory a record takes while sorted: itself and two keys
+
+struct SORTWORK {int phase;               // 0 = make keys, 1 = count digits, 2 = move keys
+                 BYTE *pRecords;
+                 long N;
+                 struct SORTKEY *pFrom;   // keys before and after this pass
+                 struct SORTKEY *pTo;
+                 int shift;               // bit position of this pass's digit
+                 long *pCount;};          // 256 digit counts for each thread, then where each thread puts them
+
+BYTE *pDataBuffer = (BYTE *)NIL;    // Pointer to all the data, inside the input file map
 struct FILEHDR FileHeader;
 
 char tempfileName[_MAX_PATH];
 
-FILE *infileStream  = (FILE *)NIL;
+struct ZMAP *inputMap = (struct ZMAP *)NIL;
+FILE *infileStream = (FILE *)NIL;
 FILE *outfileStream = (FILE *)NIL;
 
+long firstRun = 0L, nextRun = 0L;                 // Run files that exist for the external sort
+FILE *runStream[ZMERGEWAY];                       // Runs being merged
+struct ZSTREAM *runRecords[ZMERGEWAY];
+int nRunsOpen = 0;
+
 const char szTask[]="DBSORT";
 
 int main(int argc, char *argv[])
@@ -45,7 +87,7 @@ int main(int argc, char *argv[])
 //   struct TRData *TRDataPntr;
 //   struct TXData *TXDataPntr;
    char infileName[_MAX_PATH], outfileName[_MAX_PATH];
-   long lbyteCount, lDataCount;
+   long lDataCount;
 // declarations need to manage wild cards
    struct CATSTRUCT *CatList;
    char Drive[_MAX_DRIVE], Dir[_MAX_DIR], Fname[_MAX_FNAME], Ext[_MAX_EXT];
@@ -64,6 +106,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,infileName);
    CatList = ZCatFiles(infileName);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -79,7 +122,6 @@ int main(int argc, char *argv[])
 
       zTaskMessage(2,"Opening Input File '%s'\n",infileName);
       if ((infileStream = zOpen(infileName,O_readb)) == NULL) Zexit(1);
-      
       if (!Zgethead(infileStream,&FileHeader)) BombOff(1);
 
       if ((FileHeader.type != TR_Data) && (FileHeader.type != TX_Data))
@@ -88,70 +130,60 @@ int main(int argc, char *argv[])
          BombOff(1);
          }
 
-      zTaskMessage(2,"Opening Scratch File '%s'\n",tempfileName);
+      lDataCount = countDataRecords(infileStream);
 
-      if ((outfileStream = zOpen(tempfileName,O_writeb)) == NULL) Zexit(1);
+      if (isSortedHeader(&FileHeader) || isSorted(infileStream))   // Trust the header, if it says so
+         {
+         if (!strcmp(infileName,outfileName))   // Nothing to do when the file would replace itself
+            {
+            zTaskMessage(1,"'%s' is already sorted.\n", infileName);
+            fcloseall();
+            continue;
+            }
 
-   /*
-   ** Read the input file data into memory
-   */
-      lbyteCount = filesize(infileStream) - sizeof(struct FILEHDR); // Number of data bytes to read
+         zSetSorted(&FileHeader, TRUE);
+         zTaskMessage(1,"Already sorted, copying %ld values.\n", lDataCount);
+         zTaskMessage(2,"Opening Scratch File '%s'\n",tempfileName);
+         if ((outfileStream = zOpen(tempfileName,O_writeb)) == NULL) BombOff(1);
 
-      if (ferror(infileStream))
-         {
-         zTaskMessage(10,"Error getting file length.\n");
-         zError();
-         BombOff(1);
-         }
+         copyRecords(lDataCount);
 
-      pDataBuffer = malloc(lbyteCount);
+         fcloseall();
 
-      if (!pDataBuffer)
-         {
-         zTaskMessage(10,"Memory allocation of %ld bytes failed.\n", lbyteCount);
-         BombOff(1);
+         ERRFLAG = zNameOutputFile(outfileName,tempfileName);
+         continue;
          }
-      
-      fread(pDataBuffer, 1, lbyteCount, infileStream);
 
-      if (ferror(infileStream))
+      zTaskMessage(2,"Opening Scratch File '%s'\n",tempfileName);
+
+      if ((outfileStream = zOpen(tempfileName,O_writeb)) == NULL) BombOff(1);
+
+      zSetSorted(&FileHeader, TRUE);   // Mark the output, so later runs and other tasks can skip the checks
+
+      if ((double)lDataCount * SORTBYTES(Zsize(FileHeader.type)) > (double)zMemoryBudget())
          {
-         zTaskMessage(10,"Error reading file data.\n");
-         zError();
-         BombOff(1);
+         externalSort(lDataCount);
+
+         fcloseall();
+
+         ERRFLAG = zNameOutputFile(outfileName,tempfileName);
+         continue;
          }
 
       Zclose(infileStream);
       infileStream = (FILE *)NIL;
-   /*
-   ** Quick sort based on time
-   */
-         switch (FileHeader.type)
-            {
-            case TR_Data:
-               lDataCount = lbyteCount / sizeof(struct TRData);
-               zTaskMessage(1,"Sorting %ld values.\n", lDataCount);
-               qsort(pDataBuffer, lDataCount, sizeof(struct TRData), qsortCompare);
-               break;
-            case TX_Data:
-               lDataCount = lbyteCount / sizeof(struct TXData);
-               zTaskMessage(1,"Sorting %ld values.\n", lDataCount);
-               qsort(pDataBuffer, lDataCount, sizeof(struct TXData), qsortCompare);
-               break;
-            }
 
-   /*
-   ** Write data to the output file
-   */
-      if (Zputhead(outfileStream,&FileHeader)) BombOff(1);     // Ouput file is the same type as the input file, just a sorted version of it
-      fwrite(pDataBuffer, 1, lbyteCount, outfileStream);
+      if ((inputMap = zMapOpen(infileName,&FileHeader,O_mapcopyb)) == NULL) BombOff(1);   // A private copy, in case sortRecords falls back to sorting in place
 
-      if (ferror(outfileStream))
-         {
-         zTaskMessage(10,"Error writing file data.\n");
-         zError();
-         BombOff(1);
-         }
+      zSetSorted(&FileHeader, TRUE);
+
+      pDataBuffer = (BYTE *)inputMap->records;
+      lDataCount = inputMap->nRecords;
+
+      zTaskMessage(1,"Sorting %ld values.\n", lDataCount);
+
+      if (Zputhead(outfileStream,&FileHeader)) BombOff(1);     // Ouput file is the same type as the input file, just a sorted version of it
+      sortRecords(pDataBuffer, lDataCount, outfileStream);
 
       fcloseall();
       
@@ -198,6 +230,505 @@ int qsortCompare(const void *v1, const void *v2)
    return(returnValue);
    }
 
+/************************************************
+**
+** Write N records to stream in time order with a stable LSD radix sort.
+** Each time stamp becomes a 64 bit key (the sign bit flipped for positive
+** values, all bits flipped for negative ones) that orders as an unsigned
+** integer, and the keys are sorted a byte at a time on THREADS threads.
+** Each thread counts and moves a contiguous share of the keys, so equal
+** keys keep their order. Bytes that are the same in every key, usually the
+** high bytes of the times, are skipped. The records themselves are only
+** moved once, a block at a time on the way to the file. If there is not
+** enough memory for the keys, the records are quick sorted in place.
+** Records that are already in a few ascending runs are merged instead.
+*/
+void sortRecords(BYTE *pRecords, long N, FILE *stream)
+   {
+   struct SORTWORK work;
+   struct SORTKEY *pKeys, *pSwap;
+   BYTE *pBlock;
+   long I, J, nBlock, total, *pCount;
+   long pStart[ZMERGEWAY + 1];
+   int nThreads, iThread, digit, nRuns;
+   short size = Zsize(FileHeader.type);
+
+/*
+** Nearly sorted data need not be radix sorted. If the records are in at most
+** ZMERGEWAY ascending runs, they are written as they are or merged.
+*/
+   for (nRuns = 1, pStart[0] = 0L, I = 1L; (I < N) && (nRuns <= ZMERGEWAY); ++I)
+      {
+      if (recordTime(pRecords + I * size) < recordTime(pRecords + (I - 1L) * size)) pStart[nRuns++] = I;
+      }
+
+   if (nRuns == 1)
+      {
+      if (zPutData(N, stream, (char *)pRecords, FileHeader.type) != N)
+         {
+         zTaskMessage(10,"Error writing file data.\n");
+         BombOff(1);
+         }
+      return;
+      }
+
+   if (nRuns <= ZMERGEWAY)
+      {
+      zTaskMessage(3,"Merging %d sorted runs.\n", nRuns);
+      mergeSortedRuns(pRecords, N, pStart, nRuns, stream);
+      return;
+      }
+
+   nThreads = zThreadCount();
+   if (N < 65536L) nThreads = 1;
+
+   pKeys  = (struct SORTKEY *)malloc(2L * N * sizeof(struct SORTKEY) + 1L);
+   pCount = (long *)malloc(256L * nThreads * sizeof(long));
+   pBlock = (BYTE *)malloc(ZBLOCKRECORDS * size);
+
+   if (!pKeys || !pCount || !pBlock)
+      {
+      if (pKeys)  free(pKeys);
+      if (pCount) free(pCount);
+      if (pBlock) free(pBlock);
+
+      zTaskMessage(4,"Not enough memory for the radix sort, using a quick sort.\n");
+      qsort(pRecords, N, size, qsortCompare);
+
+      if (zPutData(N, stream, (char *)pRecords, FileHeader.type) != N)
+         {
+         zTaskMessage(10,"Error writing file data.\n");
+         BombOff(1);
+         }
+      return;
+      }
+
+   work.pRecords = pRecords;
+   work.N = N;
+   work.pFrom = pKeys;
+   work.pTo = pKeys + N;
+   work.pCount = pCount;
+
+   work.phase = 0;
+   zRunThreads(nThreads, SORTTHREAD, &work);
+
+   for (work.shift = 0; work.shift < 64; work.shift += 8)
+      {
+      work.phase = 1;
+      zRunThreads(nThreads, SORTTHREAD, &work);
+
+      for (digit = 0; digit < 256; ++digit)     // Skip the pass if every key has this digit
+         {
+         for (total = 0L, iThread = 0; iThread < nThreads; ++iThread) total += pCount[256 * iThread + digit];
+         if (total) break;
+         }
+      if (total == N) continue;
+
+      for (total = 0L, digit = 0; digit < 256; ++digit)   // Digit by digit, thread by thread, so the moves are stable
+         {
+         for (iThread = 0; iThread < nThreads; ++iThread)
+            {
+            I = pCount[256 * iThread + digit];
+            pCount[256 * iThread + digit] = total;
+            total += I;
+            }
+         }
+
+      work.phase = 2;
+      zRunThreads(nThreads, SORTTHREAD, &work);
+
+      pSwap = work.pFrom;
+      work.pFrom = work.pTo;
+      work.pTo = pSwap;
+      }
+
+   for (I = 0L; I < N; I += nBlock)
+      {
+      nBlock = Min(ZBLOCKRECORDS, N - I);
+
+      for (J = 0L; J < nBlock; ++J) memcpy(pBlock + J * size, pRecords + work.pFrom[I + J].index * size, size);
+
+      if (zPutData(nBlock, stream, (char *)pBlock, FileHeader.type) != nBlock)
+         {
+         zTaskMessage(10,"Error writing file data.\n");
+         BombOff(1);
+         }
+      }
+
+   free(pKeys);
+   free(pCount);
+   free(pBlock);
+
+   return;
+   }
+
+/*
+** One thread's share of a radix sort phase, keys first to last-1
+*/
+void SORTTHREAD(int iThread, int nThreads, void *pData)
+   {
+   struct SORTWORK *pWork = (struct SORTWORK *)pData;
+   long I, first, last, *pCount = pWork->pCount + 256 * iThread;
+   unsigned long long key;
+   double TIME;
+   short size = Zsize(FileHeader.type);
+
+   first = (long)((double)pWork->N * iThread / nThreads);
+   last  = (long)((double)pWork->N * (iThread + 1) / nThreads);
+
+   switch (pWork->phase)
+      {
+      case 0:
+         for (I = first; I < last; ++I)
+            {
+            TIME = recordTime(pWork->pRecords + I * size);
+            if (TIME == 0.) TIME = 0.;          // -0 sorts with +0
+
+            memcpy(&key, &TIME, sizeof(key));
+            key = (key >> 63) ? ~key : (key | 0x8000000000000000ULL);
+
+            pWork->pFrom[I].key = key;
+            pWork->pFrom[I].index = I;
+            }
+         break;
+
+      case 1:
+         memset(pCount, 0, 256 * sizeof(long));
+         for (I = first; I < last; ++I) ++pCount[(pWork->pFrom[I].key >> pWork->shift) & 0xFF];
+         break;
+
+      case 2:
+         for (I = first; I < last; ++I) pWork->pTo[pCount[(pWork->pFrom[I].key >> pWork->shift) & 0xFF]++] = pWork->pFrom[I];
+         break;
+      }
+
+   return;
+   }
+
+/*
+** Merge the nRuns ascending runs of the N records, run r starting at record pStart[r], into stream
+*/
+void mergeSortedRuns(BYTE *pRecords, long N, long *pStart, int nRuns, FILE *stream)
+   {
+   char *pRecord[ZMERGEWAY], *pEnd[ZMERGEWAY];
+   int heap[ZMERGEWAY];
+   int nHeap, iRun, top;
+   BYTE *pBlock;
+   long nBlock;
+   short size = Zsize(FileHeader.type);
+
+   if (!(pBlock = (BYTE *)malloc(ZBLOCKRECORDS * size)))
+      {
+      zTaskMessage(10,"Unable to allocate memory for the merge.\n");
+      BombOff(1);
+      }
+
+   for (nHeap = 0, iRun = 0; iRun < nRuns; ++iRun)
+      {
+      pRecord[iRun] = (char *)pRecords + pStart[iRun] * size;
+      pEnd[iRun]    = (char *)pRecords + ((iRun + 1 < nRuns) ? pStart[iRun+1] : N) * size;
+      heapPush(heap, &nHeap, iRun, pRecord);
+      }
+
+   for (nBlock = 0L; nHeap; )
+      {
+      top = heap[0];
+      memcpy(pBlock + nBlock * size, pRecord[top], size);
+      pRecord[top] += size;
+
+      heapNext(heap, &nHeap, pRecord, pRecord[top] == pEnd[top]);
+
+      if ((++nBlock == ZBLOCKRECORDS) || !nHeap)
+         {
+         if (zPutData(nBlock, stream, (char *)pBlock, FileHeader.type) != nBlock)
+            {
+            zTaskMessage(10,"Error writing file data.\n");
+            BombOff(1);
+            }
+         nBlock = 0L;
+         }
+      }
+
+   free(pBlock);
+
+   return;
+   }
+
+/*
+** TRUE if the records of stream, just past its header, are in time order.
+** The scan stops at the first record out of order, and stream is left just past the header.
+*/
+BOOL isSorted(FILE *stream)
+   {
+   struct ZSTREAM *pRecs;
+   char *pRecords;
+   double TIME, lastTime = -HUGE_VAL;
+   long I, N;
+   BOOL bSorted = TRUE;
+
+   if (!(pRecs = zStreamOpen(stream, FileHeader.type, O_readb))) BombOff(1);
+
+   while (bSorted && ((N = zStreamGetBlock(pRecs,&pRecords)) > 0L))
+      {
+      for (I = 0L; I < N; ++I)
+         {
+         TIME = recordTime((BYTE *)pRecords + I * pRecs->size);
+         if (TIME < lastTime)
+            {
+            bSorted = FALSE;
+            break;
+            }
+         lastTime = TIME;
+         }
+      }
+
+   zStreamClose(pRecs);
+
+   if (ferror(stream) || !Zgethead(stream,(struct FILEHDR *)NIL)) BombOff(1);
+
+   return(bSorted);
+   }
+
+/*
+** Copy the N records of infileStream to outfileStream, the file is already sorted
+*/
+void copyRecords(long N)
+   {
+   BYTE *pBlock;
+   long nBlock;
+
+   if (!(pBlock = (BYTE *)malloc(ZBLOCKRECORDS * Zsize(FileHeader.type))))
+      {
+      zTaskMessage(10,"Unable to allocate memory for the copy.\n");
+      BombOff(1);
+      }
+
+   if (Zputhead(outfileStream,&FileHeader)) BombOff(1);
+
+   while ((nBlock = zGetData(ZBLOCKRECORDS, infileStream, (char *)pBlock, FileHeader.type)) > 0L)
+      {
+      if (zPutData(nBlock, outfileStream, (char *)pBlock, FileHeader.type) != nBlock)
+         {
+         zTaskMessage(10,"Error writing file data.\n");
+         BombOff(1);
+         }
+      }
+
+   free(pBlock);
+
+   if (ferror(infileStream)) BombOff(1);
+
+   return;
+   }
+
+/*
+** Time stamp of a time labeled record
+*/
+double recordTime(BYTE *pRecord)
+   {
+   return((FileHeader.type == TR_Data) ? ((struct TRData *)pRecord)->t : ((struct TXData *)pRecord)->t);
+   }
+
+/************************************************
+**
+** External merge sort of a file too large for MEMORY. The input is read a
+** MEMORY sized piece at a time, each piece is sorted and written to its own
+** run file, and the runs are merged into the output file. When there are
+** more than ZMERGEWAY runs, merge passes combine them into longer runs first.
+*/
+void externalSort(long lDataCount)
+   {
+   char runName[_MAX_PATH];
+   FILE *runFile;
+   BYTE *pRun;
+   long runSize, N, lastRun;
+   short size = Zsize(FileHeader.type);
+
+   runSize = (long)((double)zMemoryBudget() / SORTBYTES(size));   // The records and two key arrays
+   if (runSize > lDataCount) runSize = lDataCount;
+
+   if (!(pRun = (BYTE *)malloc((size_t)runSize * size)))
+      {
+      zTaskMessage(10,"Unable to allocate memory for %ld values.\n", runSize);
+      BombOff(1);
+      }
+
+   zTaskMessage(1,"Sorting %ld values in runs of %ld.\n", lDataCount, runSize);
+
+   firstRun = nextRun = 0L;
+
+   while ((N = zGetData(runSize, infileStream, (char *)pRun, FileHeader.type)) > 0L)
+      {
+      if ((runFile = zOpen(runFileName(nextRun,runName),O_writeb)) == NULL) BombOff(1);
+      ++nextRun;                                           // Exists now, so BombOff removes it
+
+      if (Zputhead(runFile,&FileHeader))
+         {
+         Zclose(runFile);
+         BombOff(1);
+         }
+
+      sortRecords(pRun, N, runFile);
+
+      Zclose(runFile);
+      }
+
+   free(pRun);
+
+   if (ferror(infileStream)) BombOff(1);
+
+   while (nextRun - firstRun > ZMERGEWAY)                  // Merge passes until one last merge is enough
+      {
+      for (lastRun = nextRun; firstRun < lastRun; firstRun += N)   // A whole pass at a time, so the new runs stay in input order
+         {
+         N = Min(ZMERGEWAY, lastRun - firstRun);
+
+         if ((runFile = zOpen(runFileName(nextRun,runName),O_writeb)) == NULL) BombOff(1);
+         ++nextRun;
+
+         zTaskMessage(3,"Merging runs %ld to %ld.\n", firstRun, firstRun + N - 1L);
+         mergeRuns(firstRun, N, runFile);
+
+         Zclose(runFile);
+         }
+      }
+
+   zTaskMessage(3,"Merging %ld runs.\n", nextRun - firstRun);
+   mergeRuns(firstRun, nextRun - firstRun, outfileStream);
+   firstRun = nextRun;
+
+   return;
+   }
+
+/*
+** Merge the sorted run files firstRun to firstRun+nRuns-1 into stream, which must be positioned at its header.
+** A heap of the runs ordered by their current record picks the next record out. The runs are removed afterwards.
+*/
+void mergeRuns(long firstRun, long nRuns, FILE *stream)
+   {
+   char runName[_MAX_PATH];
+   char *pRecord[ZMERGEWAY];
+   int heap[ZMERGEWAY];
+   int nHeap, iRun, top;
+   struct ZSTREAM *outRecords;
+
+   if (Zputhead(stream,&FileHeader)) BombOff(1);
+   if (!(outRecords = zStreamOpen(stream, FileHeader.type, O_writeb))) BombOff(1);
+
+   for (nRunsOpen = 0; nRunsOpen < nRuns; ++nRunsOpen)
+      {
+      if ((runStream[nRunsOpen] = zOpen(runFileName(firstRun + nRunsOpen,runName),O_readb)) == NULL) BombOff(1);
+      if (!Zgethead(runStream[nRunsOpen],(struct FILEHDR *)NIL) ||
+          !(runRecords[nRunsOpen] = zStreamOpen(runStream[nRunsOpen], FileHeader.type, O_readb)))
+         {
+         Zclose(runStream[nRunsOpen]);
+         BombOff(1);
+         }
+      }
+
+/*
+** Start the heap with the first record of every run, then replace the smallest record with the next one from its run
+*/
+   for (nHeap = 0, iRun = 0; iRun < nRunsOpen; ++iRun)
+      {
+      if (!(pRecord[iRun] = (char *)malloc(Zsize(FileHeader.type))))
+         {
+         zTaskMessage(10,"Unable to allocate memory for the merge.\n");
+         BombOff(1);
+         }
+
+      if (zStreamRead(runRecords[iRun],pRecord[iRun])) heapPush(heap, &nHeap, iRun, pRecord);
+      }
+
+   while (nHeap)
+      {
+      top = heap[0];
+      if (zStreamWrite(outRecords,pRecord[top])) BombOff(1);
+
+      heapNext(heap, &nHeap, pRecord, !zStreamRead(runRecords[top],pRecord[top]));
+      }
+
+   if (zStreamClose(outRecords) || ferror(stream)) BombOff(1);
+
+   for (iRun = 0; iRun < nRunsOpen; ++iRun) free(pRecord[iRun]);
+
+   while (nRunsOpen)
+      {
+      --nRunsOpen;
+      zStreamClose(runRecords[nRunsOpen]);
+      if (ferror(runStream[nRunsOpen])) BombOff(1);
+      Zclose(runStream[nRunsOpen]);
+      unlink(runFileName(firstRun + nRunsOpen,runName));
+      }
+
+   return;
+   }
+
+/*
+** Order of the current records of two runs. Equal times go to the earlier run, which holds the earlier
+** part of the input, so the merge is as stable as the runs.
+*/
+int mergeCompare(int iRun1, int iRun2, char **pRecord)
+   {
+   int returnValue = qsortCompare(pRecord[iRun1], pRecord[iRun2]);
+
+   if (!returnValue) returnValue = (iRun1 < iRun2) ? -1 : 1;
+
+   return(returnValue);
+   }
+
+/*
+** Add run iRun, whose current record is pRecord[iRun], to the heap of runs
+*/
+void heapPush(int *heap, int *pnHeap, int iRun, char **pRecord)
+   {
+   int parent, child;
+
+   for (child = (*pnHeap)++; child > 0; child = parent)     // Sift up
+      {
+      parent = (child - 1) / 2;
+      if (mergeCompare(heap[parent], iRun, pRecord) < 0) break;
+      heap[child] = heap[parent];
+      }
+   heap[child] = iRun;
+
+   return;
+   }
+
+/*
+** The run at the top of the heap has moved on to its next record, or has none left if bDone
+*/
+void heapNext(int *heap, int *pnHeap, char **pRecord, BOOL bDone)
+   {
+   int parent, child, top = heap[0];
+
+   if (bDone) top = heap[--(*pnHeap)];     // Run is finished, the last one takes its place
+
+   for (parent = 0; (child = 2 * parent + 1) < *pnHeap; parent = child)   // Sift down
+      {
+      if ((child + 1 < *pnHeap) && (mergeCompare(heap[child+1], heap[child], pRecord) < 0)) ++child;
+      if (mergeCompare(top, heap[child], pRecord) < 0) break;
+      heap[parent] = heap[child];
+      }
+   if (*pnHeap) heap[parent] = top;
+
+   return;
+   }
+
+/*
+** Name of run file iRun, the scratch file name with the extension .Rn
+*/
+PSTR runFileName(long iRun, PSTR runName)
+   {
+   char Drive[_MAX_DRIVE], Dir[_MAX_DIR], Fname[_MAX_FNAME], Ext[_MAX_EXT];
+
+   splitPath(tempfileName,Drive,Dir,Fname,Ext);
+   sprintf(Ext,".R%ld",iRun);
+   makePath(runName,Drive,Dir,Fname,Ext);
+
+   return(runName);
+   }
+
 /***************************************************************
 **
 ** Process ^C Interrupt
@@ -217,22 +748,34 @@ void FPEERROR(int a)
 
 void BombOff(int a)
    {
+   char runName[_MAX_PATH];
+
    fcloseall();
    unlink(tempfileName);
+
+   for (; firstRun < nextRun; ++firstRun) unlink(runFileName(firstRun,runName));
    ZCatFiles((char*)NIL); // free catalog memory
    Zexit(a);
    }
 
 void fcloseall()
    {
-   if (infileStream) Zclose(infileStream);
-   infileStream = (FILE *)NIL;
-   
    if (outfileStream) Zclose(outfileStream);
    outfileStream = (FILE *)NIL;
 
-   if (pDataBuffer) free(pDataBuffer);
-   pDataBuffer = (BYTE *)NIL;
+   if (infileStream) Zclose(infileStream);
+   infileStream = (FILE *)NIL;
+
+   while (nRunsOpen)
+      {
+      --nRunsOpen;
+      zStreamClose(runRecords[nRunsOpen]);
+      Zclose(runStream[nRunsOpen]);
+      }
+
+   if (inputMap) zMapClose(inputMap);
+   inputMap = (struct ZMAP *)NIL;
+   pDataBuffer = (BYTE *)NIL;          // Pointed into the file map
    
    return;
    }
@@ -27,7 +27,9 @@
 *           if TRANGE[0] > TRANGE[1] then only look outside that range (inclusive)
 * CODE 8: Starting at record P (zero indexed) save N records. P = TRANGE[1] and N = TRANGE[2]
 *
-* The duplicate removal using CODE 6 is done brute force and runs in N^2 time, so it can take a while for even modest sized files.
+* The duplicate removal using CODE 6 first reads every time stamp into memory and sorts them to find the times that occur more than once,
+* so it runs in N log N time. If the time stamps do not fit in MEMORY (TISAN.CFG) the file is read in several passes, each one
+* looking at a share of the time stamps picked by a hash of their value.
 *
 * The infile of this task accepts wild cards.
 *
@@ -60,6 +62,8 @@ void deleteOutsideTimeAndAmpRange(double TIME, double VALUE, short dataType);
 void deleteInsideTimeAndAmpRange(double TIME, double VALUE, short dataType);
 
 void deleteDuplicates(double TIME, short dataType);
+void findDuplicateTimes(void);
+int compareTimes(const void *v1, const void *v2);
 void deleteSortedDuplicates(double TIME, short dataType);
 
 void saveRecordsStartingatP(short dataType);
@@ -69,7 +73,13 @@ char TMPFILE[_MAX_PATH];  // Must be visible to BREAKREQ
 
 FILE *INSTR  = (FILE *)NIL;
 FILE *OUTSTR = (FILE *)NIL;
-FILE *INSTR2  = (FILE *)NIL; // Used for removing duplicate time labels value (need to rescan file for every data point)
+FILE *INSTR2  = (FILE *)NIL; // Used to collect the time stamps for removing duplicate time labels
+
+double *pDuplicateTimes = (double *)NIL; // Sorted list of the times that occur more than once (CODE 6)
+long nDuplicateTimes = 0L;
+
+struct ZSTREAM *INRECS  = (struct ZSTREAM *)NIL;
+struct ZSTREAM *OUTRECS = (struct ZSTREAM *)NIL;
 
 double WCNT=0., DCNT=0., TCNT=0., FCNT=0., TB;
 struct FILEHDR FileHeader;
@@ -133,6 +143,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -151,6 +162,7 @@ int main(int argc, char *argv[])
       if ((INSTR = zOpen(INFILE,O_readb)) == NULL) Zexit(1);
 
       if  (!Zgethead(INSTR,&FileHeader)) BombOff(1);
+      zSetSorted(&FileHeader, isSortedHeader(&FileHeader));   // Deleting or flagging points cannot change their order
 
       if ((CODE == 6) || (CODE == 7))
          {
@@ -163,6 +175,7 @@ int main(int argc, char *argv[])
          if (CODE == 6)
             {
             if ((INSTR2 = zOpen(INFILE,O_readb)) == NULL) BombOff(1);
+            findDuplicateTimes();
             }
          }
          
@@ -171,6 +184,9 @@ int main(int argc, char *argv[])
            Zputhead(OUTSTR,&FileHeader))
          BombOff(1);
 
+      if (!(INRECS  = zStreamOpen(INSTR,  FileHeader.type, O_readb)))  BombOff(1);
+      if (!(OUTRECS = zStreamOpen(OUTSTR, FileHeader.type, O_writeb))) BombOff(1);
+
       TB = FileHeader.b;  /* Save time intercept in case we change it */
 
       FCNT  = 0.;
@@ -181,7 +197,7 @@ int main(int argc, char *argv[])
 
       printPercentComplete(0L, 0L, 0);
 
-      while (Zread(INSTR,BUFFER,FileHeader.type))
+      while (zStreamRead(INRECS,BUFFER))
          {
          if (extractValues(BUFFER, &FileHeader, TCNT, &TIME, &VALUE, &Zval, &FLAG))
             {
@@ -195,7 +211,7 @@ int main(int argc, char *argv[])
                switch (CODE)
                   {
                   case 0:  /* Delete values outside time range */
-                     if (deleteTimeSeriesOutsideTimeRange(TIME) && Zwrite(OUTSTR,BUFFER,R_Data)) BombOff(1); // relies on short circuit of &&
+                     if (deleteTimeSeriesOutsideTimeRange(TIME) && zStreamWrite(OUTRECS,BUFFER)) BombOff(1); // relies on short circuit of &&
                      break;
                   case 1:  /* Delete values inside time range */
                      RDataPntr->f = deleteTimeSeriesInsideTimeRange(TIME, RDataPntr->f);
@@ -213,10 +229,10 @@ int main(int argc, char *argv[])
                      RDataPntr->f = deleteTimeSeriesInsideTimeAndAmpRange(TIME, VALUE, RDataPntr->f);
                      break;
                   case 8:
-                     if (saveTimeSeriesRecordsStartingatP() && Zwrite(OUTSTR,BUFFER,R_Data)) BombOff(1); // relies on short circuit of &&
+                     if (saveTimeSeriesRecordsStartingatP() && zStreamWrite(OUTRECS,BUFFER)) BombOff(1); // relies on short circuit of &&
                      break;
                   }
-               if (((CODE > 0) && (CODE < 6)) && Zwrite(OUTSTR,BUFFER,R_Data)) BombOff(1); // Short circuits, so does not try to write in that case
+               if (((CODE > 0) && (CODE < 6)) && zStreamWrite(OUTRECS,BUFFER)) BombOff(1); // Short circuits, so does not try to write in that case
                break;
 
             case TR_Data:
@@ -256,7 +272,7 @@ int main(int argc, char *argv[])
                switch (CODE)
                   {
                   case 0:  /* Delete values outside time range. */
-                     if (deleteTimeSeriesOutsideTimeRange(TIME) && Zwrite(OUTSTR,BUFFER,X_Data)) BombOff(1); // relies on short circuit of &&
+                     if (deleteTimeSeriesOutsideTimeRange(TIME) && zStreamWrite(OUTRECS,BUFFER)) BombOff(1); // relies on short circuit of &&
                      break;
                   case 1:  /* Delete values inside time range */
                      XDataPntr->f = deleteTimeSeriesInsideTimeRange(TIME, XDataPntr->f);
@@ -274,10 +290,10 @@ int main(int argc, char *argv[])
                      XDataPntr->f = deleteTimeSeriesInsideTimeAndAmpRange(TIME, VALUE, XDataPntr->f);
                      break;
                   case 8:
-                     if (saveTimeSeriesRecordsStartingatP() && Zwrite(OUTSTR,BUFFER,X_Data)) BombOff(1); // relies on short circuit of &&
+                     if (saveTimeSeriesRecordsStartingatP() && zStreamWrite(OUTRECS,BUFFER)) BombOff(1); // relies on short circuit of &&
                      break;
                   }
-               if (((CODE > 0) && (CODE < 6)) && Zwrite(OUTSTR,BUFFER,X_Data)) BombOff(1); // Short circuits, so does not try to write in that case
+               if (((CODE > 0) && (CODE < 6)) && zStreamWrite(OUTRECS,BUFFER)) BombOff(1); // Short circuits, so does not try to write in that case
                break;
 
             case TX_Data:
@@ -319,6 +335,9 @@ int main(int argc, char *argv[])
 
       FileHeader.b = TB;                       /* Update intercept */
 
+      if (zStreamClose(OUTRECS)) BombOff(1);  // Flush the last block before the header is rewritten
+      OUTRECS = (struct ZSTREAM *)NIL;
+
       if ((Zputhead(OUTSTR,&FileHeader)) || (ferror(INSTR)))
          BombOff(1);
       else
@@ -355,7 +374,7 @@ void saveRecordsStartingatP(short dataType)
    if ((TCNT >= TRANGE[0]) && (TCNT < TRANGE[0]+TRANGE[1]))
       {
       ++WCNT;       // Count points written
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       }
    else
       ++DCNT;                       // Count deletes
@@ -490,7 +509,7 @@ void deleteOutsideTimeRange(double TIME, short dataType)
       }
    else
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -505,7 +524,7 @@ void deleteInsideTimeRange(double TIME, short dataType)
       }
    else
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -520,7 +539,7 @@ void deleteOutsideAmpRange(double VALUE, short dataType)
       }
    else
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -535,7 +554,7 @@ void deleteInsideAmpRange(double VALUE, short dataType)
       }
    else
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -551,7 +570,7 @@ void deleteOutsideTimeAndAmpRange(double TIME, double VALUE, short dataType)
       }
    else
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -567,7 +586,7 @@ void deleteInsideTimeAndAmpRange(double TIME, double VALUE, short dataType)
       }
    else
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -575,57 +594,149 @@ void deleteInsideTimeAndAmpRange(double TIME, double VALUE, short dataType)
    }
 
 /*
-** Brute force removal of duplicate time points. Both points are removed. Runs on order N^2, so it can take a while. Data need not be sorted.
+** Removal of duplicate time points. All copies are removed. Data need not be sorted.
+** The times that occur more than once were found by findDuplicateTimes, so each point is a binary search.
 */
 void deleteDuplicates(double TIME, short dataType)
    {
-   double VALUE2;
+   if ((TRANGE[0] == TRANGE[1])                                                  || // Look in all the data
+       ((TRANGE[0] < TRANGE[1]) && ((TIME >= TRANGE[0]) && (TIME <= TRANGE[1]))) || // look inside T0 to T1 (inclusive)
+       ((TRANGE[1] < TRANGE[0]) && ((TIME <= TRANGE[1]) || (TIME >= TRANGE[0]))))   // look outside T0 and T1 (inclusive)
+      {
+      if (nDuplicateTimes && bsearch(&TIME, pDuplicateTimes, nDuplicateTimes, sizeof(double), compareTimes))
+         {
+         ++DCNT;                       /* Count deletes */
+         }
+      else
+         {
+         if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
+         ++WCNT;                       /* Count writes */
+         }
+      }
+   else  // Not in the range where we are looking, so keep it....
+      {
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
+      ++WCNT;
+      }
+
+   return;
+   }
+
+/*
+** Build the sorted list of time stamps that occur more than once in the file open on INSTR2.
+** The times are read into memory and sorted, and every run of equal times adds one entry to the list.
+** When all the times will not fit in the memory budget the file is read nPass times, and pass k only
+** keeps the times whose hash is k modulo nPass. Equal times always hash the same, so no duplicate is split between passes.
+*/
+void findDuplicateTimes()
+   {
+   struct ZSTREAM *pRecs;
    struct FILEHDR FileHeader2;
+   double *pTimes, TIME2, VALUE2;
    short  FLAG2;
    struct complex Zval2;
    char BUFFER2[sizeof(struct TXData)];
-   double duplicateCount;
+   unsigned long long hash;
+   long N, nPass, nAlloc, nTimes, iPass, I, J;
 
-   if ((TRANGE[0] == TRANGE[1])                                                  || // Look in all the data
-       ((TRANGE[0] < TRANGE[1]) && ((TIME >= TRANGE[0]) && (TIME <= TRANGE[1]))) || // look inside T0 to T1 (inclusive)
-       ((TRANGE[1] < TRANGE[0]) && ((TIME <= TRANGE[1]) || (TIME >= TRANGE[0]))))   // look outside T0 and T1 (inclusive)
+   N = countDataRecords(INSTR2);
+
+   nPass = (long)(((double)N * sizeof(double)) / (double)zMemoryBudget()) + 1L;
+   nAlloc = N / nPass + N / (8L * nPass) + 16L;   // Allow for an uneven hash, the array grows if needed
+
+   zTaskMessage(4,"Looking for duplicate time stamps in %ld points, %ld pass(es)\n", N, nPass);
+
+   pDuplicateTimes = (double *)NIL;
+   nDuplicateTimes = 0L;
+
+   if (!(pTimes = (double *)malloc(nAlloc * sizeof(double))))
       {
-      if (!Zgethead(INSTR2,&FileHeader2)) BombOff(1);   // Rewind the second input stream of the data file
-      duplicateCount = -1.;                             // There will be one match if there are no duplicates, so the first count goes to zero
+      zTaskMessage(10,"Unable to allocate memory for %ld time stamps.\n", nAlloc);
+      BombOff(1);
+      }
 
-      TCNT2 = 0.0;
-      while (Zread(INSTR2,BUFFER2,FileHeader2.type)) // Loop through every record in the input file and look for TIME
+   if (!Zgethead(INSTR2,&FileHeader2)) BombOff(1);
+   if (!(pRecs = zStreamOpen(INSTR2, FileHeader2.type, O_readb))) BombOff(1);
+
+   for (iPass = 0L; iPass < nPass; ++iPass)
+      {
+      if (iPass && zStreamRewind(pRecs)) BombOff(1);
+
+      nTimes = 0L;
+      TCNT2  = 0.;
+      while (zStreamRead(pRecs,BUFFER2))
          {
          if (extractValues(BUFFER2, &FileHeader2, TCNT2, &TIME2, &VALUE2, &Zval2, &FLAG2))
             {
             zTaskMessage(10,"Unknown Data Type in case 6.\n");
             BombOff(1);
             }
-         if (TIME == TIME2) ++duplicateCount;
          ++TCNT2;
-         }
 
-      if (duplicateCount != 0.)
-         {
-         ++DCNT;                       /* Count deletes */
+         if (TIME2 == 0.) TIME2 = 0.;   // -0 and +0 are the same time, so give them the same hash
+         if (nPass > 1L)
+            {
+            memcpy(&hash, &TIME2, sizeof(hash));
+            hash ^= hash >> 33;
+            hash *= 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 33;
+            if ((long)(hash % (unsigned long long)nPass) != iPass) continue;
+            }
+
+         if (nTimes == nAlloc)
+            {
+            nAlloc += nAlloc / 2L;
+            if (!(pTimes = (double *)realloc(pTimes, nAlloc * sizeof(double))))
+               {
+               zTaskMessage(10,"Unable to allocate memory for %ld time stamps.\n", nAlloc);
+               BombOff(1);
+               }
+            }
+         pTimes[nTimes++] = TIME2;
          }
-      else
+
+      qsort(pTimes, nTimes, sizeof(double), compareTimes);
+
+      for (I = 0L; I < nTimes; I = J)
          {
-         if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
-         ++WCNT;                       /* Count writes */
+         for (J = I + 1L; (J < nTimes) && (pTimes[J] == pTimes[I]); ++J);
+
+         if (J - I > 1L)
+            {
+            if (!(nDuplicateTimes % 1024L) &&
+                !(pDuplicateTimes = (double *)realloc(pDuplicateTimes, (nDuplicateTimes + 1024L) * sizeof(double))))
+               {
+               zTaskMessage(10,"Unable to allocate memory for the duplicate time stamps.\n");
+               BombOff(1);
+               }
+            pDuplicateTimes[nDuplicateTimes++] = pTimes[I];
+            }
          }
-
-      printPercentComplete((long)TCNT, (long)TCNT2, PROGRESS);
       }
-   else  // Not in the range where we are looking, so keep it....
-      {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
-      ++WCNT;
-      }
-
+
+   zStreamClose(pRecs);
+   free(pTimes);
+
+   if (nPass > 1L) qsort(pDuplicateTimes, nDuplicateTimes, sizeof(double), compareTimes);   // Each pass added its own sorted share
+
+   zTaskMessage(4,"%ld Time Stamps Occur More Than Once\n", nDuplicateTimes);
+
    return;
    }
 
+/*
+** qsort and bsearch comparison of two time stamps
+*/
+int compareTimes(const void *v1, const void *v2)
+   {
+   double time1 = *(const double *)v1, time2 = *(const double *)v2;
+
+   if (time1 < time2) return(-1);
+   if (time1 > time2) return(1);
+
+   return(0);
+   }
+
 /*
 ** Removal of duplicate time points from a sorted data set. The first data point is retained and all others with the same time stamp are removed.
 ** Since the data are sorted, this function runs in order N.
@@ -663,13 +774,13 @@ void deleteSortedDuplicates(double TIME, short dataType)
          }
       else
          {
-         if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+         if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
          ++WCNT;
          }
       }
    else  // Not in the range where we are looking, so keep it....
       {
-      if (Zwrite(OUTSTR,BUFFER,dataType)) BombOff(1);
+      if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
       ++WCNT;
       }
 
@@ -703,6 +814,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
+   if (INRECS) zStreamClose(INRECS);
+   INRECS = (struct ZSTREAM *)NIL;
+
+   if (OUTRECS) zStreamClose(OUTRECS);
+   OUTRECS = (struct ZSTREAM *)NIL;
+
    if (INSTR) Zclose(INSTR);
    INSTR = (FILE *)NIL;
    
@@ -712,5 +829,9 @@ void fcloseall()
    if (INSTR2) Zclose(INSTR2);
    INSTR2 = (FILE *)NIL;
 
+   if (pDuplicateTimes) free(pDuplicateTimes);
+   pDuplicateTimes = (double *)NIL;
+   nDuplicateTimes = 0L;
+
    return;
    }
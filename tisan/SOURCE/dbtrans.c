@@ -55,6 +55,9 @@ char TMPFILE[_MAX_PATH];
 FILE *INSTR  = (FILE *)NIL;
 FILE *OUTSTR = (FILE *)NIL;
 
+struct ZSTREAM *INRECS  = (struct ZSTREAM *)NIL;
+struct ZSTREAM *OUTRECS = (struct ZSTREAM *)NIL;
+
 const char szTask[]="DBTRANS";
 
 int main(int argc, char *argv[])
@@ -96,6 +99,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -132,10 +136,13 @@ int main(int argc, char *argv[])
 
       if (Zputhead(OUTSTR,&FileHeader)) BombOff(1);
 
+      if (!(INRECS  = zStreamOpen(INSTR,  FileHeader.type, O_readb)))  BombOff(1);
+      if (!(OUTRECS = zStreamOpen(OUTSTR, FileHeader.type, O_writeb))) BombOff(1);
+
       FLAG=0;
       TCNT=0.;
 
-      while (Zread(INSTR,BUFFER,FileHeader.type))
+      while (zStreamRead(INRECS,BUFFER))
          {
          if (extractValues(BUFFER, &FileHeader, TCNT, &TIME, &Rval, &Zval, &FLAG))
             {
@@ -188,13 +195,16 @@ int main(int argc, char *argv[])
 
          insertValues(BUFFER, &FileHeader, TIME, Rval, Zval, FLAG);
 
-         if (Zwrite(OUTSTR,BUFFER,FileHeader.type)) BombOff(1);
+         if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
 
          ++TCNT;           // Must update after all the processing...
          } /* end while */
 
       if (ferror(INSTR)) BombOff(1);
 
+      if (zStreamClose(OUTRECS)) BombOff(1);  // Flush the last block before the file is closed
+      OUTRECS = (struct ZSTREAM *)NIL;
+
       fcloseall();
 
       ERRFLAG = zNameOutputFile(OUTFILE,TMPFILE);
@@ -436,6 +446,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
+   if (INRECS) zStreamClose(INRECS);
+   INRECS = (struct ZSTREAM *)NIL;
+
+   if (OUTRECS) zStreamClose(OUTRECS);
+   OUTRECS = (struct ZSTREAM *)NIL;
+
    if (INSTR) Zclose(INSTR);
    INSTR = (FILE *)NIL;
    
@@ -32,6 +32,9 @@ char TMPFILE[_MAX_PATH];  /* Must be global to be visible to BREAKREQ */
 FILE *INSTR  = (FILE *)NIL;
 FILE *OUTSTR = (FILE *)NIL;
 
+struct ZSTREAM *INRECS  = (struct ZSTREAM *)NIL;
+struct ZSTREAM *OUTRECS = (struct ZSTREAM *)NIL;
+
 const char szTask[]="DBX"; // This name must match the file name
 
 int main(int argc, char *argv[])
@@ -73,6 +76,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -114,9 +118,13 @@ int main(int argc, char *argv[])
 
       if (Zputhead(OUTSTR,&FileHeader)) BombOff(1);
 
+      if (!(OUTRECS = zStreamOpen(OUTSTR, FileHeader.type, O_writeb))) BombOff(1);
+
       FileHeader.type = TMPTYPE; /* Restore currnt type */
 
-      while (Zread(INSTR,BUFFER,FileHeader.type))
+      if (!(INRECS = zStreamOpen(INSTR, FileHeader.type, O_readb))) BombOff(1);
+
+      while (zStreamRead(INRECS,BUFFER))
          {
          if (extractValues(BUFFER, &FileHeader, TCNT, &TIME, &VALUE, &Z, &FLAG))
             {
@@ -144,22 +152,23 @@ int main(int argc, char *argv[])
             case X_Data:              /* Complex time series maps */
                RDataPntr->y = VALUE;  /* into real time sderies   */
                RDataPntr->f = FLAG;
-               Zwrite(OUTSTR,BUFFER,R_Data);
+               if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
                break;
             case TX_Data:                     /* Complex time labeled maps */
                TRDataPntr->y = VALUE; /* into real time labeled    */
                TRDataPntr->t = TIME;
-               Zwrite(OUTSTR,BUFFER,TR_Data);
+               if (zStreamWrite(OUTRECS,BUFFER)) BombOff(1);
                break;
             }
 
-         if (ferror(OUTSTR)) BombOff(1);
-
          ++TCNT;
          } /* End WHILE */
 
       if (ferror(INSTR)) BombOff(1);
 
+      if (zStreamClose(OUTRECS)) BombOff(1);  // Flush the last block before the file is closed
+      OUTRECS = (struct ZSTREAM *)NIL;
+
       zTaskMessage(2,"%ld Data Points Processed\n",(long)TCNT);
 
       fcloseall();
@@ -199,6 +208,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
+   if (INRECS) zStreamClose(INRECS);
+   INRECS = (struct ZSTREAM *)NIL;
+
+   if (OUTRECS) zStreamClose(OUTRECS);
+   OUTRECS = (struct ZSTREAM *)NIL;
+
    if (INSTR) Zclose(INSTR);
    INSTR = (FILE *)NIL;
    
@@ -19,6 +19,12 @@
 * TRANGE -> Frequency Range
 * FACTOR -> Number of Integration Points
 *
+* The times and values are unpacked once into separate arrays. For each
+* frequency cos and sin are filled into two tables, from a rotation
+* recurrence (zRotorNext) when the samples are evenly spaced or from libm
+* otherwise, and the inner products are then straight sums and dot
+* products over the tables (zSum, zDot).
+*
 * The infile of this task accepts wild cards.
 *
 */
@@ -35,7 +41,7 @@
 // Maximum number of points that can be loaded into memory at one time.
 void FINIT(void);
 void MEMREDUCE(void);
-short DSKREDUCE(void);
+void PHASES(void);
 
 double Omega, Nu, SLOPE, II, TIME, RDATA, IDATA=0., TCNT;
 double N=0., a1H0H1ON;
@@ -44,7 +50,6 @@ double d1, d2;
 double NSQ, H0H1SQ, H0H2SQ, H1, H2, TOTAL=0., SQNO2, SQNO8;
 short  FLAG=0;
 long   NUMDAT, NDAT;
-BOOL   bMemoryFile = TRUE;
 char   INFILE[_MAX_PATH], OUTFILE[_MAX_PATH], TMPFILE[_MAX_PATH];
 
 struct FILEHDR FileHeader;
@@ -56,9 +61,18 @@ struct XData  XDataOut;
 
 double TWOPI;
 
+BOOL bEVEN;                   // TRUE if the samples are evenly spaced, at TZERO + k*TSTEP
+double TZERO, TSTEP;
+struct ZROTOR ROTOR;
+
+double *WORK = (double *)NIL;   // One allocation for the arrays below, NUMDAT values each
+double *DTIME;                  // Sample times
+double *DREAL, *DIMAG;          // Real and imaginary parts, DIMAG is NIL for real data
+double *DCOS, *DSIN;            // cos and sin tables for one frequency, then h1 and h2
+
 char *dataBuffer = (char *)NIL;
 
-FILE *INSTR=(FILE *)NIL;
+struct ZMAP *INMAP=(struct ZMAP *)NIL;   // Input file is memory mapped, dataBuffer points into it
 FILE *OUTSTR=(FILE *)NIL;
 
 const char szTask[]="DCDFT";
@@ -93,6 +107,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -108,10 +123,8 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,TMPFILE);
 
       zTaskMessage(2,"Opening Input File '%s'\n",INFILE);
-      INSTR = zOpen(INFILE,O_readb);
-      if (!INSTR) Zexit(1);
-      
-      if (!Zgethead(INSTR,&FileHeader)) BombOff(1);
+      INMAP = zMapOpen(INFILE,&FileHeader,(CODE == 2) ? O_mapcopyb : O_mapb);  // The filter changes the data in memory
+      if (!INMAP) Zexit(1);
 
       switch (FileHeader.type)
          {
@@ -162,10 +175,7 @@ int main(int argc, char *argv[])
          XDataOut.z.x = XDataOut.z.y = 0.;
          Omega = TWOPI*(II*SLOPE+TRANGE[0]);  /* Calculate next Omega */
 
-         if (bMemoryFile)
-            MEMREDUCE();      /* Data Fit into Memory */
-         else
-            if (DSKREDUCE()) BombOff(1);  /* Disk Processing */
+         MEMREDUCE();
 
          if (CODE > 1)   /* Either Filter or just display results */
             {
@@ -200,6 +210,8 @@ int main(int argc, char *argv[])
 
       printPercentComplete((long)II, (long)FACTOR, PROGRESS); // 100% Complete
 
+      if (bEVEN) zRotorReport(&ROTOR, 1);
+
       if (CODE < 2) /* File is Complex DCDFT so update header information */
          {
          FileHeader.type = X_Data;        /* Output File is Complex */
@@ -225,48 +237,43 @@ int main(int argc, char *argv[])
 */
 void FINIT()
    {
-   double FIRST, FT, DELT=0., RMEAN=0., IMEAN=0.;
+   double FIRST=0., FT, DELT=0., RMEAN=0., IMEAN=0.;
    long I;
    short FFLAG=0;
-   long numDataRecords;
 
 // Need to initialize the globals in case we have wild card file names and make multiple passes
    IDATA = 0.;
    N = 0.;
    TOTAL = 0.;
    FLAG = 0;
-   bMemoryFile = TRUE;
-   
-   numDataRecords = countDataRecords(INSTR);
    
-   do {
-      dataBuffer = (char *)malloc(numDataRecords * (long)Zsize(FileHeader.type));
+   dataBuffer = INMAP->records;                 // All the records are in the file map
+   NUMDAT = NDAT = INMAP->nRecords;
 
-      if (!dataBuffer)
-         {
-         numDataRecords /= 2L;
-         bMemoryFile = FALSE;
-         }
-      }
-   while (!dataBuffer && numDataRecords);
+   zTaskMessage(2,"Processing data file in memory.\n");
 
-   if (!numDataRecords)
+   bEVEN = isEvenlySpaced(&FileHeader, dataBuffer, NUMDAT, &TZERO, &TSTEP);
+   zRotorInit(&ROTOR);
+   if (!bEVEN) zTaskMessage(2,"Samples are not evenly spaced, using cos() and sin().\n");
+
+   if (!(WORK = (double *)malloc(5 * NUMDAT * sizeof(double))))
       {
-      zTaskMessage(10,"Unable to allocate memory for input file.\n");
+      zTaskMessage(10,"Unable to allocate %ld bytes for the work arrays.\n", 5 * NUMDAT * sizeof(double));
       BombOff(1);
       }
-   
-   if (bMemoryFile)
-      zTaskMessage(2,"Processing data file in memory.\n");
-   else
-      zTaskMessage(2,"Data file too large for available memopry. Processing from file (which might take a while).\n");
+
+   DTIME = WORK;
+   DREAL = DTIME + NUMDAT;
+   DCOS  = DREAL + NUMDAT;
+   DSIN  = DCOS  + NUMDAT;
+   DIMAG = ((FileHeader.type == X_Data) || (FileHeader.type == TX_Data)) ? DSIN + NUMDAT : (double *)NIL;
+
+   if (zUnpackRecords(&FileHeader, dataBuffer, NUMDAT, DTIME, DREAL, DIMAG, (short *)NIL)) BombOff(1);
 
    TCNT = 0.;
 
-   while ((NDAT = zGetData(numDataRecords, INSTR, dataBuffer, FileHeader.type)))
+   if (NDAT)
       {
-      NUMDAT = NDAT;                                 // Should be the same as numDataRecords, but better safe than sorry
-      
       RDataPntr =  (struct RData *)dataBuffer;       /* Setup some data pointers */
       TRDataPntr = (struct TRData *)dataBuffer;
       XDataPntr =  (struct XData *)dataBuffer;
@@ -324,21 +331,13 @@ void FINIT()
             IMEAN += IDATA;
             } /* End IF */
          } /* End For */
-      } /* End WHILE */
-
-   if (ferror(INSTR)) BombOff(1);
+      } /* End IF */
 
    if (N < 2)
       {
       zTaskMessage(10,"** ERROR ** File Contains only %lG Point(s)\n",N);
       BombOff(1);
       }
-/*
-** If the data were read in 1 pass then the entire data base can
-** be processed in memory (i.e. it is SMALL), otherwise the
-** file must be processed from disc, which takes a great deal
-** more time.
-*/
 
    RMEAN /= N;
    IMEAN /= N;
@@ -363,52 +362,23 @@ void FINIT()
 
 /***************************************************************
 **
-** Process "small" data files
+** Process the unpacked data for one frequency
 */
 void MEMREDUCE()
    {
    long I;
+   double V, Rh1, Rh2, Ih1 = 0., Ih2 = 0.;
 /*
 ** First we must determine the inner product sets
 ** H0H1, H0H2, a1 and a2
 */
-   TRDataPntr = (struct TRData *)dataBuffer;
-   TXDataPntr = (struct TXData *)dataBuffer;
+   PHASES();
 
-   TCNT = 0.;
-
-   for (I=0L; I<NUMDAT; ++I)
-      {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            ++TRDataPntr;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            ++TXDataPntr;
-            break;
-         }
-
-      TIME *= Omega;
-      H1 = cos(TIME);
-      H2 = sin(TIME);
-
-      H0H1 += H1;
-      H0H2 += H2;
-      H1H1 += (H1*H1);
-      H2H2 += (H2*H2);
-      H1H2 += (H1*H2);
-      }
+   H0H1 = zSum(DCOS, NUMDAT);
+   H0H2 = zSum(DSIN, NUMDAT);
+   H1H1 = zDot(DCOS, DCOS, NUMDAT);
+   H2H2 = zDot(DSIN, DSIN, NUMDAT);
+   H1H2 = zDot(DCOS, DSIN, NUMDAT);
 
    H0H1SQ = Square(H0H1);
    H0H2SQ = Square(H0H2);
@@ -429,93 +399,39 @@ void MEMREDUCE()
 
    a1H0H1ON = a1 * H0H1/N;
 /*
-** Now we must determine the inner product set h1H2
+** Turn the cos table into h1 and find the inner product set h1H2,
+** then turn the sin table into h2
 */
-   TRDataPntr = (struct TRData *)dataBuffer;
-   TXDataPntr = (struct TXData *)dataBuffer;
+   for (I=0L; I<NUMDAT; ++I) DCOS[I] = a1 * (DCOS[I] - H0H1/N);
 
-   TCNT = 0.;
+   h1H2 = zDot(DCOS, DSIN, NUMDAT);
 
-   for (I=0L; I<NUMDAT; ++I)
-      {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            ++TRDataPntr;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            ++TXDataPntr;
-            break;
-         }
-      TIME *= Omega;
-      h1H2 += (a1 * cos(TIME) - a1H0H1ON) * sin(TIME);
-      }
+   for (I=0L; I<NUMDAT; ++I) DSIN[I] = a2*(DSIN[I] - H0H2/N - DCOS[I]*h1H2);
 /*
 ** Now determine the output values
 */
-   RDataPntr =  (struct RData *)dataBuffer;
-   TRDataPntr = (struct TRData *)dataBuffer;
-   XDataPntr =  (struct XData *)dataBuffer;
-   TXDataPntr = (struct TXData *)dataBuffer;
-   TCNT = 0.;
-   for (I=0;I<NUMDAT;++I)
-      {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            RDATA = RDataPntr->y;
-            ++TCNT;
-            ++RDataPntr;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            RDATA = TRDataPntr->y;
-            ++TRDataPntr;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            RDATA = XDataPntr->z.x;
-            IDATA = XDataPntr->z.y;
-            ++TCNT;
-            ++XDataPntr;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            RDATA = TXDataPntr->z.x;
-            IDATA = TXDataPntr->z.y;
-            ++TXDataPntr;
-            break;
-         }
+   Rh1 = zDot(DREAL, DCOS, NUMDAT);
+   Rh2 = zDot(DREAL, DSIN, NUMDAT);
 
-      TIME *= Omega;
-      h1 = a1 * (cos(TIME) - H0H1/N);
-      h2 = a2*(sin(TIME) - H0H2/N - h1*h1H2);
+   if (DIMAG)
+      {
+      Ih1 = zDot(DIMAG, DCOS, NUMDAT);
+      Ih2 = zDot(DIMAG, DSIN, NUMDAT);
+      }
 
-      switch (CODE)
-         {
-         case 0: /* DCDFT */
-            XDataOut.z.x += ((RDATA * h1) + (IDATA * h2));
-            XDataOut.z.y += ((IDATA * h1) - (RDATA * h2));
-            break;
-         case 1: /* IDCDFT */
-            XDataOut.z.x += ((RDATA * h1) - (IDATA * h2));
-            XDataOut.z.y += ((IDATA * h1) + (RDATA * h2));
-            break;
-         default: /* Filter */
-            XDataOut.z.x += (RDATA * h1);
-            XDataOut.z.y += (RDATA * h2);
-         }
+   switch (CODE)
+      {
+      case 0: /* DCDFT */
+         XDataOut.z.x += (Rh1 + Ih2);
+         XDataOut.z.y += (Ih1 - Rh2);
+         break;
+      case 1: /* IDCDFT */
+         XDataOut.z.x += (Rh1 - Ih2);
+         XDataOut.z.y += (Ih1 + Rh2);
+         break;
+      default: /* Filter */
+         XDataOut.z.x += Rh1;
+         XDataOut.z.y += Rh2;
       }
 
    if (CODE==2)    /* Filter Data */
@@ -523,33 +439,18 @@ void MEMREDUCE()
       RDataPntr =  (struct RData *)dataBuffer;
       TRDataPntr = (struct TRData *)dataBuffer;
 
-      TCNT = 0.;
-
       for (I=0L; I<NUMDAT; ++I)
          {
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               TIME = TCNT * FileHeader.m + FileHeader.b;
-               ++TCNT;
-               break;
-            case TR_Data:
-               TIME = TRDataPntr->t;
-               break;
-            }
-
-         TIME *= Omega;
-         h1 = a1 * (cos(TIME) - H0H1/N);
-         h2 = a2*(sin(TIME) - H0H2/N - h1*h1H2);
+         V = XDataOut.z.x*DCOS[I] + XDataOut.z.y*DSIN[I];
 
          switch (FileHeader.type)
             {
             case R_Data:
-               RDataPntr->y -= (XDataOut.z.x*h1 + XDataOut.z.y*h2);
+               RDataPntr->y -= V;
                ++RDataPntr;
                break;
             case TR_Data:
-               TRDataPntr->y -= (XDataOut.z.x*h1 + XDataOut.z.y*h2);
+               TRDataPntr->y -= V;
                ++TRDataPntr;
                break;
             }
@@ -562,182 +463,29 @@ void MEMREDUCE()
 
 /***************************************************************
 **
-** Process "large" data files
+** Fill the cos and sin tables with Omega*TIME for every sample.
+** Evenly spaced data take them from the rotor.
 */
-short DSKREDUCE()
+void PHASES()
    {
-/*
-** First we must determine the inner product sets
-** H0H1, H0H2, a1 and a2
-*/
-   TCNT = 0.;
-
-   if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) return(1);
+   long I;
 
-   while (Zread(INSTR,dataBuffer,FileHeader.type))
+   if (bEVEN)
       {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            break;
-         }
-
-      TIME *= Omega;
-      H1 = cos(TIME);
-      H2 = sin(TIME);
-      H0H1 += H1;
-      H0H2 += H2;
-      H1H1 += (H1*H1);
-      H2H2 += (H2*H2);
-      H1H2 += (H1*H2);
+      zRotorStart(&ROTOR, TZERO * Omega, TSTEP * Omega);
+      zRotorFill(&ROTOR, NUMDAT, DCOS, DSIN);
       }
-
-   H0H1SQ = Square(H0H1);
-   H0H2SQ = Square(H0H2);
-
-   a1 = H1H1 - H0H1SQ/N;
-   if (a1 > 0.)
-      a1 = 1./sqrt(a1);
-   else
-      a1 = 0.;
-   a2 = H2H2 - H0H2SQ/N - Square(a1)*(Square(H1H2) +
-               H0H1SQ*H0H2SQ/(N*N) - 2*H0H1*H0H2*H1H2/N);
-   if (a2 > 0.)
-      a2 = 1./sqrt(a2);
    else
-      a2 = 0.;
-
-   a1H0H1ON = a1 * H0H1/N;
-/*
-** Now we must determine the inner product set h1H2
-*/
-   TCNT = 0.;
-
-   if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) return(1);
-
-   while (Zread(INSTR,dataBuffer,FileHeader.type))
       {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            ++TCNT;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            break;
-         }
-
-      TIME *= Omega;
-      h1H2 += (a1 * cos(TIME) - a1H0H1ON) * sin(TIME);
-      }
-/*
-** Now determine the output values
-*/
-   TCNT = 0.;
-
-   if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) return(1);
-
-   while (Zread(INSTR,dataBuffer,FileHeader.type))
-      {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            RDATA = RDataPntr->y;
-            ++TCNT;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            RDATA = TRDataPntr->y;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            RDATA = XDataPntr->z.x;
-            IDATA = XDataPntr->z.y;
-            ++TCNT;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            RDATA = TXDataPntr->z.x;
-            IDATA = TXDataPntr->z.y;
-            break;
-         }
-
-      TIME *= Omega;
-      h1 = a1 * (cos(TIME) - H0H1/N);
-      h2 = a2*(sin(TIME) - H0H2/N - h1*h1H2);
-
-      switch (CODE)
+      for (I=0L; I<NUMDAT; ++I)
          {
-         case 0: /* DCDFT */
-            XDataOut.z.x += ((RDATA * h1) + (IDATA * h2));
-            XDataOut.z.y += ((IDATA * h1) - (RDATA * h2));
-            break;
-         case 1: /* IDCDFT */
-            XDataOut.z.x += ((RDATA * h1) - (IDATA * h2));
-            XDataOut.z.y += ((IDATA * h1) + (RDATA * h2));
-            break;
-         default: /* Filter */
-            XDataOut.z.x += (RDATA * h1);
-            XDataOut.z.y += (RDATA * h2);
+         TIME = DTIME[I] * Omega;
+         DCOS[I] = cos(TIME);
+         DSIN[I] = sin(TIME);
          }
-      } /* End WHILE */
-
-   if (CODE==2)    /* Filter Data */
-      {
-      if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) return(1);
-
-      TCNT = 0.;
-
-      while (Zread(INSTR,dataBuffer,FileHeader.type))
-         {
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               TIME = TCNT * FileHeader.m + FileHeader.b;
-               ++TCNT;
-               break;
-            case TR_Data:
-               TIME = TRDataPntr->t;
-               break;
-            }
-         TIME *= Omega;
-         h1 = a1 * (cos(TIME) - H0H1/N);
-         h2 = a2*(sin(TIME) - H0H2/N - h1*h1H2);
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               RDataPntr->y -= (XDataOut.z.x*h1 + XDataOut.z.y*h2);
-               break;
-            case TR_Data:
-               TRDataPntr->y -= (XDataOut.z.x*h1 + XDataOut.z.y*h2);
-               break;
-            }
-         Zwrite(OUTSTR,(char *)dataBuffer,FileHeader.type);
-         } /* END while */
       }
 
-   return(0);
+   return;
    }
 
 /***************************************************************
@@ -767,14 +515,15 @@ void BombOff(int a)
 
 void fcloseall()
    {
-   if (INSTR) Zclose(INSTR);
-   INSTR = (FILE *)NIL;
+   if (INMAP) zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
+   dataBuffer = (char *)NIL;
+
+   if (WORK) free(WORK);
+   WORK = (double *)NIL;
 
    if (OUTSTR) Zclose(OUTSTR);
    OUTSTR = (FILE *)NIL;
-
-   if (dataBuffer) free(dataBuffer);
-   dataBuffer = (char *)NIL;
    return;
    }
 
@@ -16,6 +16,14 @@
 *
 * The Inverse transform i -> -i and 2/N is changed to 1/2
 *
+* The output frequencies are independent, so blocks of them are shared
+* out over THREADS threads (see TISAN.CFG) and then written in order.
+* Each frequency is summed exactly as in a single thread, so the output
+* does not depend on the number of threads.
+*
+* The phase steps evenly through the samples, so cos and sin come from a
+* rotation recurrence (zRotorNext) checked against libm as it goes.
+*
 * Default outclass = dft
 *
 * The infile of this task accepts wild cards.
@@ -34,9 +42,16 @@
 double twoPi;
 double    Pi;
 
+#define DFTBLOCK 256L   // Frequencies per thread in each block written to the output file
+
+struct DFTWORK {double Nu0;             // first frequency of the block
+                long nFreq;             // frequencies in the block
+                struct XData *pOut;     // results, in frequency order
+                struct ZROTOR *pRotor;};// one phase recurrence per thread
+
 void InitializeDFT(void);
-void MEMREDUCE(double Nu);
-short DSKREDUCE(double Nu);
+struct complex MEMREDUCE(double Nu, struct ZROTOR *pRotor);
+void DFTTHREAD(int iThread, int nThreads, void *pData);
 
 char *dataBuffer = (char *)NIL;
 char INFILE[_MAX_PATH], OUTFILE[_MAX_PATH];
@@ -48,11 +63,11 @@ short  FLAG=0;
 long NUMDAT, NDAT;
 struct RData  *RDataPntr;
 struct XData  *XDataPntr;
-struct XData  XDataOut;
+struct XData  *XDataOut = (struct XData *)NIL;   // One block of output values
+struct ZROTOR *ROTORS = (struct ZROTOR *)NIL;     // Phase recurrence for each thread
 double Nyquist, Fundamental, HalfN;
-BOOL   bMemoryFile = TRUE;
 
-FILE *INSTR  = (FILE *)NIL;
+struct ZMAP *INMAP = (struct ZMAP *)NIL;   // Input file is memory mapped, dataBuffer points into it
 FILE *OUTSTR = (FILE *)NIL;
 
 const char szTask[]="DFT";
@@ -60,6 +75,8 @@ const char szTask[]="DFT";
 int main(int argc, char *argv[])
    {
    double Nu;
+   struct DFTWORK work;
+   int nThreads, iThread;
 // declarations need to manage wild cards
    struct CATSTRUCT *CatList;
    char Drive[_MAX_DRIVE], Dir[_MAX_DIR], Fname[_MAX_FNAME], Ext[_MAX_EXT];
@@ -86,9 +103,21 @@ int main(int argc, char *argv[])
 
    if (!OUTCLASS[0]) strcpy(OUTCLASS,"dft");
 
+   nThreads = zThreadCount();
+   zTaskMessage(2,"Using %d thread(s).\n", nThreads);
+
+   XDataOut = (struct XData *)calloc(DFTBLOCK * nThreads, sizeof(struct XData));
+   ROTORS = (struct ZROTOR *)calloc(nThreads, sizeof(struct ZROTOR));
+   if (!XDataOut || !ROTORS)
+      {
+      zTaskMessage(10,"Unable to allocate memory for the output block.\n");
+      Zexit(1);
+      }
+
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -103,10 +132,8 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,TMPFILE);
 
       zTaskMessage(2,"Opening Input File '%s'\n",INFILE);
-      INSTR = zOpen(INFILE,O_readb);
-      if (INSTR == NULL) Zexit(1);
-
-      if (!Zgethead(INSTR,&FileHeader)) BombOff(1);
+      INMAP = zMapOpen(INFILE,&FileHeader,O_mapb);
+      if (INMAP == NULL) Zexit(1);
 
       InitializeDFT();
 
@@ -116,28 +143,28 @@ int main(int argc, char *argv[])
 
       if (Zputhead(OUTSTR,&FileHeader)) BombOff(1);
 
-      XDataOut.f = 0;
-
       printPercentComplete(0L, 0L, PROGRESS);
 
-      for (Nu=0.; Nu < N; ++Nu)
+      work.pOut = XDataOut;
+      work.pRotor = ROTORS;
+      for (iThread = 0; iThread < nThreads; ++iThread) zRotorInit(&ROTORS[iThread]);
+
+      for (Nu=0.; Nu < N; Nu += (double)work.nFreq)
          {
-         XDataOut.z.x = XDataOut.z.y = 0.;
+         work.Nu0 = Nu;
+         work.nFreq = Min(DFTBLOCK * nThreads, (long)(N - Nu));
 
-         if (bMemoryFile)
-            MEMREDUCE(Nu);      /* Data Fit into Memory */
-         else
-            {
-            if (DSKREDUCE(Nu)) BombOff(1);
-            }
-               
-         if (Zwrite(OUTSTR,(char *)&XDataOut,X_Data)) BombOff(1);
+         zRunThreads(nThreads, DFTTHREAD, &work);
+
+         if (zPutData(work.nFreq, OUTSTR, (char *)XDataOut, X_Data) != work.nFreq) BombOff(1);
 
          printPercentComplete((long)Nu, (long)N, PROGRESS);
          } /* End FOR */
 
       printPercentComplete((long)Nu, (long)N, PROGRESS); // 100% Complete
 
+      zRotorReport(ROTORS, nThreads);
+
       FileHeader.type = X_Data;
       FileHeader.b = 0.;
       FileHeader.m = (2. * Nyquist - Fundamental) / (N - 1.);
@@ -151,182 +178,125 @@ int main(int argc, char *argv[])
 
    ZCatFiles((char*)NIL); // free catalog memory
 
+   free(XDataOut);
+   free(ROTORS);
+
    Zexit(ERRFLAG);
    }
 
 /***************************************************************
 **
-** Process "small" data files
+** Thread work function: every nThreads'th frequency of the block
 */
-void MEMREDUCE(double Nu)
+void DFTTHREAD(int iThread, int nThreads, void *pData)
    {
+   struct DFTWORK *pWork = (struct DFTWORK *)pData;
    long I;
-   double Tau;
-   double h1, h2;
-/*
-** Determine the output values
-*/
-   RDataPntr =  (struct RData *)dataBuffer;
-   XDataPntr =  (struct XData *)dataBuffer;
-   for (I=0; I<NUMDAT; ++I)
-      {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            RVAL = RDataPntr->y;
-            FLAG = RDataPntr->f;
-            ++RDataPntr;
-            break;
-         case X_Data:
-            RVAL = XDataPntr->z.x;
-            IVAL = XDataPntr->z.y;
-            FLAG = XDataPntr->f;
-            ++XDataPntr;
-            break;
-         }
-
-      if (!FLAG)
-         {
-         Tau = twoPi * (double)I * Nu / N;
-         h1 = cos(Tau);
-         h2 = sin(Tau);
-
-         if (!CODE)
-            {
-            XDataOut.z.x += (RVAL * h1 + IVAL * h2);
-            XDataOut.z.y += (IVAL * h1 - RVAL * h2);
-            }
-         else
-            {
-            XDataOut.z.x += (RVAL * h1 - IVAL * h2);
-            XDataOut.z.y += (IVAL * h1 + RVAL * h2);
-            }
-         }
-      }
 
-   if (!CODE)
-      {
-      XDataOut.z.y /= HalfN;
-      XDataOut.z.x /= HalfN;
-      }
-   else
+   for (I = iThread; I < pWork->nFreq; I += nThreads)
       {
-      XDataOut.z.y /= 2.;
-      XDataOut.z.x /= 2.;
+      pWork->pOut[I].z = MEMREDUCE(pWork->Nu0 + (double)I, &pWork->pRotor[iThread]);
+      pWork->pOut[I].f = 0;
       }
-
+
    return;
    }
 
 /***************************************************************
 **
-** Process "large" data files
+** Process the data in the file map for one frequency.
+** Only locals and this thread's rotor are changed, so this can run on
+** several threads at once.
 */
-short DSKREDUCE(double Nu)
+struct complex MEMREDUCE(double Nu, struct ZROTOR *pRotor)
    {
-   double Tau, II=0.;
+   long I;
    double h1, h2;
+   double rval, ival = 0.;
+   short flag = 0;
+   struct RData *pRData;
+   struct XData *pXData;
+   struct complex Zsum;
 /*
 ** Determine the output values
 */
-   if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) return(1);
-   while (Zread(INSTR,dataBuffer,FileHeader.type))
+   Zsum.x = Zsum.y = 0.;
+   pRData = (struct RData *)dataBuffer;
+   pXData = (struct XData *)dataBuffer;
+   zRotorStart(pRotor, 0., twoPi * Nu / N);   // Phase is 2 pi I Nu / N
+   for (I=0; I<NUMDAT; ++I, zRotorNext(pRotor))
       {
-      ++II;
       switch (FileHeader.type)
          {
          case R_Data:
-            RVAL = RDataPntr->y;
-            FLAG = RDataPntr->f;
+            rval = pRData->y;
+            flag = pRData->f;
+            ++pRData;
             break;
          case X_Data:
-            RVAL = XDataPntr->z.x;
-            IVAL = XDataPntr->z.y;
-            FLAG = XDataPntr->f;
+         default:
+            rval = pXData->z.x;
+            ival = pXData->z.y;
+            flag = pXData->f;
+            ++pXData;
             break;
          }
 
-      if (!FLAG)
+      if (!flag)
          {
-         Tau = twoPi * II * Nu / N;
-         h1 = cos(Tau);
-         h2 = sin(Tau);
+         h1 = pRotor->c;
+         h2 = pRotor->s;
 
          if (!CODE)
             {
-            XDataOut.z.x += (RVAL * h1 + IVAL * h2);
-            XDataOut.z.y += (IVAL * h1 - RVAL * h2);
+            Zsum.x += (rval * h1 + ival * h2);
+            Zsum.y += (ival * h1 - rval * h2);
             }
          else
             {
-            XDataOut.z.x += (RVAL * h1 - IVAL * h2);
-            XDataOut.z.y += (IVAL * h1 + RVAL * h2);
+            Zsum.x += (rval * h1 - ival * h2);
+            Zsum.y += (ival * h1 + rval * h2);
             }
          }
       }
 
-   if (ferror(INSTR)) return(1);
-
    if (!CODE)
       {
-      XDataOut.z.y /= HalfN;
-      XDataOut.z.x /= HalfN;
+      Zsum.y /= HalfN;
+      Zsum.x /= HalfN;
       }
    else
       {
-      XDataOut.z.y /= 2.;
-      XDataOut.z.x /= 2.;
+      Zsum.y /= 2.;
+      Zsum.x /= 2.;
       }
-
-   return(0);
+
+   return(Zsum);
    }
 
 /************************************************************
 **
 ** Initialize file stuff
-** When Done, We know if the entire file can be processed
-** in memory and how many data points there are (N).
+** When Done, We know how many data points there are (N).
 */
 void InitializeDFT()
    {
    long I;
    double GoodN = 0.;
-   long numDataRecords;
 
 // Need to initialize these globals in case we are using wild cards in the filename and thus make multiple passes
    IVAL = 0.;
    N = 0.;
    Imean = 0.;
    Rmean = 0.;
-   bMemoryFile = TRUE;
    
-   numDataRecords = countDataRecords(INSTR);
-   
-   do {
-      dataBuffer = (char *)malloc(numDataRecords * (long)Zsize(FileHeader.type));
-
-      if (!dataBuffer)
-         {
-         numDataRecords /= 2L;
-         bMemoryFile = FALSE;
-         }
-      }
-   while (!dataBuffer && numDataRecords);
+   dataBuffer = INMAP->records;                 // All the records are in the file map
+   NUMDAT = NDAT = INMAP->nRecords;
 
-   if (!numDataRecords)
-      {
-      zTaskMessage(10,"Unable to allocate memory for input file.\n");
-      BombOff(1);
-      }
-   
-   if (bMemoryFile)
-      zTaskMessage(2,"Processing data file in memory.\n");
-   else
-      zTaskMessage(2,"Data file too large for available memory. Processing from file (which might take a while).\n");
+   zTaskMessage(2,"Processing data file in memory.\n");
 
-   while ((NDAT = zGetData(numDataRecords, INSTR, dataBuffer, FileHeader.type)))
+   if (NDAT)
       {
-      NUMDAT = NDAT;
       N += (double)NDAT;
       RDataPntr =  (struct RData *)dataBuffer;
       XDataPntr =  (struct XData *)dataBuffer;
@@ -363,9 +333,7 @@ void InitializeDFT()
             ++GoodN;
             } /* End IF */
          } /* End For */
-      } /* End WHILE */
-
-   if (ferror(INSTR)) BombOff(1);
+      } /* End IF */
 
    if (N < 2.)
       {
@@ -411,20 +379,20 @@ void BombOff(int a)
    fcloseall();
    unlink(TMPFILE);
    ZCatFiles((char*)NIL); // free catalog memory
+   if (XDataOut) free(XDataOut);
+   if (ROTORS) free(ROTORS);
    Zexit(a);
    }
 
 void fcloseall()
    {
-   if (INSTR) Zclose(INSTR);
-   INSTR = (FILE *)NIL;
+   if (INMAP) zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
+   dataBuffer = (char *)NIL;
 
    if (OUTSTR) Zclose(OUTSTR);
    OUTSTR = (FILE *)NIL;
 
-   if (dataBuffer) free(dataBuffer);
-   dataBuffer = (char *)NIL;
-
    return;
    }
 
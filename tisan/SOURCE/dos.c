@@ -41,7 +41,7 @@ char firstChar(PSTR string)
 */
 char lastChar(PSTR string)
    {
-   return(*(string + (strlen(string) - 1)));
+   return(*string ? *(string + (strlen(string) - 1)) : NUL);   // An empty string has no last character
    }
 
 
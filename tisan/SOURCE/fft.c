@@ -13,6 +13,20 @@
 *
 * CODE 0 -> FFT
 * CODE 1 -> IFFT
+* CODE 2 -> FFT, zero padded to a power of 2
+* CODE 3 -> IFFT, zero padded to a power of 2
+*
+* Without padding any number of points is transformed (see zFFT) and the
+* frequency grid is the file's own.
+*
+* Real data files with an even number of points use the real input
+* transform (zRealFFT), which needs half the memory and arithmetic. The
+* inverse of a conjugate symmetric complex file, such as the FFT of real
+* data, is done with zRealIFFT. The output is always complex.
+*
+* When the transform would need more than MEMORY in TISAN.CFG, or the
+* memory cannot be allocated, it is done through a scratch file instead
+* (see OutOfCoreFFT).
 *
 * Default outclass = fft
 *
@@ -30,12 +44,20 @@
 #include "tisan.h"
 
 void InitializeFFT(void);
-void FOUR1(int);
+BOOL isHermitian(long numDataRecords);
+BOOL getValue(long I, double *pRVAL, double *pIVAL);
+void OutOfCoreFFT(void);
+double FFTScratch(long);
 
-char BUFFER[sizeof(struct TRData)];
 char INFILE[_MAX_PATH], OUTFILE[_MAX_PATH];
 char TMPFILE[_MAX_PATH];
 long N=0L;
+BOOL bINVERSE = FALSE;  // CODE 1 and 3
+BOOL bPAD = FALSE;      // CODE 2 and 3
+BOOL bREAL = FALSE;     // Real input, dataBuffer holds N values and then X(0) to X(N/2)
+BOOL bHERMITIAN = FALSE;// Conjugate symmetric input, dataBuffer holds X(0) to X(N/2) and then N real values
+BOOL bOUTOFCORE = FALSE;// Too big for memory, see OutOfCoreFFT
+double SCALE = 1.;      // Output normalisation, N/2 for the FFT and 2 for the inverse
 double Imean=0., Rmean=0.;
 struct FILEHDR FileHeader;
 long  NUMDAT, NDAT;
@@ -44,18 +66,23 @@ struct XData  *XDataPntr;
 struct XData  XDataOut;
 double Nyquist, Fundamental;
 
-double *dataBuffer = (double *)NIL;  // Holds X iY in adjacent cells
+double *dataBuffer = (double *)NIL;  // Holds X iY in adjacent cells, one indexed
 
-FILE *INSTR  = (FILE *)NIL;
+struct ZMAP *INMAP = (struct ZMAP *)NIL;   // Input file is memory mapped
 FILE *OUTSTR = (FILE *)NIL;
-
-double twoPI;
+
+char SCRFILE[_MAX_PATH];                   // Out of core transform, intermediate results as an X_Data file
+FILE *SCRSTR = (FILE *)NIL;
+struct ZSTREAM *SCRRECORDS = (struct ZSTREAM *)NIL;
+struct ZMAP *SCRMAP = (struct ZMAP *)NIL;
 
 const char szTask[]="FFT";
 
 int main(int argc, char *argv[])
    {
-   unsigned int wI;
+   long J, K;
+   double *pData;
+   BOOL bFail;
 // declarations need to manage wild cards
    struct CATSTRUCT *CatList;
    char Drive[_MAX_DRIVE], Dir[_MAX_DIR], Fname[_MAX_FNAME], Ext[_MAX_EXT];
@@ -68,19 +95,21 @@ int main(int argc, char *argv[])
 
    if (zTaskInit(argv[0])) Zexit(1); /* Initialize Task */
 
-   if ((CODE < 0) || (CODE > 1))
+   if ((CODE < 0) || (CODE > 3))
       {
       zTaskMessage(10,"Invalid CODE Specification\n");
       Zexit(1);
       }
 
+   bINVERSE = (CODE & 1) ? TRUE : FALSE;
+   bPAD = (CODE > 1) ? TRUE : FALSE;
+
    if (!OUTCLASS[0]) strcpy(OUTCLASS,"fft");
 
-   twoPI = 2.0 * acos(-1.0);
-
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -95,38 +124,60 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,TMPFILE);
 
       zTaskMessage(2,"Opening Input File '%s'\n",INFILE);
-      INSTR = zOpen(INFILE,O_readb);
-      if (!INSTR) Zexit(1);;
-      
-      if (!Zgethead(INSTR,&FileHeader)) BombOff(1);
+      INMAP = zMapOpen(INFILE,&FileHeader,O_mapb);
+      if (!INMAP) Zexit(1);
 
       InitializeFFT();
 
-      FOUR1(CODE ? -1 : 1);
-
       zTaskMessage(2,"Opening Scratch File '%s'\n",TMPFILE);
       if ((OUTSTR = zOpen(TMPFILE,O_writeb)) == NULL) BombOff(1);
 
       if (Zputhead(OUTSTR,&FileHeader)) BombOff(1);
 
-      XDataOut.f = 0;
-      for (wI = 1; wI <= (unsigned int)(2L * N); wI += 2) // write out the result starting at index 1.
+      if (bOUTOFCORE)
+         OutOfCoreFFT();
+      else
          {
-         XDataOut.z.x = dataBuffer[wI];
-         XDataOut.z.y = dataBuffer[wI+1];
+         pData = dataBuffer + 1;   // dataBuffer is one indexed
 
-         if (!CODE)
-            {
-            XDataOut.z.y /= (double)(N / 2L);
-            XDataOut.z.x /= (double)(N / 2L);
-            }
+         if (bREAL)
+            bFail = zRealFFT(pData, N, bINVERSE ? -1 : 1);
+         else if (bHERMITIAN)
+            bFail = zRealIFFT(pData, N, -1);
          else
+            bFail = zFFT(pData, N, bINVERSE ? -1 : 1);
+
+         if (bFail)
             {
-            XDataOut.z.y /= 2.;
-            XDataOut.z.x /= 2.;
+            zTaskMessage(10,"Unable to allocate memory for the transform of %ld points.\n", N);
+            BombOff(1);
             }
 
-         if (Zwrite(OUTSTR,(char *)&XDataOut,X_Data)) BombOff(1);
+         XDataOut.f = 0;
+         for (J = 0L; J < N; ++J)
+            {
+            if (bHERMITIAN)          // Real result
+               {
+               XDataOut.z.x = pData[J];
+               XDataOut.z.y = 0.;
+               }
+            else if (bREAL)          // Upper half of the spectrum is the conjugate of the lower half
+               {
+               K = (J <= N / 2L) ? J : N - J;
+               XDataOut.z.x = pData[2L*K];
+               XDataOut.z.y = (J <= N / 2L) ? pData[2L*K+1] : -pData[2L*K+1];
+               }
+            else
+               {
+               XDataOut.z.x = pData[2L*J];
+               XDataOut.z.y = pData[2L*J+1];
+               }
+
+            XDataOut.z.y /= SCALE;
+            XDataOut.z.x /= SCALE;
+
+            if (Zwrite(OUTSTR,(char *)&XDataOut,X_Data)) BombOff(1);
+            }
          }
 
       FileHeader.type = X_Data;
@@ -154,16 +205,25 @@ int main(int argc, char *argv[])
 void InitializeFFT()
    {
    double RVAL, IVAL=0.;
-   long L, lFLAGGED=0L;
+   long L, I, lFLAGGED=0L;
    int FLAG;
-   long numDataRecords;
+   long numDataRecords, M;
+   double need;
+   char *record;
 
 // Need to initialize these globals in case we have wild cards in the file name and thus make multiple passes
    N = 0L;
    Imean = 0.;
    Rmean = 0.;
+   bOUTOFCORE = FALSE;
    
-   numDataRecords = countDataRecords(INSTR);
+   numDataRecords = INMAP->nRecords;
+
+   if ((FileHeader.type == TR_Data) || (FileHeader.type == TX_Data))
+      {
+      zTaskMessage(10,"Cannot perform an FFT on time labeled data files.\n");
+      BombOff(1);
+      }
 
    if (numDataRecords < 2L)
       {
@@ -173,35 +233,79 @@ void InitializeFFT()
 
    zTaskMessage(3,"File Contains %ld Total Points\n",numDataRecords);
 
-   L = 1L;
-   while (L < numDataRecords) L *= 2L; // FFT must have a power of 2 number of records
-
-   if (L != numDataRecords)
+   if (bPAD)
       {
-      numDataRecords = L;
-      zTaskMessage(9,"** WARNING ** Padding to %ld\n",L);
+      L = 1L;
+      while (L < numDataRecords) L *= 2L; // Pad to a power of 2 number of records
+
+      if (L != numDataRecords)
+         {
+         numDataRecords = L;
+         zTaskMessage(9,"** WARNING ** Padding to %ld\n",L);
+         }
       }
+   else if (!isSmoothLength(numDataRecords))
+      zTaskMessage(3,"%ld has prime factors above 7, using Bluestein's transform\n",numDataRecords);
 
+   bREAL = (FileHeader.type == R_Data) && !(numDataRecords % 2L);
+   bHERMITIAN = (FileHeader.type == X_Data) && bINVERSE && !(numDataRecords % 2L) && isHermitian(numDataRecords);
+
+/*
+** Rough memory use in bytes, the data plus the scratch zFFT needs. Bluestein's transform works on
+** two arrays of M >= 2N-1 points.
+*/
+   need = 48. * (double)numDataRecords;
+   if (!isSmoothLength(bREAL || bHERMITIAN ? numDataRecords / 2L : numDataRecords))
+      {
+      for (M = 1L; M < 2L * numDataRecords - 1L; M *= 2L);
+      need = 16. * (double)numDataRecords + 64. * (double)M;
+      }
+   if (bREAL || bHERMITIAN) need /= 2.;
+
+   if (need > (double)zMemoryBudget()) bOUTOFCORE = TRUE;
+
 /*
 ** This FFT was originally written in FORTRAN and ported to C. FORTRAN arrays are 1 indexed, and the
-** indexing was left alone to avoid introducing bugs. As a result we need space for one more complex value.
-** The 2L is needed since we are storing complex numbers (real and imaginary parts for each record).
+** indexing was left alone to avoid introducing bugs. As a result we need space for one more value.
+** Complex data takes 2 doubles per record, real data 1 per record plus 2 for the X(N/2) term.
 */
-   dataBuffer = (double *)calloc((numDataRecords + 1L) * 2L, sizeof(double));
+   if (!bOUTOFCORE)
+      {
+      if (bREAL || bHERMITIAN)
+         dataBuffer = (double *)calloc(numDataRecords + 3L, sizeof(double));
+      else
+         dataBuffer = (double *)calloc((numDataRecords + 1L) * 2L, sizeof(double));
+
+      if (!dataBuffer)
+         {
+         zTaskMessage(9,"** WARNING ** Unable to allocate memory for %ld complex records.\n", numDataRecords);
+         bOUTOFCORE = TRUE;
+         }
+      }
+
+   N = numDataRecords;  // N is used throughout the code because it is easier to read.
+   SCALE = bINVERSE ? 2. : (double)N / 2.;
+
+   Nyquist     = 1./(2. * FileHeader.m);
+   Fundamental = 1./((double)(N - 1L) * FileHeader.m);
 
-   if (!dataBuffer)
+   if (bOUTOFCORE)
       {
-      zTaskMessage(10,"Unable to allocate memory for %ld complex records.\n", numDataRecords);
-      BombOff(1);
+      bREAL = bHERMITIAN = FALSE;
+      zTaskMessage(3,"Fundamental Frequency = %lG\n",Fundamental );
+      zTaskMessage(3,"Nyquist Frequency = %lG\n",Nyquist);
+      return;   // The data are read from INMAP as the transform goes
       }
 
-   RDataPntr =  (struct RData *)BUFFER;
-   XDataPntr =  (struct XData *)BUFFER;
-
+   if (bREAL) zTaskMessage(3,"Using the real input transform\n");
+   if (bHERMITIAN) zTaskMessage(3,"Conjugate symmetric input, using the real output transform\n");
+
    L = 1L;
-   while (Zread(INSTR,BUFFER,FileHeader.type))
+   for (I = 0L, record = INMAP->records; I < INMAP->nRecords; ++I, record += INMAP->size) // Records straight from the file map
       {
-      ++N;
+      RDataPntr =  (struct RData *)record;
+      XDataPntr =  (struct XData *)record;
+
       switch (FileHeader.type)
          {
          case R_Data:
@@ -211,7 +315,7 @@ void InitializeFFT()
          case X_Data:
             RVAL = XDataPntr->z.x;
             IVAL = XDataPntr->z.y;
-            FLAG = RDataPntr->f;
+            FLAG = XDataPntr->f;
             break;
          case TR_Data:
          case TX_Data:
@@ -229,103 +333,278 @@ void InitializeFFT()
          ++lFLAGGED;
          }
 
-      dataBuffer[L]   = RVAL; // Set the real and imaginary values
-      dataBuffer[L+1] = IVAL;
-      L += 2L;                // Advances the the next complex value
+      if (bREAL)
+         dataBuffer[L++] = RVAL;
+      else if (!bHERMITIAN || (I <= numDataRecords / 2L))   // Only X(0) to X(N/2) are needed
+         {
+         dataBuffer[L]   = RVAL; // Set the real and imaginary values
+         dataBuffer[L+1] = IVAL;
+         L += 2L;                // Advances the the next complex value
+         }
 
       Imean += IVAL;
       Rmean += RVAL;
-      } /* End WHILE */
-
-   if (ferror(INSTR)) BombOff(1);
+      } /* End FOR */
 
    zTaskMessage(3,"File Contains %ld Flagged Points\n",lFLAGGED);
 
-   N = numDataRecords;  // N is used throughout the code because it is easier to read.
-   
    Rmean /= (double)N;
    Imean /= (double)N;
 
-   Nyquist     = 1./(2. * FileHeader.m);
-   Fundamental = 1./((double)(N - 1L) * FileHeader.m);
-
    zTaskMessage(3,"Mean Value =  %lG + i(%lG)\n",Rmean,Imean);
    zTaskMessage(3,"Fundamental Frequency = %lG\n",Fundamental );
    zTaskMessage(3,"Nyquist Frequency = %lG\n",Nyquist);
 
-   Zclose(INSTR);
-   INSTR = (FILE *)NIL;
+   zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
 
    return;
    }
 
-void FOUR1(int ISIGN)
+/************************************************************
+**
+** TRUE if the (padded) input of numDataRecords complex values is
+** conjugate symmetric, X(N-j) = conj(X(j)), so its transform is real.
+** Flagged points count as 0, as in InitializeFFT.
+*/
+BOOL isHermitian(long numDataRecords)
    {
-   double WR,WI,WPR,WPI,WTEMP,THETA, TEMPR, TEMPI;
-   long wN, J, I, M, MMAX, ISTEP;
-
-   wN = 2L * N; // N is a global and is the same as numDataRecords and is used strictly for readability
-   J = 1L;
-   for (I=1L; I <= wN; I += 2L)
+   double ar, ai, br, bi;
+   long J;
+
+   for (J = 0L; J <= numDataRecords / 2L; ++J)
       {
-      if (J > I)
-         {
-         TEMPR = dataBuffer[J];
-         TEMPI = dataBuffer[J+1];
-         dataBuffer[J]   = dataBuffer[I];
-         dataBuffer[J+1] = dataBuffer[I+1];
-         dataBuffer[I]   = TEMPR;
-         dataBuffer[I+1] = TEMPI;
-         }
-      M=wN/2;
-      while ((M >= 2L ) && (J > M))
+      getValue(J, &ar, &ai);
+      getValue((numDataRecords - J) % numDataRecords, &br, &bi);
+
+      if ((ar != br) || (ai != -bi)) return(FALSE);
+      }
+
+   return(TRUE);
+   }
+
+/************************************************************
+**
+** Value of record I of the input with flagged points and the padding
+** past the end of the file set to 0. Returns TRUE for a flagged point.
+*/
+BOOL getValue(long I, double *pRVAL, double *pIVAL)
+   {
+   struct RData *pR;
+   struct XData *pX;
+
+   *pRVAL = *pIVAL = 0.;
+
+   if (I >= INMAP->nRecords) return(FALSE);
+
+   if (FileHeader.type == R_Data)
+      {
+      pR = (struct RData *)(INMAP->records + I * INMAP->size);
+      if (pR->f) return(TRUE);
+      *pRVAL = pR->y;
+      }
+   else
+      {
+      pX = (struct XData *)(INMAP->records + I * INMAP->size);
+      if (pX->f) return(TRUE);
+      *pRVAL = pX->z.x;
+      *pIVAL = pX->z.y;
+      }
+
+   return(FALSE);
+   }
+
+/************************************************************
+**
+** Out of core transform, for files too big for memory.
+** With N = N1 * N2, n = N2*n1 + n2 and k = k1 + N1*k2 the transform is
+** N2 transforms of length N1 down the columns of the input, a twiddle of
+** exp(i 2 pi n2 k1 / N), and then N1 transforms of length N2 (the four
+** step method).
+**
+** The first transforms are written a row at a time to the scratch file
+** SCRFILE, which is then memory mapped and read back a block of columns at
+** a time for the second. Their results go straight to their place in the
+** output file. Only one block of columns is in memory, sized from MEMORY
+** in TISAN.CFG less the scratch zFFT takes for the pieces.
+**
+** N1 and N2 are picked to have only factors of 2, 3, 5 and 7 when N allows
+** it, since any other length goes through Bluestein's transform, which
+** needs several times more scratch.
+*/
+void OutOfCoreFFT()
+   {
+   double twoPI = 2.0 * acos(-1.0);
+   double *block, *pData, budget;
+   long N1, N2, nCols1, nCols2, nCols, n1, n2, k1, k2, c, lFLAGGED=0L;
+   int iSign = bINVERSE ? -1 : 1;
+   struct FILEHDR scratchHeader;
+   struct XData scratchRecord, *pRecord;
+   struct ZROTOR rotor;
+
+   for (N1 = (long)sqrt((double)N); N1 > 1L; --N1)   // Largest factor of N up to sqrt(N) with both pieces fast lengths
+      if (!(N % N1) && isSmoothLength(N1) && isSmoothLength(N / N1)) break;
+
+   if (N1 == 1L)
+      for (N1 = (long)sqrt((double)N); N % N1; --N1);   // None, so just the largest factor
+   N2 = N / N1;
+
+   budget = (double)zMemoryBudget() - Max(FFTScratch(N1), FFTScratch(N2));
+
+   if (16. * (double)N2 > budget)
+      {
+      zTaskMessage(10,"%ld points do not split into pieces that fit in MEMORY, use CODE %d to pad to a power of 2.\n", N, bINVERSE ? 3 : 2);
+      BombOff(1);
+      }
+
+   nCols1 = (long)(budget / (16. * (double)N1));     // Columns held at once in each pass
+   nCols2 = (long)(budget / (16. * (double)N2));
+   if (nCols1 > N2) nCols1 = N2;
+   if (nCols2 > N1) nCols2 = N1;
+
+   block = (double *)malloc(2L * ((nCols1 * N1 > nCols2 * N2) ? nCols1 * N1 : nCols2 * N2) * sizeof(double));
+   if (!block)
+      {
+      zTaskMessage(10,"Unable to allocate memory for the out of core transform.\n");
+      BombOff(1);
+      }
+
+   zTaskMessage(3,"Out of core transform of %ld x %ld points\n", N1, N2);
+
+   zBuildFileName(M_tmpname,SCRFILE);   // A new name, since TMPFILE already exists
+   zTaskMessage(2,"Opening Scratch File '%s'\n",SCRFILE);
+   if ((SCRSTR = zOpen(SCRFILE,O_writeb)) == NULL) BombOff(1);
+
+   scratchHeader = FileHeader;
+   scratchHeader.type = X_Data;
+   if (Zputhead(SCRSTR,&scratchHeader)) BombOff(1);
+   if (!(SCRRECORDS = zStreamOpen(SCRSTR, X_Data, O_writeb))) BombOff(1);
+
+   zRotorInit(&rotor);
+   scratchRecord.f = 0;
+
+/*
+** First pass, input columns to scratch rows
+*/
+   for (n2 = 0L; n2 < N2; n2 += nCols)
+      {
+      nCols = (nCols1 < N2 - n2) ? nCols1 : N2 - n2;
+
+      for (n1 = 0L; n1 < N1; ++n1)    // Each input row gives nCols adjacent records
+         for (c = 0L; c < nCols; ++c)
+            {
+            pData = block + 2L * (c * N1 + n1);
+            if (getValue(N2 * n1 + n2 + c, pData, pData + 1)) ++lFLAGGED;
+            Rmean += pData[0];
+            Imean += pData[1];
+            }
+
+      for (c = 0L; c < nCols; ++c)
          {
-         J = J - M;
-         M /= 2L;
+         pData = block + 2L * c * N1;
+         if (zFFT(pData, N1, iSign))
+            {
+            zTaskMessage(10,"Unable to allocate memory for the transform of %ld points.\n", N1);
+            BombOff(1);
+            }
+
+         zRotorStart(&rotor, 0., (double)iSign * twoPI * (double)(n2 + c) / (double)N);
+         for (k1 = 0L; k1 < N1; ++k1, zRotorNext(&rotor))
+            {
+            scratchRecord.z.x = pData[2L*k1]   * rotor.c - pData[2L*k1+1] * rotor.s;
+            scratchRecord.z.y = pData[2L*k1+1] * rotor.c + pData[2L*k1]   * rotor.s;
+            if (zStreamWrite(SCRRECORDS,(char *)&scratchRecord)) BombOff(1);
+            }
          }
-      J += M;
       }
-
-   MMAX = 2L;
 
-   while (wN > MMAX)
+   if (zStreamClose(SCRRECORDS)) BombOff(1);
+   SCRRECORDS = (struct ZSTREAM *)NIL;
+   Zclose(SCRSTR);
+   SCRSTR = (FILE *)NIL;
+
+   zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
+
+   zTaskMessage(3,"File Contains %ld Flagged Points\n",lFLAGGED);
+   zTaskMessage(3,"Mean Value =  %lG + i(%lG)\n",Rmean / (double)N,Imean / (double)N);
+
+   if (!(SCRMAP = zMapOpen(SCRFILE,&scratchHeader,O_mapb))) BombOff(1);
+
+/*
+** Second pass, scratch columns to the output
+*/
+   XDataOut.f = 0;
+   for (k1 = 0L; k1 < N1; k1 += nCols)
       {
-      ISTEP = 2L * MMAX;
-      THETA = twoPI / ((double)ISIGN * (double)MMAX);
-      WPR = sin(THETA / 2.0);
-      WPR *= (-2.0 * WPR);
-      WPI = sin(THETA);
-      WR = 1.0;
-      WI = 0.0;
-
-      for (M=1; M <= MMAX; M += 2L)
+      nCols = (nCols2 < N1 - k1) ? nCols2 : N1 - k1;
+
+      for (n2 = 0L; n2 < N2; ++n2)
          {
-         for (I=M; I<=wN; I+=ISTEP)
+         pRecord = (struct XData *)(SCRMAP->records + (n2 * N1 + k1) * SCRMAP->size);
+         for (c = 0L; c < nCols; ++c, ++pRecord)
             {
-            J = I + MMAX;
+            block[2L*(c*N2+n2)]   = pRecord->z.x;
+            block[2L*(c*N2+n2)+1] = pRecord->z.y;
+            }
+         }
 
-            TEMPR = dataBuffer[J]   * WR - dataBuffer[J+1] * WI;
-            TEMPI = dataBuffer[J+1] * WR + dataBuffer[J]   * WI;
+      for (c = 0L; c < nCols; ++c)
+         if (zFFT(block + 2L * c * N2, N2, iSign))
+            {
+            zTaskMessage(10,"Unable to allocate memory for the transform of %ld points.\n", N2);
+            BombOff(1);
+            }
 
-            dataBuffer[J]   = dataBuffer[I]   - TEMPR;
-            dataBuffer[J+1] = dataBuffer[I+1] - TEMPI;
-            dataBuffer[I]   = dataBuffer[I]   + TEMPR;
-            dataBuffer[I+1] = dataBuffer[I+1] + TEMPI;
+      for (k2 = 0L; k2 < N2; ++k2)    // Output records k1 to k1+nCols-1 of row k2 are adjacent
+         {
+         if (fseek(OUTSTR, (long)sizeof(struct FILEHDR) + (k2 * N1 + k1) * (long)Zsize(X_Data), SEEK_SET))
+            {
+            zError();
+            BombOff(1);
+            }
+
+         for (c = 0L; c < nCols; ++c)
+            {
+            XDataOut.z.x = block[2L*(c*N2+k2)]   / SCALE;
+            XDataOut.z.y = block[2L*(c*N2+k2)+1] / SCALE;
+            if (Zwrite(OUTSTR,(char *)&XDataOut,X_Data)) BombOff(1);
             }
-         WTEMP = WR;
-         WR = WR * WPR - WI    * WPI + WR;
-         WI = WI * WPR + WTEMP * WPI + WI;
          }
-       MMAX=ISTEP;
-       }
-
-    return;
-    }
+      }
+
+   zMapClose(SCRMAP);
+   SCRMAP = (struct ZMAP *)NIL;
+   unlink(SCRFILE);
+   SCRFILE[0] = '\0';
+
+   free(block);
+
+   return;
+   }
 
 /***************************************************************
 **
 ** Process ^C Interrupt
 */
+/************************************************************
+**
+** Bytes of scratch zFFT allocates for a transform of N points: a work
+** array and twiddle table for lengths made of 2, 3, 5 and 7, and for any
+** other length Bluestein's two padded arrays and chirp on top of the
+** power of 2 transforms of them.
+*/
+double FFTScratch(long N)
+   {
+   long M;
+
+   if (isSmoothLength(N)) return(32. * (double)N);
+
+   for (M = 1L; M < 2L * N - 1L; M *= 2L);
+
+   return(64. * (double)M + 16. * (double)N);
+   }
+
 void BREAKREQ(int a)
    {
    BombOff(256);
@@ -343,18 +622,28 @@ void BombOff(int a)
    {
    fcloseall();
    unlink(TMPFILE);
+   if (SCRFILE[0]) unlink(SCRFILE);
    ZCatFiles((char*)NIL); // free catalog memory
    Zexit(a);
    }
 
 void fcloseall()
    {
-   if (INSTR) Zclose(INSTR);
-   INSTR = (FILE *)NIL;
+   if (INMAP) zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
 
    if (OUTSTR) Zclose(OUTSTR);
    OUTSTR = (FILE *)NIL;
 
+   if (SCRRECORDS) zStreamClose(SCRRECORDS);
+   SCRRECORDS = (struct ZSTREAM *)NIL;
+
+   if (SCRSTR) Zclose(SCRSTR);
+   SCRSTR = (FILE *)NIL;
+
+   if (SCRMAP) zMapClose(SCRMAP);
+   SCRMAP = (struct ZMAP *)NIL;
+
    if (dataBuffer) free(dataBuffer);
    dataBuffer = (double *)NIL;
 
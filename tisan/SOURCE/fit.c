@@ -8,12 +8,19 @@
 * Fourier Integral Transform
 * CODE = 0 ->  FIT
 * CODE = 1 -> IFIT
+*
+* ITYPE = 0 -> Sum every frequency directly, O(N FACTOR)
+* ITYPE = 1 -> Non-uniform FFT (zNUFFT), O(N + FACTOR log FACTOR), to
+*              within FASTTOL in TISAN.CFG
 *
 * The default behavior is
 * F(ν) = 2/N ∫(f(t) exp(-i 2π ν t) dt
 * summed from 0 to N - 1 (Fundamental to 2*Nyquist)
 *
 * The Inverse transform i -> -i and 2/N is changed to 1/2
+*
+* When the samples are evenly spaced in time, cos and sin come from a
+* rotation recurrence (zRotorNext) instead of libm.
 
 * The infile of this task accepts wild cards.
 *
@@ -30,7 +37,7 @@
 
 void FINIT(void);
 void MEMREDUCE(void);
-short DSKREDUCE(void);
+void FASTFIT(void);
 
 double Omega, Nu, SLOPE, II, TIME, RDATA, IDATA=0., TCNT, HalfN;
 double N=0., a1H0H1ON;
@@ -45,11 +52,14 @@ struct XData  *XDataPntr;
 struct TXData *TXDataPntr;
 struct XData  XDataOut;
 char *dataBuffer = (char *)NIL;
-BOOL bMemoryFile = TRUE;
 
 double TWOPI;
 
-FILE *INSTR  = (FILE *)NIL;
+BOOL bEVEN;                   // TRUE if the samples are evenly spaced, at TZERO + k*TSTEP
+double TZERO, TSTEP;
+struct ZROTOR ROTOR;
+
+struct ZMAP *INMAP = (struct ZMAP *)NIL;   // Input file is memory mapped, dataBuffer points into it
 FILE *OUTSTR = (FILE *)NIL;
 
 const char szTask[]="FIT";
@@ -81,11 +91,18 @@ int main(int argc, char *argv[])
       Zexit(1);
       }
 
+   if ((ITYPE<0) || (ITYPE>1))
+      {
+      zTaskMessage(10,"Invalid ITYPE Specification\n");
+      Zexit(1);
+      }
+
    if (!OUTCLASS[0]) strcpy(OUTCLASS,"fit");
 
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -100,10 +117,8 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,TMPFILE);
 
       zTaskMessage(2,"Opening Input File '%s'\n",INFILE);
-      INSTR = zOpen(INFILE,O_readb);
-      if (!INSTR) Zexit(1);
-      
-      if (!Zgethead(INSTR,&FileHeader)) BombOff(1);
+      INMAP = zMapOpen(INFILE,&FileHeader,O_mapb);
+      if (!INMAP) Zexit(1);
 
       switch (FileHeader.type)
          {
@@ -132,25 +147,27 @@ int main(int argc, char *argv[])
       
       XDataOut.f = 0;
 
-      for (II = 0.0; II < FACTOR; ++II)
+      if (ITYPE == 1)
+         FASTFIT();
+      else
          {
-         XDataOut.z.x = XDataOut.z.y = 0.;
+         for (II = 0.0; II < FACTOR; ++II)
+            {
+            XDataOut.z.x = XDataOut.z.y = 0.;
 
-         Omega = TWOPI * (II * SLOPE + TRANGE[0]);  // Calculate next Omega which is 2 pi * frequency
+            Omega = TWOPI * (II * SLOPE + TRANGE[0]);  // Calculate next Omega which is 2 pi * frequency
 
-         if (bMemoryFile)
-            MEMREDUCE();      /* Data Fit into Memory */
-         else
-            {
-            if (DSKREDUCE()) BombOff(1);  /* Disk Processing */
-            }
+            MEMREDUCE();
 
-         Zwrite(OUTSTR,(char *)&XDataOut,X_Data);
+            Zwrite(OUTSTR,(char *)&XDataOut,X_Data);
 
-         printPercentComplete((long)II, (long)FACTOR, PROGRESS);
-         } /* End FOR II */
+            printPercentComplete((long)II, (long)FACTOR, PROGRESS);
+            } /* End FOR II */
 
-      printPercentComplete((long)II, (long)FACTOR, PROGRESS); // 100% Complete
+         printPercentComplete((long)II, (long)FACTOR, PROGRESS); // 100% Complete
+
+         if (bEVEN) zRotorReport(&ROTOR, 1);
+         }
 
       FileHeader.type = X_Data;        /* Output File is Complex */
       FileHeader.m = SLOPE;
@@ -174,46 +191,28 @@ int main(int argc, char *argv[])
 */
 void FINIT()
    {
-   double FIRST, FT, DELT=0., RMEAN=0., IMEAN=0.;
+   double FIRST=0., FT, DELT=0., RMEAN=0., IMEAN=0.;
    long I;
    short FFLAG=0, FLAG=0;
-   long numDataRecords;
 
 // Need to initialize these globals in case there are wildcards in the file name and thus we would make multiple passes
    IDATA = 0.;
    N = 0.;
    TOTAL = 0.;
    
-   numDataRecords = countDataRecords(INSTR);
-   
-   do {
-      dataBuffer = (char *)malloc(numDataRecords * (long)Zsize(FileHeader.type));
+   dataBuffer = INMAP->records;                 // All the records are in the file map
+   NUMDAT = NDAT = INMAP->nRecords;
 
-      if (!dataBuffer)
-         {
-         numDataRecords /= 2L;
-         bMemoryFile = FALSE;
-         }
-      }
-   while (!dataBuffer && numDataRecords);
+   zTaskMessage(2,"Processing data file in memory.\n");
 
-   if (!numDataRecords)
-      {
-      zTaskMessage(10,"Unable to allocate memory for input file.\n");
-      BombOff(1);
-      }
-   
-   if (bMemoryFile)
-      zTaskMessage(2,"Processing data file in memory.\n");
-   else
-      zTaskMessage(2,"Data file too large for available memopry. Processing from file (which might take a while).\n");
+   bEVEN = isEvenlySpaced(&FileHeader, dataBuffer, NUMDAT, &TZERO, &TSTEP);
+   zRotorInit(&ROTOR);
+   if (!bEVEN) zTaskMessage(2,"Samples are not evenly spaced, using cos() and sin().\n");
 
    TCNT = 0.;
 
-   while ((NDAT = zGetData(numDataRecords, INSTR, dataBuffer, FileHeader.type)))
+   if (NDAT)
       {
-      NUMDAT = NDAT;                                  // should be the same as numDataRecords (we would hope)
-      
       RDataPntr =  (struct RData *)dataBuffer;       /* Setup some data pointers */
       TRDataPntr = (struct TRData *)dataBuffer;
       XDataPntr =  (struct XData *)dataBuffer;
@@ -272,9 +271,7 @@ void FINIT()
             IMEAN += IDATA;
             } /* End IF */
          } /* End For */
-      } /* End WHILE */
-
-   if (ferror(INSTR)) BombOff(1);
+      } /* End IF */
 
    if (N < 3L)
       {
@@ -303,13 +300,13 @@ void FINIT()
 
 /***************************************************************
 **
-** Process "small" data files
+** Process the data in the file map
 */
 void MEMREDUCE()
    {
    long I;
    short Pass1 = 1;
-   double h1, h2, LastTime, LastX, LastY, DeltaT, ThisX, ThisY;
+   double h1, h2, LastTime, LastX=0., LastY=0., DeltaT, ThisX=0., ThisY=0.;
    double avgDeltaT = 0.0;
    short FLAG = 0;
    
@@ -320,6 +317,8 @@ void MEMREDUCE()
 
    TCNT = 0.0;
 
+   if (bEVEN) zRotorStart(&ROTOR, TZERO * Omega, TSTEP * Omega);
+
    for (I = 0; I < NUMDAT; ++I)
       {
       switch (FileHeader.type)
@@ -361,9 +360,17 @@ void MEMREDUCE()
 
             LastTime = TIME;
 
-            TIME *= Omega;
-            h1 = cos(TIME);
-            h2 = sin(TIME);
+            if (bEVEN)
+               {
+               h1 = ROTOR.c;
+               h2 = ROTOR.s;
+               }
+            else
+               {
+               TIME *= Omega;
+               h1 = cos(TIME);
+               h2 = sin(TIME);
+               }
 
             switch (CODE)
                {
@@ -384,9 +391,17 @@ void MEMREDUCE()
 
             LastTime = TIME;
 
-            TIME *= Omega;
-            h1 = cos(TIME);
-            h2 = sin(TIME);
+            if (bEVEN)
+               {
+               h1 = ROTOR.c;
+               h2 = ROTOR.s;
+               }
+            else
+               {
+               TIME *= Omega;
+               h1 = cos(TIME);
+               h2 = sin(TIME);
+               }
 
             switch (CODE)
                {
@@ -408,6 +423,8 @@ void MEMREDUCE()
             LastY = ThisY;
             } // if (Pass1) ... else
          } // if (!FLAG)
+
+      if (bEVEN) zRotorNext(&ROTOR);  // Every sample moves the phase on, flagged or not
       } // for (I = 0; I < NUMDAT; ++I)
 
    avgDeltaT /= (2. * HalfN);
@@ -431,120 +448,102 @@ void MEMREDUCE()
 
 /***************************************************************
 **
-** Process "large" data files
+** The whole transform at once with the non-uniform FFT.
+**
+** The trapezoid rule in MEMREDUCE gives each good sample the weight
+** (t[k+1] - t[k-1])/2, half that at the ends, so the integral for every
+** frequency is one sum of weight * f * exp(-i 2 pi nu t) for zNUFFT. The
+** inverse transform uses the conjugate. A few frequencies are then summed
+** directly with MEMREDUCE to check the result.
 */
-short DSKREDUCE()
+void FASTFIT()
    {
-   short Pass1 = 1;
-   double h1, h2, LastTime, LastX, LastY, DeltaT, ThisX, ThisY;
-   double avgDeltaT = 0.0;
-   short FLAG = 0;
-   
-   TCNT = 0.;
+   double *pTime, *pReal, *pImag, *pWork = (double *)NIL;
+   short *pFlag = (short *)NIL;
+   struct complex *pOut = (struct complex *)NIL;
+   double tolerance = zFastTolerance();
+   double avgDeltaT, scale, weight, sumAbs = 0., error, maxError = 0.;
+   long I, K, nGood, nFreq = (long)FACTOR;
+   long checkFreq[3];
+
+   pWork = (double *)malloc(3 * NUMDAT * sizeof(double));
+   pFlag = (short *)malloc(NUMDAT * sizeof(short));
+   pOut  = (struct complex *)malloc(nFreq * sizeof(struct complex));
+   if (!pWork || !pFlag || !pOut)
+      {
+      zTaskMessage(10,"Unable to allocate memory for the fast transform.\n");
+      BombOff(1);
+      }
 
-   if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) return(1);
-
-   while (Zread(INSTR,dataBuffer,FileHeader.type))
+   pTime = pWork;
+   pReal = pTime + NUMDAT;
+   pImag = pReal + NUMDAT;
+
+   if (zUnpackRecords(&FileHeader, dataBuffer, NUMDAT, pTime, pReal, pImag, pFlag)) BombOff(1);
+
+   for (I = nGood = 0L; I < NUMDAT; ++I)     // Keep the good samples only
       {
-      switch (FileHeader.type)
-         {
-         case R_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            RDATA = RDataPntr->y;
-            FLAG = RDataPntr->f;
-            ++TCNT;
-            break;
-         case TR_Data:
-            TIME = TRDataPntr->t;
-            RDATA = TRDataPntr->y;
-            break;
-         case X_Data:
-            TIME = TCNT * FileHeader.m + FileHeader.b;
-            RDATA = XDataPntr->z.x;
-            IDATA = XDataPntr->z.y;
-            FLAG = XDataPntr->f;
-            ++TCNT;
-            break;
-         case TX_Data:
-            TIME = TXDataPntr->t;
-            RDATA = TXDataPntr->z.x;
-            IDATA = TXDataPntr->z.y;
-            break;
-         }
+      if (pFlag[I]) continue;
+      pTime[nGood] = pTime[I];
+      pReal[nGood] = pReal[I];
+      pImag[nGood] = CODE ? -pImag[I] : pImag[I];
+      ++nGood;
+      }
 
-      if (!FLAG)
-         {
-         if (Pass1)
-            {
-            Pass1 = 0;
+   avgDeltaT = (pTime[nGood - 1] - pTime[0]) / (2. * HalfN);
+   scale = CODE ? 1. / 2. : 1. / (HalfN * avgDeltaT);
 
-            LastTime = TIME;
-
-            TIME *= Omega;
-            h1 = cos(TIME);
-            h2 = sin(TIME);
-
-            switch (CODE)
-               {
-               case 0: /* FIT */
-                  LastX = ((RDATA * h1) + (IDATA * h2));
-                  LastY = ((IDATA * h1) - (RDATA * h2));
-                  break;
-               case 1: /* IFIT */
-                  LastX = ((RDATA * h1) - (IDATA * h2));
-                  LastY = ((IDATA * h1) + (RDATA * h2));
-                  break;
-               }
-            }
-         else
-            {
-            DeltaT = TIME - LastTime;
-            avgDeltaT += DeltaT; 
-
-            LastTime = TIME;
+   for (K = 0L; K < nGood; ++K)             // Trapezoid weights
+      {
+      weight = (pTime[Min(K + 1, nGood - 1)] - pTime[Max(K - 1, 0L)]) / 2.;
+      pReal[K] *= weight;
+      pImag[K] *= weight;
+      sumAbs += sqrt(Square(pReal[K]) + Square(pImag[K]));
+      }
 
-            TIME *= Omega;
-            h1 = cos(TIME);
-            h2 = sin(TIME);
-
-            switch (CODE)
-               {
-               case 0: /* FIT */
-                  ThisX = (RDATA * h1) + (IDATA * h2);
-                  ThisY = (IDATA * h1) - (RDATA * h2);
-                  XDataOut.z.x += (DeltaT * (ThisX + LastX) / 2.);
-                  XDataOut.z.y += (DeltaT * (ThisY + LastY) / 2.);
-                  break;
-               case 1: /* IFIT */
-                  ThisX = (RDATA * h1) - (IDATA * h2);
-                  ThisY = (IDATA * h1) + (RDATA * h2);
-                  XDataOut.z.x += (DeltaT * (ThisX + LastX) / 2.);
-                  XDataOut.z.y += (DeltaT * (ThisY + LastY) / 2.);
-                  break;
-               }
-            LastX = ThisX;
-            LastY = ThisY;
-            }
-         }
-      } /* End WHILE */
-
-   avgDeltaT /= (2. * HalfN);
-
-   if (!CODE)
+   zTaskMessage(2,"Non-uniform FFT of %ld points to %ld frequencies.\n", nGood, nFreq);
+
+   if (zNUFFT(pTime, pReal, pImag, nGood, TRANGE[0], SLOPE, nFreq, tolerance, pOut))
       {
-      XDataOut.z.y /= HalfN;
-      XDataOut.z.x /= HalfN;
-
-      XDataOut.z.y /= avgDeltaT; // Apply scaling so sin(t) gives an amplitude of 1
-      XDataOut.z.x /= avgDeltaT;
+      zTaskMessage(10,"Unable to allocate memory for the fast transform grid.\n");
+      BombOff(1);
       }
-   else
+/*
+** Check against the direct sums
+*/
+   checkFreq[0] = 0L;
+   checkFreq[1] = nFreq / 2L;
+   checkFreq[2] = nFreq - 1L;
+
+   for (I = 0L; I < 3L; ++I)
       {
-      XDataOut.z.y /= 2.;
-      XDataOut.z.x /= 2.;
+      XDataOut.z.x = XDataOut.z.y = 0.;
+      Omega = TWOPI * ((double)checkFreq[I] * SLOPE + TRANGE[0]);
+      MEMREDUCE();
+
+      error = sqrt(Square(XDataOut.z.x - pOut[checkFreq[I]].x * scale) +
+                   Square(XDataOut.z.y - (CODE ? -pOut[checkFreq[I]].y : pOut[checkFreq[I]].y) * scale));
+      maxError = Max(maxError, error);
       }
 
-   return(ferror(INSTR));
+   maxError /= (sumAbs * scale);
+   zTaskMessage(3,"Largest relative difference from the direct sums %lG\n", maxError);
+   if (maxError > tolerance)
+      zTaskMessage(9,"** WARNING ** Fast transform is off by more than FASTTOL = %lG\n", tolerance);
+
+   XDataOut.f = 0;
+   for (I = 0L; I < nFreq; ++I)
+      {
+      XDataOut.z.x = pOut[I].x * scale;
+      XDataOut.z.y = (CODE ? -pOut[I].y : pOut[I].y) * scale;
+      if (Zwrite(OUTSTR,(char *)&XDataOut,X_Data)) BombOff(1);
+      }
+
+   free(pWork);
+   free(pFlag);
+   free(pOut);
+
+   return;
    }
 
 /***************************************************************
@@ -574,14 +573,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
-   if (INSTR) Zclose(INSTR);
-   INSTR = (FILE *)NIL;
+   if (INMAP) zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
+   dataBuffer = (char *)NIL;
 
    if (OUTSTR) Zclose(OUTSTR);
    OUTSTR = (FILE *)NIL;
-
-   if (dataBuffer) free(dataBuffer);
-   dataBuffer = (char *)NIL;
    
    return;
    }
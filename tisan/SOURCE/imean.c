@@ -42,12 +42,12 @@ int main(int argc, char *argv[])
    struct FILEHDR FileHeader;
    double TimeCount=0.,DataTime, DataCount=0.;
    double FlaggedCount=0., DataCountInRange=0.;
-   double FileDataMin , FileDataMax , RangeDataMin , RangeDataMax , Data;
-   double FileStartTime, RangeTimeOfMax, RangeTimeOfMin;
-   double RangeCountAtMin, RangeCountAtMax, DataSum=0., SumSquared=0.;
-   double RangeMinTime, RangeMaxTime, FileMinTime, FileMaxTime;         // Smallest and largest time values
+   double FileDataMin=0., FileDataMax=0., RangeDataMin=0., RangeDataMax=0., Data;
+   double FileStartTime=0., RangeTimeOfMax=0., RangeTimeOfMin=0.;
+   double RangeCountAtMin=0., RangeCountAtMax=0., DataSum=0., SumSquared=0.;
+   double RangeMinTime=0., RangeMaxTime=0., FileMinTime=0., FileMaxTime=0.;         // Smallest and largest time values
    double DataMean=0.0, SIGMA=0.0;
-   double TLLAST, TLNEXT, THLAST, THNEXT, LastDataTime;
+   double TLLAST=0., TLNEXT=0., THLAST=0., THNEXT=0., LastDataTime;
    short FLAG=0;
    BOOL bFileFirstPass = TRUE, bRangeFirstPass = TRUE;
    BOOL bMinJustFound, bMaxJustFound;
@@ -57,7 +57,7 @@ int main(int argc, char *argv[])
 //   struct TRData *TRDataPntr;
 //   struct XData  *XDataPntr;
 //   struct TXData *TXDataPntr;
-   struct complex ComplexMean, ComplexMin, ComplexMax, ComplexSum, ComplexData;
+   struct complex ComplexMean={0.,0.}, ComplexMin={0.,0.}, ComplexMax={0.,0.}, ComplexSum, ComplexData;
    BOOL unsorted = FALSE, duplicateAdjacentTiemStamps = FALSE;;
 // declarations need to manage wild cards
    struct CATSTRUCT *CatList;
@@ -24,6 +24,20 @@
 *
 * The infile of this task accepts wild cards.
 *
+* The input is memory mapped and read twice, once for the statistics (q, r and the prediction times) and once by the filter. The filter
+* is a single streaming pass: BUILD merges the data with the prediction times, STRIP combines points at the same time and PREDICT runs the
+* forward filter into a ring of states. The backward smoother sweeps the ring and writes every state whose smoothed value can no longer be
+* changed by the rest of the series (the product of the smoother gains from it to the newest state is below KALMANTOL). When the whole series
+* fits in the ring the result is exactly that of a full backward pass. If the ring fills up without any state becoming final, the states
+* are spilled to a scratch file and the backward pass is finished from there, writing the output blocks in place.
+*
+* With more than one of THREADS (TISAN.CFG) the forward and backward passes over the ring are split into segments of KALMANSEGMENT
+* states that are worked on in parallel. Both recursions are associative once written as transforms of the state entering a segment:
+* the forward error variance p is a linear fractional (Mobius) transform of the previous one, and with the variances known the forward
+* state x and the smoothed value y are linear (affine) in the previous ones. Each segment first composes its transform, the transforms
+* are chained from one segment to the next to find the state entering every segment, and then each segment runs the usual recursion
+* from there. The results agree with the serial filter to within round-off and do not depend on the number of threads.
+*
 */
 #include <unistd.h>
 
@@ -44,19 +58,75 @@ struct PREDICTSTRUCT {double t;
                       double p;
                       int f;};
 
+#define KALMANTOL 1.0e-17   // A smoothed value is final once the newest state can move it by less than this fraction
+#define KALMANSEGMENT 65536L // States per segment of the threaded passes
+
+#define KALMAN_MOBIUS  0    // What a threaded pass does with each segment: compose the transform of p
+#define KALMAN_AFFINE  1    // Find p and compose the transform of x
+#define KALMAN_FORWARD 2    // Find x
+#define KALMAN_GAINS   3    // Compose the transform of the smoothed values
+#define KALMAN_SMOOTH  4    // Find the smoothed values
+
+struct SEGMENTSTRUCT {double m[4];     // p -> (m[0] p + m[1])/(m[2] p + m[3]) over the segment
+                      double a, b;     // x -> a x + b, or y -> a y + b for the smoother
+                      double g;        // Product of the smoother gains
+                      double in;       // p, then x, entering the segment, or y leaving it for the smoother
+                      double gAbove;   // Product of the smoother gains from the end of the segment to the newest state
+                      long lFinal;};   // States of the segment that are final (SMOOTH)
+
+struct KALMANWORK {int  iPass;               // Work shared by the threads of one pass over the ring
+                   long lStart;              // First state of the pass, counted from the oldest in the ring
+                   long n;                   // States in the pass
+                   long nSegments;
+                   long lSegment;            // States per segment
+                   double tIn;               // Time of the state before the pass (forward)
+                   BOOL bNext;               // A later state follows the pass (backward)
+                   double tNext;             // Its time
+                   BOOL bTrack;              // Look for the final states (backward)
+                   struct SEGMENTSTRUCT *pSegments;};
+
 int FINIT(void);
-int BUILD(void);
-int STRIP(void);
+BOOL NEXTDATA(struct KALMANSTRUCT *);
+BOOL BUILD(struct KALMANSTRUCT *);
+BOOL STRIP(struct KALMANSTRUCT *);
 int PREDICT(void);
+int MAKEROOM(void);
+void FORWARD(long, long);
+long SWEEP(long, BOOL, double, double, BOOL);
+void KALMANTHREAD(int, int, void *);
+int SMOOTH(BOOL);
+int SPILL(void);
+int UNSPILL(void);
+int OUTPUT(double);
 
 double Q, R=0., TB, TM;
 double N=0.;
 short ErrorFlag=0;
-char InputFileName[_MAX_PATH], OutputFileName[_MAX_PATH], TempFileName[_MAX_PATH];
+char InputFileName[_MAX_PATH], OutputFileName[_MAX_PATH], TempFileName[_MAX_PATH], SpillFileName[_MAX_PATH];
 struct FILEHDR FileHeader;
 
-FILE *InputStream  = (FILE *)NIL;
-FILE *OutputStream = (FILE *)NIL;;
+struct ZMAP *INMAP = (struct ZMAP *)NIL;          // Input file is memory mapped
+FILE *OutputStream = (FILE *)NIL;
+struct ZSTREAM *OUTSTREAM = (struct ZSTREAM *)NIL; // Output records
+FILE *SpillStream  = (FILE *)NIL;                 // Forward states that did not fit in the ring
+
+long iInput;                      // Next input record for NEXTDATA
+double II;                        // Next prediction time index for BUILD
+struct KALMANSTRUCT InputData;    // Next valid input point not yet merged
+BOOL bInputData;
+struct KALMANSTRUCT Pending;      // STRIP look ahead
+BOOL bPending;
+
+struct PREDICTSTRUCT *pStates = (struct PREDICTSTRUCT *)NIL;   // Ring of forward states
+double *pSmooth = (double *)NIL;                                // Smoothed values of the ring
+long lRingSize, lFirst, lCount;   // Ring slots, slot of the oldest state and number of states held
+long lSpilled, lSpillOutputs;     // States in the spill file and output records they (and the ring) hold
+BOOL bSpill;
+double Tk, Xk, Pk;                // Newest forward state
+int nThreads;                     // THREADS in TISAN.CFG
+
+#define STATE(k) pStates[(lFirst + (k)) % lRingSize]   // k-th state counted from the oldest in the ring
+#define SMOOTHED(k) pSmooth[(lFirst + (k)) % lRingSize]
 
 const char szTask[]="KALMAN";
 
@@ -94,9 +164,13 @@ int main(int argc, char *argv[])
 
    if (!OUTCLASS[0]) strcpy(OUTCLASS,"kal");
 
+   nThreads = zThreadCount();
+   zTaskMessage(2,"Using %d thread(s).\n", nThreads);
+
    zBuildFileName(M_inname,InputFileName);
    CatList = ZCatFiles(InputFileName);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);         // Quit if there are none
+   zParallelFiles(CatList);               // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -110,8 +184,7 @@ int main(int argc, char *argv[])
 
       FINIT();
 
-      if (!(ErrorFlag=BUILD()) &&
-          !(ErrorFlag=STRIP())) (ErrorFlag=PREDICT());
+      ErrorFlag = PREDICT();
 
       if (ErrorFlag >= 1) BombOff(1);
 
@@ -131,29 +204,27 @@ int main(int argc, char *argv[])
 */
 int FINIT()
    {
-   double PreviousData, PreviousTime;
+   double PreviousData=0., PreviousTime=0.;
    int FirstFlag = 0;
-   char InputBuffer[sizeof(struct TRData)];
    struct TRData *pInputTRData;
    struct RData  *pInputRData;
-   double Data, Time, TimeCount=0.;
+   double Data=0., Time=0., TimeCount=0.;
    int Flag=0;
    double SumSqr=0.;
+   long I;
+   char *record;
 
 
 // Initialize these globals in case we have wildcards in the file name
    R = 0.;
    N = 0.;
    ErrorFlag = 0;
-
-   pInputTRData = (struct TRData *)InputBuffer;
-   pInputRData  = (struct  RData *)InputBuffer;
+   TempFileName[0] = SpillFileName[0] = '\0';
 
    zBuildFileName(M_inname,InputFileName);
    zTaskMessage(2,"Opening Input File '%s'\n",InputFileName);
 
-   if (((InputStream = zOpen(InputFileName,O_readb)) == NULL) ||
-        (!Zgethead(InputStream,&FileHeader))) BombOff(1);
+   if (!(INMAP = zMapOpen(InputFileName,&FileHeader,O_mapb))) BombOff(1);
 
    switch (FileHeader.type)
       {
@@ -165,25 +236,26 @@ int FINIT()
          BombOff(1);
       }
 
-   zBuildFileName(M_tmpname,TempFileName);
-   zTaskMessage(2,"Opening Scratch File '%s'\n",TempFileName);
-
-   if (!(OutputStream = zOpen(TempFileName,O_writeb))) BombOff(1);
-
-   while (Zread(InputStream,InputBuffer,FileHeader.type))
+   for (I = 0L, record = INMAP->records; I < INMAP->nRecords; ++I, record += INMAP->size)
       {
-      if (Zwrite(OutputStream,InputBuffer,FileHeader.type)) return(1);
       switch (FileHeader.type)
          {
          case R_Data:
+            pInputRData = (struct RData *)record;
             Flag = pInputRData->f;
             Data = pInputRData->y;
             Time = FileHeader.m*TimeCount + FileHeader.b;
             ++TimeCount;
             break;
          case TR_Data:
+            pInputTRData = (struct TRData *)record;
             Time = pInputTRData->t;
             Data = pInputTRData->y;
+            if (FirstFlag && (Time < PreviousTime))
+               {
+               zTaskMessage(10,"File is not in time order. Sort it with DBSORT first.\n");
+               BombOff(1);
+               }
             break;
          }
 
@@ -228,281 +300,597 @@ int FINIT()
 
    zTaskMessage(3,"File Contains %ld Valid Points\n",(long)N);
    zTaskMessage(3,"r=%lG, q=%lG\n",R,Q);
-   fcloseall();
 
    return(0);
    }
 
 /************************************************************
 **
-** Build Prediction Data Times
+** Next valid input point, skipping flagged data
 */
-int BUILD()
+BOOL NEXTDATA(struct KALMANSTRUCT *pData)
    {
-   double II;
-   struct KALMANSTRUCT Predicted, InputData;
-   char InputBuffer[sizeof(struct TRData)];
    struct TRData *pInputTRData;
    struct RData  *pInputRData;
-   double TimeCount=0.;
-   int Flag;
 
-   pInputTRData = (struct TRData *)InputBuffer;
-   pInputRData  = (struct  RData *)InputBuffer;
+   for (; iInput < INMAP->nRecords; ++iInput)
+      {
+      switch (INMAP->type)   // FileHeader now describes the output
+         {
+         case R_Data:
+            pInputRData = (struct RData *)(INMAP->records + iInput * INMAP->size);
+            if (pInputRData->f) continue;
+            pData->y = pInputRData->y;
+            pData->t = INMAP->header->m*(double)iInput + INMAP->header->b;
+            break;
+         case TR_Data:
+            pInputTRData = (struct TRData *)(INMAP->records + iInput * INMAP->size);
+            pData->y = pInputTRData->y;
+            pData->t = pInputTRData->t;
+            break;
+         }
+      pData->f = 1;
+      ++iInput;
+      return(TRUE);
+      }
 
-   Predicted.f = 0;
-   Predicted.y = 0.;
+   return(FALSE);
+   }
 
-   InputData.f = 1;
+/************************************************************
+**
+** Build Prediction Data Times
+**
+** Returns the next record of the data merged with the prediction
+** times. A data point comes before a prediction at the same time and
+** data after the last prediction time are dropped.
+*/
+BOOL BUILD(struct KALMANSTRUCT *pRecord)
+   {
+   double PredictedTime;
 
-   zTaskMessage(3,"Building Prediction Times\n",N);
+   if (II >= FACTOR) return(FALSE);
 
-/*
-** From this point on, the input file is now a temporary file
+   PredictedTime = II * TM + TB;
+
+   if (bInputData && (InputData.t <= PredictedTime))
+      {
+      *pRecord = InputData;
+      bInputData = NEXTDATA(&InputData);
+      }
+   else
+      {
+      pRecord->t = PredictedTime;
+      pRecord->y = 0.;
+      pRecord->f = 0;
+      ++II;
+      }
+
+   return(TRUE);
+   }
+
+/************************************************************
+**
+** Strip Redundant Points
+**
+** Two records at the same time become one flagged -1, which is the
+** data point when the first of them is one. STRIP looks one record
+** ahead of BUILD.
 */
-   strcpy(InputFileName,TempFileName);
-   zTaskMessage(2,"Opening Input File '%s'\n",InputFileName);
-   if (!(InputStream = zOpen(InputFileName,O_readb))) return(2);
+BOOL STRIP(struct KALMANSTRUCT *pRecord)
+   {
+   struct KALMANSTRUCT Next;
+
+   if (!bPending) return(FALSE);
+
+   if (!BUILD(&Next))
+      {
+      *pRecord = Pending;
+      bPending = FALSE;
+      }
+   else if (Pending.t == Next.t)
+      {
+      *pRecord = (Pending.f) ? Pending : Next;
+      pRecord->f = -1;
+      bPending = BUILD(&Pending);
+      }
+   else
+      {
+      *pRecord = Pending;
+      Pending = Next;
+      }
+
+   return(TRUE);
+   }
+
+/************************************************************
+**
+** Create Prediction Points
+*/
+int  PREDICT()
+   {
+   struct KALMANSTRUCT KalmanInput;
+   long lTotal, n, k;
+   BOOL bMore;
+
+   zTaskMessage(3,"Creating Prediction Values\n",N);
 
    zBuildFileName(M_tmpname,TempFileName);
    zTaskMessage(2,"Opening Scratch File '%s'\n",TempFileName);
    if (!(OutputStream = zOpen(TempFileName,O_writeb))) return(2);
 
+   FileHeader.type = R_Data;
+   FileHeader.m = TM;
+   FileHeader.b = TB;
+
+   if (Zputhead(OutputStream,&FileHeader)) return(2);
+   if (!(OUTSTREAM = zStreamOpen(OutputStream,R_Data,O_writeb))) return(2);
+
 /*
-** Read Past any initial bad data for setting prediction times
+** The ring holds the forward states still waiting for the smoother,
+** as many as MEMORY allows but no more than the series can produce.
 */
-   do {
-      if (!Zread(InputStream,InputBuffer,FileHeader.type)) return(2);
-      Flag =  (FileHeader.type == R_Data) ? pInputRData->f : 0;
-      ++TimeCount;
-      }
-   while (Flag);
-   --TimeCount;
-   switch (FileHeader.type)
+   lTotal = (long)(N + FACTOR) + 1L;
+   lRingSize = zMemoryBudget() / (long)(sizeof(struct PREDICTSTRUCT) + sizeof(double));
+   if (lRingSize > lTotal) lRingSize = lTotal;
+   if (lRingSize < 2L) lRingSize = 2L;
+
+   pStates = (struct PREDICTSTRUCT *)malloc((size_t)lRingSize * sizeof(struct PREDICTSTRUCT));
+   pSmooth = (double *)malloc((size_t)lRingSize * sizeof(double));
+   if (!pStates || !pSmooth)
       {
-      case R_Data:
-         InputData.y = pInputRData->y;
-         InputData.t = FileHeader.m*TimeCount + FileHeader.b;
-         break;
-      case TR_Data:
-         InputData.y = pInputTRData->y;
-         InputData.t = pInputTRData->t;
-         break;
+      zTaskMessage(10,"Unable to allocate memory for the filter states.\n");
+      return(2);
       }
 
-   for (II = 0.; II < FACTOR; ++II)
+   lFirst = lCount = 0L;
+   lSpilled = lSpillOutputs = 0L;
+   bSpill = FALSE;
+
+   iInput = 0L;
+   II = 0.;
+   bInputData = NEXTDATA(&InputData);
+   bPending = BUILD(&Pending);
+
+   if (!STRIP(&KalmanInput)) return(2);
+
+   Tk = pStates[0].t = KalmanInput.t;
+   Xk = pStates[0].x = KalmanInput.y;
+   Pk = pStates[0].p = R;
+   pStates[0].f = KalmanInput.f;
+   lCount = 1L;
+
+/*
+** The records are gathered into the free part of the ring and then
+** filtered there as one batch.
+*/
+   bMore = STRIP(&KalmanInput);
+   while (bMore)
       {
-      Predicted.t = II * TM + TB;
-      while ((InputData.t <= Predicted.t) && !feof(InputStream))
+      if ((lCount == lRingSize) && MAKEROOM()) return(2);
+
+      for (n = 0L; bMore && (lCount + n < lRingSize); ++n, bMore = STRIP(&KalmanInput))
          {
-         fwrite(&InputData,sizeof(struct KALMANSTRUCT),1,OutputStream);
-         do {
-            if (!Zread(InputStream,InputBuffer,FileHeader.type)) break;
-            Flag =  (FileHeader.type == R_Data) ? pInputRData->f : 0;
-            ++TimeCount;
-            }
-         while (Flag);
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               InputData.y = pInputRData->y;
-               InputData.t = FileHeader.m*TimeCount + FileHeader.b;
-               break;
-            case TR_Data:
-               InputData.y = pInputTRData->y;
-               InputData.t = pInputTRData->t;
-               break;
-            }
+         STATE(lCount + n).t = KalmanInput.t;
+         STATE(lCount + n).x = KalmanInput.y;   // The measurement until FORWARD replaces it with the state
+         STATE(lCount + n).f = KalmanInput.f;
          }
-      fwrite(&Predicted,sizeof(struct KALMANSTRUCT),1,OutputStream);
+
+      FORWARD(lCount, n);
+
+      if (bSpill)
+         for (k = lCount; k < lCount + n; ++k)
+            if (STATE(k).f < 1) ++lSpillOutputs;
+
+      lCount += n;
       }
 
-   fcloseall();
-   unlink(InputFileName);
+   if (bSpill ? UNSPILL() : SMOOTH(TRUE)) return(2);
+
    return(0);
    }
 
 /************************************************************
 **
-** Strip File of Redundant Points
+** Free up the full ring, smoothing it if we can. Once spilling,
+** the ring is only a buffer for the spill file.
 */
-int STRIP()
+int MAKEROOM()
    {
-   struct KALMANSTRUCT InputData1, InputData2;
-   int DoneFlag = 0;
+   if (bSpill)
+      {
+      if (fwrite(pStates,sizeof(struct PREDICTSTRUCT),(size_t)lCount,SpillStream) != (size_t)lCount) return(2);
+      lSpilled += lCount;
+      lCount = 0L;
+      }
+   else
+      {
+      if (SMOOTH(FALSE)) return(2);
+      if (lCount > lRingSize - lRingSize/8L) // Hardly anything was final, the smoother needs the whole series
+         if (SPILL()) return(2);
+      }
 
-   zTaskMessage(3,"Stripping Redundant Points\n",N);
+   return(0);
+   }
 
-   strcpy(InputFileName,TempFileName);
-   zTaskMessage(2,"Opening Input File '%s'\n",InputFileName);
-   if (!(InputStream = zOpen(InputFileName,O_readb))) return(2);
+/************************************************************
+**
+** Forward filter over the n states of the ring starting at lStart,
+** which hold the measurements, from the newest state (Tk, Xk, Pk).
+*/
+void FORWARD(long lStart, long n)
+   {
+   struct KALMANWORK work;
+   double Xkp1, Zkp1, Pkp1, Tkp1, Rinv, P, X;
+   int Flag;
+   long k, j;
 
-   zBuildFileName(M_tmpname,TempFileName);
-   zTaskMessage(2,"Opening Scratch File '%s'\n",TempFileName);
-   if (!(OutputStream = zOpen(TempFileName,O_writeb))) return(2);
+   if (!n) return;
+
+   work.nSegments = (n + KALMANSEGMENT - 1L) / KALMANSEGMENT;
+   work.pSegments = (struct SEGMENTSTRUCT *)NIL;
+
+   if ((nThreads > 1) && (work.nSegments > 1L))
+      work.pSegments = (struct SEGMENTSTRUCT *)malloc((size_t)work.nSegments * sizeof(struct SEGMENTSTRUCT));
 
-   fread(&InputData1,sizeof(struct KALMANSTRUCT),1,InputStream);
-   while (!feof(InputStream))
+   if (!work.pSegments)   // One thread, one segment, or no memory for the segments
       {
-      fread(&InputData2,sizeof(struct KALMANSTRUCT),1,InputStream);
-      if (!feof(InputStream))
+      for (k = lStart; k < lStart + n; ++k)
          {
-         if (InputData1.t == InputData2.t)
-            {
-            if (InputData1.f)
-               {
-               InputData1.f = -1;
-               fwrite(&InputData1,sizeof(struct KALMANSTRUCT),1,OutputStream);
-               }
-            else
-               {
-               InputData2.f = -1;
-               fwrite(&InputData2,sizeof(struct KALMANSTRUCT),1,OutputStream);
-               }
-            fread(&InputData1,sizeof(struct KALMANSTRUCT),1,InputStream);
-            if (feof(InputStream)) DoneFlag = 1;
-            }
-         else
-            {
-            fwrite(&InputData1,sizeof(struct KALMANSTRUCT),1,OutputStream);
-            InputData1 = InputData2;
-            }
+         Tkp1 = STATE(k).t;
+         Zkp1 = STATE(k).x;
+         Flag = STATE(k).f;
+         Rinv = fabs((double)Flag)/R;
+         Pkp1 = 1./(1./(Pk + Q*(Tkp1 - Tk)) + Rinv);
+         Xkp1 = Xk + Pkp1*Rinv*(Zkp1 - Xk);
+         Tk = Tkp1;
+         Xk = STATE(k).x = Xkp1;
+         Pk = STATE(k).p = Pkp1;
          }
+      return;
       }
 
-   if (!DoneFlag)
-      fwrite(&InputData1,sizeof(struct KALMANSTRUCT),1,OutputStream);
+   work.lStart = lStart;
+   work.n = n;
+   work.lSegment = KALMANSEGMENT;
+   work.tIn = Tk;
 
-   fcloseall();
-   unlink(InputFileName);
-   return(0);
+   work.iPass = KALMAN_MOBIUS;
+   zRunThreads((int)Min((long)nThreads, work.nSegments), KALMANTHREAD, &work);
+
+   for (j = 0L, P = Pk; j < work.nSegments; ++j)
+      {
+      work.pSegments[j].in = P;
+      P = (work.pSegments[j].m[0]*P + work.pSegments[j].m[1])/(work.pSegments[j].m[2]*P + work.pSegments[j].m[3]);
+      }
+
+   work.iPass = KALMAN_AFFINE;
+   zRunThreads((int)Min((long)nThreads, work.nSegments), KALMANTHREAD, &work);
+
+   for (j = 0L, X = Xk; j < work.nSegments; ++j)
+      {
+      work.pSegments[j].in = X;
+      X = work.pSegments[j].a*X + work.pSegments[j].b;
+      }
+
+   work.iPass = KALMAN_FORWARD;
+   zRunThreads((int)Min((long)nThreads, work.nSegments), KALMANTHREAD, &work);
+
+   Tk = STATE(lStart + n - 1L).t;
+   Xk = STATE(lStart + n - 1L).x;
+   Pk = STATE(lStart + n - 1L).p;
+
+   free(work.pSegments);
+
+   return;
    }
 
 /************************************************************
 **
-** Create Prediction Points
+** Backward smoother over the n oldest states of the ring, into
+** pSmooth. The newest of them is taken at its forward value unless
+** bNext, when the smoothed value yNext at tNext follows it.
+** With bTrack, returns how many of the oldest states are final.
 */
-int  PREDICT()
+long SWEEP(long n, BOOL bNext, double tNext, double yNext, BOOL bTrack)
    {
-   struct PREDICTSTRUCT PredictOutput, PredictInput;
-   struct KALMANSTRUCT KalmanInput, KalmanOutput;
-   double Xk, Xkp1, Ykp1, Zkp1, Pk, Pkp1, Tk, Tkp1, Yk;
-   double Rinv;
-   struct RData OutputRData;
-   int Flag;
-   long lOffset;
+   struct KALMANWORK work;
+   struct SEGMENTSTRUCT one;
+   double Y, G;
+   long j, lFinal = 0L;
 
-   zTaskMessage(3,"Creating Prediction Values\n",N);
+   if (!n) return(0L);
 
-   strcpy(InputFileName,TempFileName);
-   zTaskMessage(2,"Opening Input File '%s'\n",InputFileName);
-   if (!(InputStream = zOpen(InputFileName,O_readb))) return(2);
+   work.n = n;
+   work.lStart = 0L;
+   work.bNext = bNext;
+   work.tNext = tNext;
+   work.bTrack = bTrack;
+   work.nSegments = (n + KALMANSEGMENT - 1L) / KALMANSEGMENT;
+   work.pSegments = (struct SEGMENTSTRUCT *)NIL;
 
-   zBuildFileName(M_tmpname,TempFileName);
-   zTaskMessage(2,"Opening Scratch File '%s'\n",TempFileName);
-   if (!(OutputStream = zOpen(TempFileName,O_writeb))) return(2);
+   if ((nThreads > 1) && (work.nSegments > 1L))
+      work.pSegments = (struct SEGMENTSTRUCT *)malloc((size_t)work.nSegments * sizeof(struct SEGMENTSTRUCT));
 
-   fread(&KalmanInput,sizeof(struct KALMANSTRUCT),1,InputStream);
+   if (!work.pSegments)   // The whole sweep as one segment
+      {
+      work.nSegments = 1L;
+      work.lSegment = n;
+      work.pSegments = &one;
+      one.in = yNext;
+      one.gAbove = 1.;
+      }
+   else
+      {
+      work.lSegment = KALMANSEGMENT;
+      work.iPass = KALMAN_GAINS;
+      zRunThreads((int)Min((long)nThreads, work.nSegments), KALMANTHREAD, &work);
 
-   Tk = PredictOutput.t = KalmanInput.t;
-   Xk = PredictOutput.x = KalmanInput.y;
-   Pk = PredictOutput.p = R;
-   Flag = PredictOutput.f = KalmanInput.f;
+      for (j = work.nSegments - 1L, Y = yNext, G = 1.; j >= 0L; --j)
+         {
+         work.pSegments[j].in = Y;
+         work.pSegments[j].gAbove = G;
+         Y = work.pSegments[j].a*Y + work.pSegments[j].b;
+         G *= work.pSegments[j].g;
+         }
+      }
 
-   fwrite(&PredictOutput,sizeof(struct PREDICTSTRUCT),1,OutputStream);
+   work.iPass = KALMAN_SMOOTH;
+   zRunThreads((int)Min((long)nThreads, work.nSegments), KALMANTHREAD, &work);
 
-   while(!feof(InputStream))
+   for (j = 0L; j < work.nSegments; ++j) lFinal = Max(lFinal, work.pSegments[j].lFinal);
+
+   if (work.pSegments != &one) free(work.pSegments);
+
+   return(lFinal);
+   }
+
+/************************************************************
+**
+** One thread of a pass over the segments of the ring. The segments
+** are dealt out in turn, so the result does not depend on the number
+** of threads.
+*/
+void KALMANTHREAD(int iThread, int nThreads, void *pData)
+   {
+   struct KALMANWORK *pWork = (struct KALMANWORK *)pData;
+   struct SEGMENTSTRUCT *pSeg;
+   double m0, m1, m2, m3, a, r, scale;
+   double Tprev, Tnext, P, X, Y, G, K, Rinv, Pkp1;
+   long j, k, kStart, kEnd;
+
+   for (j = iThread; j < pWork->nSegments; j += nThreads)
       {
-      fread(&KalmanInput,sizeof(struct KALMANSTRUCT),1,InputStream);
-      Tkp1 = KalmanInput.t;
-      Zkp1 = KalmanInput.y;
-      Flag = KalmanInput.f;
-      if (!feof(InputStream))
+      pSeg = pWork->pSegments + j;
+      kStart = pWork->lStart + j * pWork->lSegment;
+      kEnd = Min(kStart + pWork->lSegment, pWork->lStart + pWork->n);
+
+      switch (pWork->iPass)
          {
-         Rinv = fabs((double)Flag)/R;
-         Pkp1 = 1./(1./(Pk + Q*(Tkp1 - Tk)) + Rinv);
-         Xkp1 = Xk + Pkp1*Rinv*(Zkp1 - Xk);
-         Tk = PredictOutput.t = Tkp1;
-         Xk = PredictOutput.x = Xkp1;
-         Pk = PredictOutput.p = Pkp1;
-         PredictOutput.f = Flag;
-         fwrite(&PredictOutput,sizeof(struct PREDICTSTRUCT),1,OutputStream);
+         case KALMAN_MOBIUS:  // p -> (p + q dt)/(p/r + 1 + q dt/r), taken as the matrix [1, q dt; 1/r, 1 + q dt/r]
+            m0 = m3 = 1.;
+            m1 = m2 = 0.;
+            Tprev = (j) ? STATE(kStart - 1L).t : pWork->tIn;
+            for (k = kStart; k < kEnd; ++k)
+               {
+               a = Q*(STATE(k).t - Tprev);
+               r = fabs((double)STATE(k).f)/R;
+               pSeg->m[0] = m0 + a*m2;
+               pSeg->m[1] = m1 + a*m3;
+               pSeg->m[2] = r*m0 + (1. + r*a)*m2;
+               pSeg->m[3] = r*m1 + (1. + r*a)*m3;
+               scale = pSeg->m[0] + pSeg->m[1] + pSeg->m[2] + pSeg->m[3];   // The transform does not change with the scale
+               m0 = pSeg->m[0]/scale;
+               m1 = pSeg->m[1]/scale;
+               m2 = pSeg->m[2]/scale;
+               m3 = pSeg->m[3]/scale;
+               Tprev = STATE(k).t;
+               }
+            pSeg->m[0] = m0;
+            pSeg->m[1] = m1;
+            pSeg->m[2] = m2;
+            pSeg->m[3] = m3;
+            break;
+         case KALMAN_AFFINE:  // x -> (1 - K) x + K z
+            pSeg->a = 1.;
+            pSeg->b = 0.;
+            P = pSeg->in;
+            Tprev = (j) ? STATE(kStart - 1L).t : pWork->tIn;
+            for (k = kStart; k < kEnd; ++k)
+               {
+               Rinv = fabs((double)STATE(k).f)/R;
+               Pkp1 = 1./(1./(P + Q*(STATE(k).t - Tprev)) + Rinv);
+               K = Pkp1*Rinv;
+               pSeg->a = (1. - K)*pSeg->a;
+               pSeg->b = (1. - K)*pSeg->b + K*STATE(k).x;
+               P = STATE(k).p = Pkp1;
+               Tprev = STATE(k).t;
+               }
+            break;
+         case KALMAN_FORWARD:
+            X = pSeg->in;
+            for (k = kStart; k < kEnd; ++k)
+               {
+               Rinv = fabs((double)STATE(k).f)/R;
+               X = STATE(k).x = X + STATE(k).p*Rinv*(STATE(k).x - X);
+               }
+            break;
+         case KALMAN_GAINS:   // y -> (1 - G) x + G y
+            pSeg->a = pSeg->g = 1.;
+            pSeg->b = 0.;
+            Tnext = (kEnd < pWork->n) ? STATE(kEnd).t : pWork->tNext;
+            for (k = kEnd - 1L; k >= kStart; --k)
+               {
+               if ((k == pWork->n - 1L) && !pWork->bNext)
+                  {
+                  pSeg->a = 0.;
+                  pSeg->b = STATE(k).x;
+                  }
+               else
+                  {
+                  G = STATE(k).p/(STATE(k).p + Q*(Tnext - STATE(k).t));
+                  pSeg->a = G*pSeg->a;
+                  pSeg->b = (1. - G)*STATE(k).x + G*pSeg->b;
+                  pSeg->g *= G;
+                  }
+               Tnext = STATE(k).t;
+               }
+            break;
+         case KALMAN_SMOOTH:
+            Y = pSeg->in;
+            G = pSeg->gAbove;
+            pSeg->lFinal = 0L;
+            Tnext = (kEnd < pWork->n) ? STATE(kEnd).t : pWork->tNext;
+            for (k = kEnd - 1L; k >= kStart; --k)
+               {
+               X = STATE(k).x;
+               P = STATE(k).p;
+               if ((k == pWork->n - 1L) && !pWork->bNext)
+                  Y = X;                        // The newest state
+               else
+                  {
+                  Y = X + P*(Y - X)/(P + Q*(Tnext - STATE(k).t));
+                  if (pWork->bTrack && !pSeg->lFinal)
+                     {
+                     G *= P/(P + Q*(Tnext - STATE(k).t));
+                     if (G < KALMANTOL) pSeg->lFinal = k + 1L;
+                     }
+                  }
+               SMOOTHED(k) = Y;
+               Tnext = STATE(k).t;
+               }
+            break;
          }
       }
 
-   fcloseall();
-   unlink(InputFileName);
+   return;
+   }
 
-   strcpy(InputFileName,TempFileName);
-   zTaskMessage(2,"Opening Input File '%s'\n",InputFileName);
-   if (!(InputStream = zOpen(InputFileName,O_readb))) return(2);
+/************************************************************
+**
+** Backward smoother over the ring
+**
+** Sweeps from the newest state, whose smoothed value is taken to be its
+** forward value, and writes the oldest states that are final. At the end
+** of the series (bEnd) every state is final.
+*/
+int SMOOTH(BOOL bEnd)
+   {
+   long k, lFinal;
 
-   zBuildFileName(M_tmpname,TempFileName);
-   zTaskMessage(2,"Opening Scratch File '%s'\n",TempFileName);
-   if (!(OutputStream = zOpen(TempFileName,O_writeb))) return(2);
-/*
-* Write out Y's
+   if (!lCount) return(0);
+
+   lFinal = SWEEP(lCount, FALSE, 0., 0., !bEnd);
+   if (bEnd) lFinal = lCount;
+
+   for (k = 0L; k < lFinal; ++k)
+      if (STATE(k).f < 1)
+         if (OUTPUT(SMOOTHED(k))) return(2);
+
+   lFirst = (lFirst + lFinal) % lRingSize;
+   lCount -= lFinal;
+
+   return(0);
+   }
+
+/************************************************************
+**
+** Move the ring to the spill file
 */
-   fseek(InputStream,-(long)sizeof(struct PREDICTSTRUCT),SEEK_END);
-   lOffset = ftell(InputStream);
+int SPILL()
+   {
+   long k;
 
-   fread(&PredictInput,sizeof(struct PREDICTSTRUCT),1,InputStream);
-   Tkp1 = KalmanOutput.t = PredictInput.t;
-   Ykp1 = KalmanOutput.y = PredictInput.x;
-   Pkp1 = PredictInput.x;
-   KalmanOutput.f = PredictInput.f;
-   fwrite(&KalmanOutput,sizeof(struct KALMANSTRUCT),1,OutputStream);
+   zBuildFileName(M_tmpname,SpillFileName);
+   zTaskMessage(2,"Opening Scratch File '%s'\n",SpillFileName);
+   if (!(SpillStream = zOpen(SpillFileName,O_writeb))) return(2);
 
-   while ((lOffset -= (long)sizeof(struct PREDICTSTRUCT)) >= 0L)
+   for (k = 0L; k < lCount; ++k)
       {
-      fseek(InputStream,lOffset,SEEK_SET);
-      fread(&PredictInput,sizeof(struct PREDICTSTRUCT),1,InputStream);
-      Tk = PredictInput.t;
-      Xk = PredictInput.x;
-      Pk = PredictInput.p;
-      Yk = Xk + Pk*(Ykp1 - Xk)/(Pk + Q*(Tkp1-Tk));
-      KalmanOutput.t = Tkp1 = Tk;
-      KalmanOutput.y = Ykp1 = Yk;
-      KalmanOutput.f = PredictInput.f;
-      fwrite(&KalmanOutput,sizeof(struct KALMANSTRUCT),1,OutputStream);
+      if (fwrite(&STATE(k),sizeof(struct PREDICTSTRUCT),1,SpillStream) != 1) return(2);
+      if (STATE(k).f < 1) ++lSpillOutputs;
       }
 
-   fcloseall();
-   unlink(InputFileName);
+   lSpilled = lCount;
+   lFirst = lCount = 0L;
+   bSpill = TRUE;
 
-   strcpy(InputFileName,TempFileName);
-   zTaskMessage(2,"Opening Input File '%s'\n",InputFileName);
-   if (!(InputStream = zOpen(InputFileName,O_readb))) return(2);
+   return(0);
+   }
 
-   zBuildFileName(M_tmpname,TempFileName);
-   zTaskMessage(2,"Opening Scratch File '%s'\n",TempFileName);
-   if (!(OutputStream = zOpen(TempFileName,O_writeb))) return(2);
+/************************************************************
+**
+** Backward smoother over the spill file
+**
+** The ring holds the newest states and the spill file the rest. Each
+** block is smoothed from its end and its output records are written
+** in place, after the records already written by SMOOTH.
+*/
+int UNSPILL()
+   {
+   double Tkp1 = 0., Ykp1 = 0.;
+   long k, m, lStart, lOffset, lOutputs;
+   short size;
+   BOOL bNewest = TRUE;
 
-   FileHeader.type = R_Data;
-   FileHeader.m = TM;
-   FileHeader.b = TB;
-   OutputRData.f = 0;
+   zTaskMessage(3,"Smoothing %ld Spilled States\n",lSpilled + lCount);
 
-   if (Zputhead(OutputStream,&FileHeader)) return(2);
-   fseek(InputStream,0L,SEEK_END);
-   lOffset = ftell(InputStream);
+   if (zStreamFlush(OUTSTREAM)) return(2);
+   lOffset = ftell(OutputStream);
+   lOutputs = lSpillOutputs;
+   size = Zsize(R_Data);
 
-   while ((lOffset -= (long)sizeof(struct KALMANSTRUCT)) >= 0L)
-      {
-      fseek(InputStream,lOffset,SEEK_SET);
-      fread(&KalmanInput,sizeof(struct KALMANSTRUCT),1,InputStream);
-      if (KalmanInput.f < 1)
+   lStart = lSpilled;
+   do {
+      SWEEP(lCount, !bNewest, Tkp1, Ykp1, FALSE);   // The ring is a plain buffer now, lFirst is 0
+      if (lCount)
          {
-         OutputRData.y = KalmanInput.y;
-         if (Zwrite(OutputStream,(char *)&OutputRData,R_Data)) return(2);
+         Tkp1 = pStates[0].t;
+         Ykp1 = pSmooth[0];
+         bNewest = FALSE;
+         }
+
+      for (k = m = 0L; k < lCount; ++k)
+         if (pStates[k].f < 1) pSmooth[m++] = pSmooth[k];
+
+      lOutputs -= m;
+      if (fseek(OutputStream,lOffset + lOutputs*(long)size,SEEK_SET)) return(2);
+      for (k = 0L; k < m; ++k)
+         if (OUTPUT(pSmooth[k])) return(2);
+      if (zStreamFlush(OUTSTREAM)) return(2);
+
+      lCount = Min(lRingSize,lStart);
+      lStart -= lCount;
+      if (lCount)
+         {
+         if (fseek(SpillStream,lStart*(long)sizeof(struct PREDICTSTRUCT),SEEK_SET)) return(2);
+         if (fread(pStates,sizeof(struct PREDICTSTRUCT),(size_t)lCount,SpillStream) != (size_t)lCount) return(2);
          }
       }
+   while (lCount);
+
+   Zclose(SpillStream);
+   SpillStream = (FILE *)NIL;
+   unlink(SpillFileName);
+   SpillFileName[0] = '\0';
 
-   fcloseall();
-   unlink(InputFileName);
    return(0);
    }
 
+/************************************************************
+**
+** Write a smoothed value to the output file
+*/
+int OUTPUT(double y)
+   {
+   struct RData OutputRData;
+
+   OutputRData.y = y;
+   OutputRData.f = 0;
+
+   return(zStreamWrite(OUTSTREAM,(char *)&OutputRData));
+   }
+
 /***************************************************************
 **
 ** Process ^C Interrupt
@@ -524,18 +912,30 @@ void BombOff(int a)
    {
    fcloseall();
    unlink(TempFileName);
-   if (ErrorFlag > 1) unlink(InputFileName); // Should always be a temporary file at this point.
+   if (SpillFileName[0]) unlink(SpillFileName);
    ZCatFiles((char*)NIL); // free catalog memory
    Zexit(a);
    }
 
 void fcloseall()
    {
-   if (InputStream) Zclose(InputStream);
-   InputStream = (FILE *)NIL;
+   if (INMAP) zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
+
+   if (OUTSTREAM) zStreamClose(OUTSTREAM);
+   OUTSTREAM = (struct ZSTREAM *)NIL;
 
    if (OutputStream) Zclose(OutputStream);
    OutputStream = (FILE *)NIL;
 
+   if (SpillStream) Zclose(SpillStream);
+   SpillStream = (FILE *)NIL;
+
+   if (pStates) free(pStates);
+   pStates = (struct PREDICTSTRUCT *)NIL;
+
+   if (pSmooth) free(pSmooth);
+   pSmooth = (double *)NIL;
+
    return;
    }
@@ -8,6 +8,15 @@
 
 #define far
 
+#ifdef __GNUC__
+#define NORETURN __attribute__((noreturn))   // Lets the optimizer know the code after a call is never reached
+#else
+#define NORETURN
+#endif
+
+#include <stdio.h>
+#include <sys/types.h>
+
 #include "atcs.h"
 
 #define LABELSIZE 128
@@ -56,6 +65,8 @@
 #define O_readt   (char)03
 #define O_writet  (char)04
 #define O_appendt (char)05
+#define O_mapb    (char)06   // Read only memory map, see zMapOpen
+#define O_mapcopyb (char)07  // Private copy-on-write memory map, see zMapOpen
 
 #define R_Data  0
 #define TR_Data 1
@@ -85,9 +96,82 @@ struct FILEHDR {char szTISAN[8];          // TISAN\0\r\n
                 char szTlabel[LABELSIZE]; // text...\0\r\n
                 char szYlabel[LABELSIZE]; // text...\0\r\n
                 short type;
+                char szVersion[3];        // "V1" when flags is valid. These 6 bytes were padding, so older files
+                BYTE flags;               //   have no version and no flags. See isSortedHeader and zSetSorted
+                BYTE check;               // ~flags
+                BYTE spare;
                 double m;
                 double b;};
 
+/*
+** FILEHDR flags
+*/
+#define ZSORTED 0x01                      // time labeled records are in time order
+
+/*
+** Buffered record stream used to move TISAN data records to and from disk in blocks
+** of ZBLOCKRECORDS records rather than one fread/fwrite per record.
+*/
+#define ZBLOCKRECORDS 65536L
+
+struct ZSTREAM {FILE *stream;    // TISAN file, positioned just past the header
+                short type;      // data type of the records
+                short size;      // bytes per record, Zsize(type)
+                short mode;      // O_readb or O_writeb
+                long  nRecords;  // records held in the block
+                long  iRecord;   // next record to hand out (read) or fill (write)
+                char *block;};
+
+/*
+** Memory map of a TISAN data file. The header and the data records are used
+** in place from the page cache instead of being read into allocated memory.
+*/
+struct ZMAP {char  *base;             // start of the mapping, which is the file header
+             size_t length;           // bytes mapped
+             short  mode;             // O_mapb or O_mapcopyb
+             BOOL   bMapped;          // FALSE if the file had to be read into memory instead
+             struct FILEHDR *header;  // file header in the mapping
+             short  type;             // data type of the records
+             short  size;             // bytes per record, Zsize(type)
+             long   nRecords;         // number of complete records in the file
+             char  *records;};        // first data record
+
+/*
+** A task running as a resident server, see goResident in pverbs.c
+*/
+struct RESIDENT {char szTask[16];          // task name, upper case
+                 pid_t pid;                // process id of the server
+                 int hRequest;             // pipe that sends the adverbs for a run
+                 int hReply;};             // pipe that returns the exit status of the run
+
+/*
+** One thread started by zRunThreads
+*/
+struct ZTHREAD {void (*pWork)(int, int, void *);   // work function
+                int iThread;                       // this thread's number, 0 to nThreads-1
+                int nThreads;                      // threads sharing the work
+                void *pData;};                     // data shared by all the threads
+
+/*
+** cos and sin of an evenly stepped phase, theta0 + k*dtheta, by rotation
+** instead of libm calls. See zRotorStart in tisanlib.c
+*/
+#define ZROTORSYNC 64      // steps between exact values from libm
+#define ZROTORTOL  1.0e-9  // largest recurrence error allowed before libm is used throughout
+
+struct ZROTOR {double c, s;             // cos and sin of the current phase
+               double dc, ds;           // cos and sin of the phase step
+               double theta0, dtheta;   // first phase and the step
+               long   k;                // steps taken since zRotorStart
+               int    nLeft;            // steps until the next exact value
+               double maxError;         // largest recurrence error found at an exact value
+               BOOL   bExact;};         // TRUE once the error was too large, libm is then used for every step
+
+#define ZLANES 4           // independent partial sums kept by zSum and zDot
+
+#define ZFFTBLOCK 65536L   // longest power of 2 FFT done in one piece (1 MB), longer ones are split, see zFFT
+#define ZFFTTILE  16       // block size of the FFT transposes
+
 struct DEVICES {char scrn;
                 char pntr;
                 char pltr;};
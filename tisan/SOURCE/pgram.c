@@ -15,6 +15,11 @@
 * CODE = 1 -> Scale by the variance
 * CODE = 2 -> Change to % Probability Level
 *
+* ITYPE = 0 -> Sum every frequency directly, O(N FACTOR)
+* ITYPE = 1 -> Fast periodogram of Press, W.H. and Rybicki, G.B. 1989,
+*              Astrophysical Journal, 338, p. 277, with the trig sums from
+*              the non-uniform FFT (zNUFFT) to within FASTTOL in TISAN.CFG
+*
 * TRANGE - Frequency range (not angular frequency)
 *
 * FACTOR - Default is number of iput points
@@ -23,9 +28,13 @@
 *
 * Defaults are 2pi/T to (2pi/min(t))/2 and N points
 *
-* The program allocates the memory needed using malloc.
-* If the input file is too large for a single allocation, then
-* it is processed from disk one data point at a time.
+* The input file is memory mapped, so the data are used in place
+* without being read into an allocated buffer first.
+*
+* The times and values are unpacked once into separate arrays. For each
+* frequency cos and sin are filled into two tables, from a rotation
+* recurrence (zRotorNext) when the samples are evenly spaced or from libm
+* otherwise, and the sums are then straight dot products (zSum, zDot).
 *
 * The infile of this task accepts wild cards.
 *
@@ -44,8 +53,10 @@
 #include "tisan.h"
 
 double tau(double);
-void pxw(double,double);
+double pxw(double,double);
+void FASTPGRAM(double OSTART, double SLOPE);
 void variance(void);
+void PHASES(double OMEGA, double OFFSET);
 
 char *dataBuffer = (char *)NIL;
 
@@ -55,14 +66,24 @@ struct FILEHDR FileHeader;
 long   NUMDAT, NDAT;
 short  FLAG=0;
 double DATA, TIME;
-BOOL bMemoryFile = TRUE;
 long NUMPNT;                                          // Number of points in the periodogram
 struct RData *pgramDataBuffer = (struct RData *)NIL;  // Data array for the periodogram
 long numDataRecords = 0L;
 
 double TWOPI;
 
-FILE *INSTR = (FILE *)NIL;
+BOOL bEVEN;                   // TRUE if the samples are evenly spaced, at TZERO + k*TSTEP
+double TZERO, TSTEP;
+struct ZROTOR ROTOR;
+
+double *WORK = (double *)NIL;   // One allocation for the arrays below, NUMDAT values each
+double *PTIME, *PDATA;          // Sample times and values less the mean, 0 if flagged
+double *PMASK;                  // 1 for good samples, 0 for flagged ones
+double *PCOS, *PSIN;            // cos and sin tables for one frequency
+short  *PFLAG = (short *)NIL;
+BOOL   bFLAGGED;                // TRUE if any sample is flagged
+
+struct ZMAP *INMAP = (struct ZMAP *)NIL;   // Input file is memory mapped, dataBuffer points into it
 FILE *OUTSTR = (FILE *)NIL;
 
 const char szTask[]="PGRAM";
@@ -71,7 +92,7 @@ int main(int argc, char *argv[])
    {
    long I;
    short  FFLAG=0;
-   double FIRST, OMEGA, SLOPE;
+   double FIRST=0., OMEGA, SLOPE;
    double OSTART, OSTOP, TCNT=0.;
    double SUM=0., SUM2=0., DELT=0., FT, DT;
    struct RData  *RDataPntr;
@@ -90,11 +111,18 @@ int main(int argc, char *argv[])
 
    if (zTaskInit(argv[0])) Zexit(1);     /* Initialize Task */
 
+   if ((ITYPE < 0) || (ITYPE > 1))
+      {
+      zTaskMessage(10,"Invalid ITYPE Specification\n");
+      Zexit(1);
+      }
+
    if (!OUTCLASS[0]) strcpy(OUTCLASS,"pgm");
 
    zBuildFileName(M_inname,INFILE);
    CatList = ZCatFiles(INFILE);    // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);  // Quit if there are none
+   zParallelFiles(CatList);        // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -109,9 +137,7 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,TMPFILE);
 
       zTaskMessage(2,"Opening Input File '%s'\n",INFILE);
-      if ((INSTR = zOpen(INFILE,O_readb)) == NULL) Zexit(1);
-
-      if (!Zgethead(INSTR,&FileHeader)) BombOff(1);
+      if ((INMAP = zMapOpen(INFILE,&FileHeader,O_mapb)) == NULL) Zexit(1);
       if ((FileHeader.type != R_Data) &&
           (FileHeader.type != TR_Data))
          {
@@ -122,7 +148,6 @@ int main(int argc, char *argv[])
 // Initialize in case we have wildcards in the file name
       N0 = 0.0;
       FLAG = 0;
-      bMemoryFile = TRUE;
       FFLAG = 0;
       TCNT = 0.;
       SUM = 0.;
@@ -130,49 +155,26 @@ int main(int argc, char *argv[])
       DELT = 0.;
 
    /*
-   ** We would like to be able to load the entire file into memory at once, however that might not be possible,
-   ** so allocate the full space and keep asking for less if the allocation fails. We will either get some
-   ** memory or we will error out with no bytes left to request.
+   ** The entire file is in the file map, so the records are used where they are.
    */
-      numDataRecords = countDataRecords(INSTR);
+      numDataRecords = INMAP->nRecords;
+      dataBuffer = INMAP->records;
 
-      do {
-         dataBuffer = (char *)malloc(numDataRecords * (long)Zsize(FileHeader.type));
-
-         if (!dataBuffer)
-            {
-            numDataRecords /= 2L;
-            bMemoryFile = FALSE;
-            }
-         }
-      while (!dataBuffer && numDataRecords);
-
-      if (!numDataRecords)
-         {
-         zTaskMessage(10,"Unable to allocate memory for input file.\n");
-         BombOff(1);
-         }
-      
-      if (bMemoryFile)
-         zTaskMessage(2,"Processing data file in memory.\n");
-      else
-         zTaskMessage(2,"Data file too large for available memory. Processing from file (which might take a while).\n");
+      zTaskMessage(2,"Processing data file in memory.\n");
          
       OSTART = TRANGE[0] * TWOPI;     /* Omega Start and Stop Ranges */
       OSTOP  = TRANGE[1] * TWOPI;
       
    /*
    ** Find Size of File, MEAN and SIGMA2.
-   ** File is loaded into dataBuffer and NUMDAT is set.
-   ** If the file is small, (i.e. it fit in memory on 1 read)
-   ** then dataBuffer and NUMDAT are not changed ever again.
+   ** dataBuffer and NUMDAT point at the file map and are not changed ever again.
    **
    */
       printPercentComplete(0L, 0L, 0);
 
-      while ((NDAT = zGetData(numDataRecords, INSTR, dataBuffer, FileHeader.type)))    //  Read in as much as possible at a time
+      if ((NDAT = numDataRecords))
          {
-         NUMDAT = NDAT;                               // NUMDAT should be the same as numDataRecords, but better safe than sorry.
+         NUMDAT = NDAT;
          RDataPntr =  (struct RData *)dataBuffer;
          TRDataPntr = (struct TRData *)dataBuffer;
 
@@ -217,9 +219,7 @@ int main(int argc, char *argv[])
                SUM2 += Square(DATA);
                }
             }
-         } /* End WHILE */
-
-      if (ferror(INSTR)) BombOff(1);
+         } /* End IF */
 
       if (N0 < 2.)
          {
@@ -257,15 +257,57 @@ int main(int argc, char *argv[])
 
       SLOPE = (OSTOP-OSTART)/(double)(NUMPNT - 1L);   /* Omega value slope */
 
-      for (I=0L; I<NUMPNT; ++I)
+      bEVEN = isEvenlySpaced(&FileHeader, dataBuffer, NUMDAT, &TZERO, &TSTEP);
+      zRotorInit(&ROTOR);
+      if (!bEVEN) zTaskMessage(2,"Samples are not evenly spaced, using cos() and sin().\n");
+
+      WORK  = (double *)malloc(5 * NUMDAT * sizeof(double));
+      PFLAG = (short *)malloc(NUMDAT * sizeof(short));
+      if (!WORK || !PFLAG)
          {
-         printPercentComplete(I, NUMPNT, PROGRESS);
+         zTaskMessage(10, "Unable to allocate %ld bytes for the work arrays.\n", (5 * sizeof(double) + sizeof(short)) * NUMDAT);
+         BombOff(1);
+         }
 
-         OMEGA = OSTART + (double)I * SLOPE;
-         pxw(tau(OMEGA),OMEGA);
-         } /* End For */
+      PTIME = WORK;
+      PDATA = PTIME + NUMDAT;
+      PMASK = PDATA + NUMDAT;
+      PCOS  = PMASK + NUMDAT;
+      PSIN  = PCOS  + NUMDAT;
 
-      printPercentComplete(I, NUMPNT, PROGRESS); // 100% Complete
+      if (zUnpackRecords(&FileHeader, dataBuffer, NUMDAT, PTIME, PDATA, (double *)NIL, PFLAG)) BombOff(1);
+
+      bFLAGGED = FALSE;
+      for (I=0L; I<NUMDAT; ++I)
+         {
+         if (PFLAG[I])
+            {
+            PMASK[I] = PDATA[I] = 0.;
+            bFLAGGED = TRUE;
+            }
+         else
+            {
+            PMASK[I] = 1.;
+            PDATA[I] -= MEAN;
+            }
+         }
+
+      if (ITYPE == 1)
+         FASTPGRAM(OSTART, SLOPE);
+      else
+         {
+         for (I=0L; I<NUMPNT; ++I)
+            {
+            printPercentComplete(I, NUMPNT, PROGRESS);
+
+            OMEGA = OSTART + (double)I * SLOPE;
+            pgramDataBuffer[I].y = pxw(tau(OMEGA),OMEGA);
+            } /* End For */
+
+         printPercentComplete(I, NUMPNT, PROGRESS); // 100% Complete
+
+         if (bEVEN) zRotorReport(&ROTOR, 1);
+         }
 
       zTaskMessage(2,"Scaling periodogram...\n");
 
@@ -294,74 +336,53 @@ int main(int argc, char *argv[])
 
 /*********************************************************************
 *
-* Function to Calculate Tau's
-*
+* Fill the cos and sin tables with the phases OMEGA*(t - OFFSET)
+* Flagged samples get 0 in both tables so they drop out of the sums.
 */
-double tau(double OMEGA)
+void PHASES(double OMEGA, double OFFSET)
    {
-   double ARG, V1=0.,V2=0.,TCNT=0.;
+   double ARG;
    long J;
-   struct RData  *RDataPntr;
-   struct TRData *TRDataPntr;
 
-   RDataPntr =  (struct RData *)dataBuffer;
-   TRDataPntr = (struct TRData *)dataBuffer;
-   OMEGA *= 2.;
-
-   if (bMemoryFile)        /* Data is memory resident */
+   if (bEVEN)
+      {
+      zRotorStart(&ROTOR, OMEGA * (TZERO - OFFSET), OMEGA * TSTEP);
+      zRotorFill(&ROTOR, NUMDAT, PCOS, PSIN);
+      }
+   else
       {
       for (J=0L; J<NUMDAT; ++J)
          {
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               TIME = TCNT * FileHeader.m + FileHeader.b;
-               ++TCNT;
-               FLAG = RDataPntr->f;
-               break;
-            case TR_Data:
-               TIME = TRDataPntr->t;
-               ++TRDataPntr;
-               break;
-            }
-         if (!FLAG)
-            {
-            ARG = OMEGA*TIME;
-            V1 += sin(ARG);
-            V2 += cos(ARG);
-            }
-         }  /* End For */
-      }  /* End IF */
-   else                    /* Read data from disk */
+         ARG = OMEGA * (PTIME[J] - OFFSET);
+         PCOS[J] = cos(ARG);
+         PSIN[J] = sin(ARG);
+         }
+      }
+
+   if (bFLAGGED)
       {
-      if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) BombOff(1);
-      while (Zread(INSTR,dataBuffer,FileHeader.type))
-         {
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               TIME = TCNT * FileHeader.m + FileHeader.b;
-               ++TCNT;
-               FLAG = RDataPntr->f;
-               break;
-            case TR_Data:
-               TIME = TRDataPntr->t;
-               break;
-            }
-         if (!FLAG)
-            {
-            ARG = OMEGA*TIME;
-            V1 += sin(ARG);
-            V2 += cos(ARG);
-            }
-         } /* End WHILE */
-      if (ferror(INSTR))
+      for (J=0L; J<NUMDAT; ++J)
          {
-         zError();
-         BombOff(1);
+         PCOS[J] *= PMASK[J];
+         PSIN[J] *= PMASK[J];
          }
-      }    /* End ELSE */
-   return(atan2(V1,V2)/OMEGA);
+      }
+
+   return;
+   }
+
+/*********************************************************************
+*
+* Function to Calculate Tau's
+*
+*/
+double tau(double OMEGA)
+   {
+   OMEGA *= 2.;
+
+   PHASES(OMEGA, 0.);
+
+   return(atan2(zSum(PSIN, NUMDAT), zSum(PCOS, NUMDAT))/OMEGA);
    }
 
 /*********************************************************************
@@ -369,87 +390,91 @@ double tau(double OMEGA)
 * Function to Calculate Periodogram
 *
 */
-void pxw(double TAUV, double OMEGA)
+double pxw(double TAUV, double OMEGA)
    {
-   double V1=0., V2=0., V3=0., V4=0., V, ARG, TCNT=0.;
-   long J;
-   struct RData  *RDataPntr;
-   struct TRData *TRDataPntr;
-   static long lIndex = 0L;
+   double V1, V2, V3, V4;
+
+   PHASES(OMEGA, TAUV);
+
+   V1 = zDot(PDATA, PCOS, NUMDAT);
+   V3 = zDot(PCOS,  PCOS, NUMDAT);
+   V2 = zDot(PDATA, PSIN, NUMDAT);
+   V4 = zDot(PSIN,  PSIN, NUMDAT);
 
-   RDataPntr =  (struct RData *)dataBuffer;
-   TRDataPntr = (struct TRData *)dataBuffer;
+   return((V1*(V1/V3) + V2*(V2/V4))/2.);
+   }
 
-   if (bMemoryFile)
+/*********************************************************************
+*
+* The whole periodogram at once. With
+*
+*    C - iS   = sum of (y - MEAN) exp(-i w t)
+*    C2 - iS2 = sum of exp(-i 2w t)
+*
+* from two non-uniform FFTs, tan(2 w tau) = S2/C2 and the four sums of
+* pxw follow from rotating C, S, C2 and S2 by w tau, as in Press and
+* Rybicki. A few frequencies are then done directly to check the result.
+*/
+void FASTPGRAM(double OSTART, double SLOPE)
+   {
+   struct complex *pSum1, *pSum2;
+   double tolerance = zFastTolerance();
+   double C, S, C2, S2, H, A, V1, V2, V3, V4, OMEGA;
+   double error, maxError = 0., maxPower = 0.;
+   long I;
+
+   pSum1 = (struct complex *)malloc(NUMPNT * sizeof(struct complex));
+   pSum2 = (struct complex *)malloc(NUMPNT * sizeof(struct complex));
+   if (!pSum1 || !pSum2)
       {
-      for (J=0L; J<NUMDAT; ++J)
-         {
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               TIME = TCNT * FileHeader.m + FileHeader.b;
-               DATA = RDataPntr->y - MEAN;
-               FLAG = RDataPntr->f;
-               ++RDataPntr;
-               ++TCNT;
-               break;
-            case TR_Data:
-               TIME = TRDataPntr->t;
-               DATA = TRDataPntr->y - MEAN;
-               ++TRDataPntr;
-               break;
-            }
-         if (!FLAG)
-            {
-            ARG = OMEGA * (TIME - TAUV);
-            V = cos(ARG);
-            V1 += DATA * V;
-            V3 += Square(V);
-            V = sin(ARG);
-            V2 += DATA * V;
-            V4 += Square(V);
-            }
-         }  /* End For */
-      } /* End IF */
-   else
+      zTaskMessage(10,"Unable to allocate memory for the fast periodogram.\n");
+      BombOff(1);
+      }
+
+   zTaskMessage(2,"Non-uniform FFT of %ld points to %ld frequencies.\n", (long)N0, NUMPNT);
+
+   if (zNUFFT(PTIME, PDATA, (double *)NIL, NUMDAT, OSTART / TWOPI, SLOPE / TWOPI, NUMPNT, tolerance, pSum1) ||
+       zNUFFT(PTIME, PMASK, (double *)NIL, NUMDAT, 2. * OSTART / TWOPI, 2. * SLOPE / TWOPI, NUMPNT, tolerance, pSum2))
       {
-      if (!Zgethead(INSTR,(struct FILEHDR *)NULL)) BombOff(1);
-      while (Zread(INSTR,dataBuffer,FileHeader.type))
-         {
-         switch (FileHeader.type)
-            {
-            case R_Data:
-               TIME = TCNT * FileHeader.m + FileHeader.b;
-               DATA = RDataPntr->y - MEAN;
-               FLAG = RDataPntr->f;
-               ++TCNT;
-               break;
-            case TR_Data:
-               TIME = TRDataPntr->t;
-               DATA = TRDataPntr->y - MEAN;
-               break;
-            }
-         if (!FLAG)
-            {
-            ARG = OMEGA * (TIME - TAUV);
-            V = cos(ARG);
-            V1 += DATA * V;
-            V3 += Square(V);
-            V = sin(ARG);
-            V2 += DATA * V;
-            V4 += Square(V);
-            }
-         } /* End While */
-      if (ferror(INSTR))
-         {
-         zError();
-         BombOff(1);
-         }
-      } /* End ELSE */
+      zTaskMessage(10,"Unable to allocate memory for the fast transform grid.\n");
+      BombOff(1);
+      }
+
+   for (I=0L; I<NUMPNT; ++I)
+      {
+      C  =  pSum1[I].x;
+      S  = -pSum1[I].y;
+      C2 =  pSum2[I].x;
+      S2 = -pSum2[I].y;
 
-   pgramDataBuffer[lIndex].y = (V1*(V1/V3) + V2*(V2/V4))/2.;
+      A = atan2(S2, C2);               // 2 w tau
+      H = sqrt(Square(C2) + Square(S2));
 
-   ++lIndex;
+      V1 = C * cos(A / 2.) + S * sin(A / 2.);
+      V2 = S * cos(A / 2.) - C * sin(A / 2.);
+      V3 = (N0 + H) / 2.;
+      V4 = (N0 - H) / 2.;
+
+      pgramDataBuffer[I].y = (V1*(V1/V3) + V2*(V2/V4))/2.;
+      maxPower = Max(maxPower, pgramDataBuffer[I].y);
+      }
+/*
+** Check against the direct sums, away from the ends of the range
+*/
+   for (I=NUMPNT/4L; I<NUMPNT; I+=Max(NUMPNT/4L, 1L))
+      {
+      OMEGA = OSTART + (double)I * SLOPE;
+      error = fabs(pxw(tau(OMEGA),OMEGA) - pgramDataBuffer[I].y);
+      maxError = Max(maxError, error);
+      }
+
+   if (maxPower > 0.) maxError /= maxPower;
+   zTaskMessage(3,"Largest difference from the direct sums %lG of the highest peak\n", maxError);
+   if (maxError > tolerance)
+      zTaskMessage(9,"** WARNING ** Fast periodogram is off by more than FASTTOL = %lG\n", tolerance);
+
+   free(pSum1);
+   free(pSum2);
 
    return;
    }
@@ -521,17 +546,22 @@ void BombOff(int a)
 
 void fcloseall(void)
    {
-   if (INSTR) Zclose(INSTR);
-   INSTR = (FILE *)NIL;
+   if (INMAP) zMapClose(INMAP);
+   INMAP = (struct ZMAP *)NIL;
    
    if (OUTSTR) Zclose(OUTSTR);
    OUTSTR = (FILE *)NIL;
 
    if (pgramDataBuffer) free(pgramDataBuffer);
    pgramDataBuffer = (struct RData *)NIL;
+
+   if (WORK) free(WORK);
+   WORK = (double *)NIL;
+
+   if (PFLAG) free(PFLAG);
+   PFLAG = (short *)NIL;
    
-   if (dataBuffer) free(dataBuffer);
-   dataBuffer = (char *)NIL;
+   dataBuffer = (char *)NIL;           // Pointed into the file map
    
    return;
    }
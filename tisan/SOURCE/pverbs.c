@@ -15,6 +15,9 @@
 #include <math.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #include "tisan.h"
 
@@ -24,6 +27,9 @@
 
 struct DEVICES HARDWARE;
 
+struct RESIDENT Residents[MAXRESIDENT];   // Tasks started in resident mode
+int nResidents = 0;
+
 int decodeHelpText(PSTR inFileName, PSTR matchString);
 int displayHelpText(PSTR inFileName, PSTR outFileName, BOOL bFindExactMatch);
 
@@ -43,6 +49,10 @@ short  SystemCall(PSTR pCommand, PSTR pArgs);
 
 short  Setwin(void);
 short  Go(void);
+BOOL   isResidentMode(void);
+int    goResident(PSTR taskName, PSTR path);
+struct RESIDENT *startResident(PSTR taskName, PSTR path);
+int    stopResident(struct RESIDENT *pResident);
 short  Put(void);
 short  Get(void);
 short  Rename(void);
@@ -167,7 +177,10 @@ short Go()
 
    makePath(path,TisanDrive,TisanDir,JPNTR,(PSTR)NIL);
 
-   ERRFLAG = system(path);
+   if (isResidentMode())
+      ERRFLAG = goResident(JPNTR,path);
+   else
+      ERRFLAG = system(path);
 
    if (ERRFLAG < 0)
       {
@@ -195,6 +208,187 @@ short Go()
    return(ERRFLAG);
    }
 
+/*********************************************************************
+*
+* Resident mode is set by RESIDENT=YES in TISAN.CFG. TISAN.CFG is
+* only checked on the first GO.
+*
+*/
+BOOL isResidentMode()
+   {
+   static short residentMode = -1;      // -1 until TISAN.CFG has been checked
+   char szValue[16];
+
+   if (residentMode < 0)
+      {
+      if (getConfigString("RESIDENT", sizeof(szValue), szValue)) // TRUE if the key was found
+         residentMode = (toupper(szValue[0]) == 'Y') || (toupper(szValue[0]) == 'T') || (szValue[0] == '1');
+      else
+         residentMode = 0;
+      }
+
+   return((BOOL)residentMode);
+   }
+
+/*********************************************************************
+*
+* Run a task in resident mode.
+* The first GO for a task starts it as a server (see zTaskServe) that
+* stays running until TISAN exits. Every GO then sends the adverbs down
+* a pipe and the server forks a copy of itself to do the run, which
+* avoids the shell, the exec and reading the inputs file each time.
+* The inputs file is still written so GET and the tasks see the same adverbs.
+*
+* Returns the wait status of the run, the same as system() would.
+*/
+int goResident(PSTR taskName, PSTR path)
+   {
+   struct RESIDENT *pResident = (struct RESIDENT *)NIL;
+   char *pAdverbs = (char *)NIL;
+   size_t size = 0;
+   long length;
+   int i, status = 1 << 8, tries;
+   BOOL bSent;
+   FILE *pFile;
+
+   if (!(pFile = open_memstream(&pAdverbs, &size)))
+      {
+      zError();
+      return(status);
+      }
+
+   zWriteAdverbs(pFile);
+   fclose(pFile);
+   length = (long)size;
+
+   fflush(stdout);
+
+   for (tries = 0; tries < 2; ++tries)         // A server that has gone away is restarted once
+      {
+      for (i = 0, pResident = (struct RESIDENT *)NIL; (i < nResidents) && !pResident; ++i)
+         {
+         if (!strcmp(Residents[i].szTask, taskName)) pResident = &Residents[i];
+         }
+
+      if (!pResident && !(pResident = startResident(taskName, path))) break;
+
+      bSent = !zWritePipe(pResident->hRequest, &length, sizeof(length)) &&
+              !zWritePipe(pResident->hRequest, pAdverbs, size);
+
+      if (!bSent || zReadPipe(pResident->hReply, &status, sizeof(status)))  // The server has gone away
+         {
+         status = stopResident(pResident);
+
+         if (WIFEXITED(status) && (WEXITSTATUS(status) == 127))
+            {
+            printf("Task '%s' Not Found\n",taskName);
+            break;
+            }
+
+         printf("%sResident task '%s' stopped unexpectedly\n",MSP[1],taskName);
+         status = 1 << 8;
+
+         if (!bSent) continue;                  // Nothing was run, so try again with a new server
+         }
+
+      break;
+      }
+
+   free(pAdverbs);
+
+   return(status);
+   }
+
+/*********************************************************************
+*
+* Start a task as a resident server.
+* Returns NIL if there is no room for another resident task or the
+* pipes cannot be made.
+*/
+struct RESIDENT *startResident(PSTR taskName, PSTR path)
+   {
+   struct RESIDENT *pResident;
+   int hRequest[2], hReply[2];
+   char szPipes[32];
+
+   if (nResidents >= MAXRESIDENT)
+      {
+      printf("%sToo many resident tasks, stopping '%s'\n",MSP[1],Residents[0].szTask);
+      stopResident(&Residents[0]);
+      }
+
+   if (pipe(hRequest))
+      {
+      zError();
+      return((struct RESIDENT *)NIL);
+      }
+
+   if (pipe(hReply))
+      {
+      zError();
+      close(hRequest[0]);
+      close(hRequest[1]);
+      return((struct RESIDENT *)NIL);
+      }
+
+   signal(SIGPIPE, SIG_IGN);                    // A write to a server that has exited returns an error instead
+
+   pResident = &Residents[nResidents];
+   strncpy(pResident->szTask, taskName, sizeof(pResident->szTask) - 1);
+   pResident->szTask[sizeof(pResident->szTask) - 1] = NUL;
+
+   if ((pResident->pid = fork()) == 0)
+      {
+      close(hRequest[1]);
+      close(hReply[0]);
+      sprintf(szPipes, "%d,%d", hRequest[0], hReply[1]);
+      setenv(RESIDENTENV, szPipes, 1);
+      signal(SIGPIPE, SIG_DFL);
+      execl(path, path, (char *)NIL);
+      _exit(127);                               // Same as the shell when the task is not found
+      }
+
+   close(hRequest[0]);
+   close(hReply[1]);
+
+   if (pResident->pid < 0)
+      {
+      zError();
+      close(hRequest[1]);
+      close(hReply[0]);
+      return((struct RESIDENT *)NIL);
+      }
+
+   pResident->hRequest = hRequest[1];
+   pResident->hReply   = hReply[0];
+
+   fcntl(pResident->hRequest, F_SETFD, FD_CLOEXEC);   // Other servers must not hold these open
+   fcntl(pResident->hReply,   F_SETFD, FD_CLOEXEC);
+
+   ++nResidents;
+
+   return(pResident);
+   }
+
+/*********************************************************************
+*
+* Stop a resident server and remove it from the list.
+* Returns the wait status of the server.
+*/
+int stopResident(struct RESIDENT *pResident)
+   {
+   int status = 0;
+
+   close(pResident->hRequest);                 // The server exits when it sees the end of the request pipe
+   close(pResident->hReply);
+
+   if (waitpid(pResident->pid, &status, 0) < 0) status = 1 << 8;
+
+   *pResident = Residents[--nResidents];       // Keep the list packed
+
+   return(status);
+   }
+
 /*********************************************************************
 * Pseudo Verb Put
 *
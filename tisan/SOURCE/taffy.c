@@ -6,9 +6,10 @@
 *  Task TAFFY
 *
 * This code processes data in a single monolithic memory block.
-* All data are first loaded into allocated memory.
+* The input file is memory mapped copy-on-write, so all the data are in memory without first
+* being read into an allocated buffer, and changes made in memory never reach the input file.
 * Working from memory is faster than processing one record at a time from disk, but it requires
-* that everything fit.
+* that everything fit in the address space.
 *
 * The default outclass is tfy
 *
@@ -31,7 +32,6 @@ double processRealData(double timeVal, double Rval);
 struct complex processComplexData(double timeVal, struct complex Zval);
 void readAllDataRecords(void);
 void writeAllDataRecords(void);
-void allocateMemoryBuffer(void);
 
 char infileName[_MAX_PATH], outfileName[_MAX_PATH], tempfileName[_MAX_PATH];
 
@@ -42,7 +42,7 @@ struct XData  *XDataPntr;
 struct TXData *TXDataPntr;
 struct XData  XDataOut;
 
-FILE *infileStream  = (FILE *)NIL;
+struct ZMAP *inputMap = (struct ZMAP *)NIL;
 FILE *outfileStream = (FILE *)NIL;
 
 const char szTask[]="TAFFY";
@@ -76,6 +76,7 @@ int main(int argc, char *argv[])
    zBuildFileName(M_inname,infileName);
    CatList = ZCatFiles(infileName);   // Find Matching Files for the input file specification
    if (CatList->N == 0) Zexit(1);     // Quit if there are none
+   zParallelFiles(CatList);           // Spread the files over worker processes (WORKERS in TISAN.CFG)
 
    for (iwc = 0, pWild = CatList->pList;
         (iwc < CatList->N) && !ERRFLAG;
@@ -90,10 +91,8 @@ int main(int argc, char *argv[])
       zBuildFileName(M_tmpname,tempfileName);
 
       zTaskMessage(2,"Opening Input File '%s'\n",infileName);
-      infileStream = zOpen(infileName,O_readb);
-      if (!infileStream) Zexit(1);
-      
-      if (!Zgethead(infileStream,&FileHeader)) BombOff(1);
+      inputMap = zMapOpen(infileName,&FileHeader,O_mapcopyb);
+      if (!inputMap) Zexit(1);
 
       switch (FileHeader.type)
          {
@@ -110,7 +109,6 @@ int main(int argc, char *argv[])
       zTaskMessage(2,"Opening Scratch File '%s'\n",tempfileName);
       if ((outfileStream = zOpen(tempfileName,O_writeb)) == NULL) BombOff(1);
 
-      allocateMemoryBuffer();
       readAllDataRecords();
       processData();
       writeAllDataRecords();
@@ -204,22 +202,21 @@ struct complex processComplexData(double timeVal, struct complex Zval)
    }
 
 /*
-** Read in all the data records to the allocated memory (we hope)
+** All the data records are already in the file map, so just point at them.
+** The mapping is released in fcloseall().
 */
 void readAllDataRecords()
    {
-   size_t recordsRead;
+   numDataRecords = numberOfDataRecordsRead = inputMap->nRecords;
 
-   if (!Zgethead(infileStream,&FileHeader)) BombOff(1); // Rewind the file back to the start of the data
-
-   recordsRead = fread(dataBuffer, (size_t)Zsize(FileHeader.type), (size_t)numDataRecords, infileStream);
-
-   if (recordsRead != (size_t)numDataRecords)
+   if (!numDataRecords)
       {
-      zTaskMessage(10,"Error reading input file. Expected %ld records but only read %ld\n", numDataRecords, recordsRead);
+      zTaskMessage(10,"There appear to be zero records in this input file.\n");
       BombOff(1);
       }
-      
+
+   dataBuffer = inputMap->records;
+
    return;   
    }
 
@@ -242,34 +239,6 @@ void writeAllDataRecords()
 
    return;   
    }
-
-/*
-**
-** Allocate the memory block
-** Memory is freed in fcloseall()
-*/
-void allocateMemoryBuffer()
-   {
-   numDataRecords = countDataRecords(infileStream);
-
-   if (!numDataRecords)
-      {
-      zTaskMessage(10,"There appear to be zero records in this input file.\n");
-      BombOff(1);
-      }
-   else
-      {
-      dataBuffer = (char *)malloc(numDataRecords * (long)Zsize(FileHeader.type));
-
-      if (!numDataRecords)
-         {
-         zTaskMessage(10,"Unable to allocate memory for input file.\n");
-         BombOff(1);
-         }
-      }
-
-   return;
-   }
 
 /***************************************************************
 **
@@ -298,14 +267,12 @@ void BombOff(int a)
 
 void fcloseall()
    {
-   if (infileStream) Zclose(infileStream);
-   infileStream = (FILE *)NIL;
+   if (inputMap) zMapClose(inputMap);
+   inputMap = (struct ZMAP *)NIL;
+   dataBuffer = (char *)NIL;           // Pointed into the file map
 
    if (outfileStream) Zclose(outfileStream);
    outfileStream = (FILE *)NIL;
-
-   if (dataBuffer) free(dataBuffer);
-   dataBuffer = (char *)NIL;
    
    return;
    }
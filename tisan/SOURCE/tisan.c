@@ -218,7 +218,7 @@ int main(int argc, char *argv[])
 */
 short PROCESS()
    {
-   short I, F1=0, F2=0, F3;
+   short I, F1=0, F2=0, F3=0;
    unsigned short LEN;
 
    IPNTR = ILINE;
@@ -650,7 +650,7 @@ short SIMPLE(short N, short F1, short IDX)
 */
 double GETVAL(char *PNTR, short I, short N)
    {
-   double D;
+   double D=0.;
 
    switch (N)
       {
@@ -734,7 +734,7 @@ void PUTVAL(char *PNTR, short I, short N, double D)
 */
 short ADVERB(short N)
    {
-   double D;
+   double D=0.;
    char *P;
    short IDX, I, M, F1;
 
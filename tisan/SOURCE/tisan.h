@@ -23,6 +23,13 @@
 #define INPUTSEXT ".INP"
 #define RUNDIREXT "run"
 
+/*
+** Environment variable holding the pipe handles of a resident task, see zTaskServe.
+** The RESIDENT key in TISAN.CFG turns resident mode on.
+*/
+#define RESIDENTENV "TISAN_RESIDENT"
+#define MAXRESIDENT 32  // Number of tasks that can be resident at once
+
 /*
 ** Define Functions
 */
@@ -33,8 +40,13 @@ void initializeAdverbArrays(void);
 BOOL displayTaskInputs(char *); // INPUTS()
 
 BOOL  zTaskInit(PSTR);
+BOOL  zTaskServe(BOOL *);
+BOOL  zReadPipe(int, void *, size_t);
+BOOL  zWritePipe(int, void *, size_t);
 BOOL  zGetAdverbs(PSTR);
 BOOL  zPutAdverbs(PSTR);
+BOOL  zReadAdverbs(FILE *);
+BOOL  zWriteAdverbs(FILE *);
 PSTR  zBuildFileName(short, PSTR);
 long zGetData(long, FILE *,char *,short);
 long zPutData(long,FILE *,char *,short);
@@ -52,17 +64,55 @@ short           zNameOutputFile(char *,char *);
 char           *Zread(FILE *,char *,short);
 short           Zwrite(FILE *,char *,short);
 short           Zsize(short);
+
+struct ZSTREAM  *zStreamOpen(FILE *, short, short);
+long            zStreamGetBlock(struct ZSTREAM *, char **);
+char           *zStreamRead(struct ZSTREAM *, char *);
+short           zStreamWrite(struct ZSTREAM *, char *);
+short           zStreamFlush(struct ZSTREAM *);
+short           zStreamRewind(struct ZSTREAM *);
+short           zStreamClose(struct ZSTREAM *);
+
+struct ZMAP     *zMapOpen(PSTR, struct FILEHDR *, short);
+short           zMapClose(struct ZMAP *);
 struct CATSTRUCT *ZCatFiles(char *);   // Used to support wild cards file names
+int zParallelFiles(struct CATSTRUCT *); // Spread the files of a catalog over worker processes
+int zParallelCatalog(struct CATSTRUCT *); // The same, even with OUTNAME set
+BOOL isWorker(void);
+int zWaitWorkers(int);
+int zThreadCount(void);                 // THREADS in TISAN.CFG
+long zMemoryBudget(void);               // MEMORY in TISAN.CFG, bytes
+BOOL zRunThreads(int, void (*)(int, int, void *), void *);
+void zRotorInit(struct ZROTOR *);        // Phase recurrence used in place of cos() and sin()
+void zRotorStart(struct ZROTOR *, double, double);
+void zRotorNext(struct ZROTOR *);
+void zRotorReport(struct ZROTOR *, int);
+void zRotorFill(struct ZROTOR *, long, double *, double *);
+BOOL isEvenlySpaced(struct FILEHDR *, char *, long, double *, double *);
+BOOL zUnpackRecords(struct FILEHDR *, char *, long, double *, double *, double *, short *);
+double zSum(double *, long);
+double zDot(double *, double *, long);
+BOOL zFFT(double *, long, int);           // In place complex FFT, any length
+BOOL zRealFFT(double *, long, int);       // Real input FFT, N/2+1 complex values out
+BOOL zRealIFFT(double *, long, int);      // Its inverse, conjugate symmetric input to N real values
+BOOL isSmoothLength(long);
+long zSmoothLength(long);
+double zFastTolerance(void);              // FASTTOL in TISAN.CFG
+BOOL zNUFFT(double *, double *, double *, long, double, double, long, double, struct complex *);
 
 void  BEEP(void);
 
-void Zexit(int N);
+void Zexit(int N) NORETURN;
 
 BOOL isTisanHeader(struct FILEHDR *pHeader);
+BOOL isSortedHeader(struct FILEHDR *pHeader);
+void zSetSorted(struct FILEHDR *pHeader, BOOL bSorted);
+long zFindTime(FILE *stream, struct FILEHDR *pHeader, double time);
 void setHeaderText(struct FILEHDR *pHeader);
 void getHeaderText(struct FILEHDR *pHeader);
 
 long countDataRecords(FILE *stream);
+long zRecordCount(long dataBytes, short dataType);
 
 BOOL extractValues(char *BUFFER, struct FILEHDR *fileHeader, double TCNT, double *TIME, double *Rval, struct complex *Zval, short *FLAG);
 BOOL insertValues(char *BUFFER, struct FILEHDR *fileHeader, double TIME, double Rval, struct complex Zval, short FLAG);
@@ -129,7 +179,7 @@ void printPercentComplete(long y, long N, short printPercentComplete);
 ** Functions used by all tasks to deal with errors and termination requests
 */
 void BREAKREQ(int a);
-void BombOff(int a);
+void BombOff(int a) NORETURN;
 void FPEERROR(int a);
 
 
@@ -15,6 +15,7 @@
 ** BOOL iseven(double val)
 ** double unbiasedRound(double val)
 ** long countDataRecords(FILE *stream)
+** long zRecordCount(long dataBytes, short dataType)
 ** BOOL insertValues(char *BUFFER, struct FILEHDR *fileHeader, double TIME, double Rval, struct ** complex Zval, short FLAG)
 ** BOOL extractValues(char *BUFFER, struct FILEHDR *fileHeader, double TCNT, double *TIME, double *Rval, struct complex *Zval, short *FLAG)
 ** 
@@ -23,12 +24,20 @@
 ** PSTR parseString(FILE* pFile, int N, char szStr[N])
 ** PSTR parseAdverb(FILE* pFile, int N, char szAdverb[N])
 ** BOOL zGetAdverbs(PSTR pTaskName)
+** BOOL zReadAdverbs(FILE *pFile)
+** BOOL zWriteAdverbs(FILE *pFile)
 ** BOOL zPutAdverbs(PSTR pTaskName)
 ** short Zputhead(FILE *stream, struct FILEHDR *pHeader)
 ** struct FILEHDR *Zgethead(FILE *INSTR, struct FILEHDR *HeadStruct)
 ** BOOL isTisanHeader(struct FILEHDR *pHeader)
+** BOOL isSortedHeader(struct FILEHDR *pHeader)
+** void zSetSorted(struct FILEHDR *pHeader, BOOL bSorted)
+** long zFindTime(FILE *stream, struct FILEHDR *pHeader, double time)
 ** void setHeaderText(struct FILEHDR *pHeader)
 ** void getHeaderText(struct FILEHDR *pHeader)
+** BOOL zReadPipe(int hPipe, void *pData, size_t N)
+** BOOL zWritePipe(int hPipe, void *pData, size_t N)
+** BOOL zTaskServe(BOOL *pbError)
 ** BOOL zTaskInit(PSTR Argv0)
 ** short zNameOutputFile(char *OUTFILE, char *TMPFILE)
 ** void zError()
@@ -37,6 +46,15 @@
 ** short Zwrite(FILE *OUTSTR, char *DATA, short dataType)
 ** char *Zread(FILE *INSTR, char *DATA, short dataType)
 ** short Zsize(short dataType)
+** struct ZSTREAM *zStreamOpen(FILE *stream, short dataType, short mode)
+** long zStreamGetBlock(struct ZSTREAM *pStream, char **ppRecords)
+** char *zStreamRead(struct ZSTREAM *pStream, char *DATA)
+** short zStreamWrite(struct ZSTREAM *pStream, char *DATA)
+** short zStreamFlush(struct ZSTREAM *pStream)
+** short zStreamRewind(struct ZSTREAM *pStream)
+** short zStreamClose(struct ZSTREAM *pStream)
+** struct ZMAP *zMapOpen(PSTR fileName, struct FILEHDR *pHeader, short type)
+** short zMapClose(struct ZMAP *pMap)
 ** void BEEP()
 ** void Zexit(int N)
 
@@ -84,6 +102,29 @@
 ** void displayInputs(unsigned char InputsAdverbToken, FILE *IndexTableStream)
 ** BOOL displayTaskInputs(char *cPointer)
 ** struct CATSTRUCT *ZCatFiles(char* pPath)
+** int zParallelFiles(struct CATSTRUCT *pCatList)
+** int zParallelCatalog(struct CATSTRUCT *pCatList)
+** BOOL isWorker(void)
+** int zWaitWorkers(int N)
+** int zThreadCount(void)
+** long zMemoryBudget(void)
+** BOOL zRunThreads(int nThreads, void (*pWork)(int iThread, int nThreads, void *pData), void *pData)
+** void zRotorInit(struct ZROTOR *pRotor)
+** void zRotorStart(struct ZROTOR *pRotor, double theta0, double dtheta)
+** void zRotorNext(struct ZROTOR *pRotor)
+** void zRotorReport(struct ZROTOR *pRotors, int N)
+** void zRotorFill(struct ZROTOR *pRotor, long N, double *pCos, double *pSin)
+** BOOL isEvenlySpaced(struct FILEHDR *pHeader, char *records, long nRecords, double *pT0, double *pDt)
+** BOOL zUnpackRecords(struct FILEHDR *pHeader, char *records, long N, double *pTime, double *pReal, double *pImag, short *pFlag)
+** double zSum(double *pA, long N)
+** double zDot(double *pA, double *pB, long N)
+** BOOL zFFT(double *pData, long N, int iSign)
+** BOOL zRealFFT(double *pData, long N, int iSign)
+** BOOL zRealIFFT(double *pData, long N, int iSign)
+** BOOL isSmoothLength(long N)
+** long zSmoothLength(long N)
+** double zFastTolerance(void)
+** BOOL zNUFFT(double *pTime, double *pReal, double *pImag, long N, double nu0, double dNu, long nFreq, double tolerance, struct complex *pOut)
 ** PSTR zBuildFileName(short TYPE, PSTR cPointer)
 ** short zMessage(short level, const char *format, ...)
 ** short zTaskMessage(short level, const char *format, ...)
@@ -103,11 +144,32 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "tisan.h"
 
 char const szTisanSignature[] = "TISAN\0\r\n";    // Must be 8 bytes plus the nul
 char const szEndBytes[] = "\0\r\n";               // Must be 3 bytes plus the nul
+char const szHeaderWrite[] = "V1";                 // FILEHDR szVersion, flags set for writing (and as found on disk)
+char const szHeaderRead[]  = "R1";                 // FILEHDR szVersion, flags as read from the file
+
+static void readHeaderFlags(struct FILEHDR *pHeader);
+static BOOL hasHeaderFlags(struct FILEHDR *pHeader, PSTR szVersion);
+
+static int   iWorker = 0;                          // Worker number when the files are processed in parallel, 0 is the original process
+static int   nWorkerPids = 0;                      // Workers started by this process, see zParallelFiles
+static pid_t *pWorkerPids = (pid_t *)NIL;
+
+static BOOL zPow2FFT(double *pData, long N, int iSign);     // The three FFT engines behind zFFT
+static BOOL zMixedFFT(double *pData, long N, int iSign);
+static BOOL zBluesteinFFT(double *pData, long N, int iSign);
+static double *zTwiddles(long N, int iSign);
+static void zStockhamFFT(double *x, double *y, long N, double *table, int iSign);
+static BOOL zSixStepFFT(double *pData, long N, int iSign);
+static void zTranspose(double *pSrc, double *pDst, long rows, long cols);
 
 /*
 ** Print %pass Complete in "reportInterval" percent intervals
@@ -239,25 +301,41 @@ double unbiasedRound(double val)
 
 /*
 ** Count the number of data records in a TISAN file
+** The count comes from the file size, so the data are not read.
 ** Restore the file pointer when done.
 */
 long countDataRecords(FILE *stream)
    {
    struct FILEHDR localFileHeader;
-   char bitbucket[sizeof(struct TRData)]; // Largest data typew
    long lCount = 0L;
    long lpos;
    
    lpos = ftell(stream);
    
-   Zgethead(stream,&localFileHeader);
-   
-   while (Zread(stream,bitbucket,localFileHeader.type)) ++lCount;
+   if (Zgethead(stream,&localFileHeader))
+      lCount = zRecordCount(filesize(stream) - (long)sizeof(struct FILEHDR), localFileHeader.type);
 
    fseek(stream,lpos,SEEK_SET);
    
    return(lCount);
    }
+
+/*
+** Number of complete records of dataType in dataBytes bytes of file data.
+** A trailing partial record (e.g. from an interrupted write) is not counted
+** and a warning is printed.
+*/
+long zRecordCount(long dataBytes, short dataType)
+   {
+   long lSize, trailingBytes;
+
+   if ((dataBytes <= 0L) || !(lSize = (long)Zsize(dataType))) return(0L);
+
+   trailingBytes = dataBytes % lSize;
+   if (trailingBytes) zTaskMessage(9,"** WARNING ** Ignoring %ld bytes of an incomplete last record.\n", trailingBytes);
+
+   return(dataBytes / lSize);
+   }
 
 /*
 ** Given a pointer to the data buffer and the file type, take the time, real value, complex value and flag and
@@ -525,11 +603,6 @@ BOOL zGetAdverbs(PSTR pTaskName)
    char dir[_MAX_DIR];
    char path[_MAX_PATH];
    FILE *pFile;
-   int i;
-   char szAdverb[16];
-   double* pDouble;
-   short* pShort;
-   int indexAdverb;
    BOOL bError=FALSE;
    extern const char szTask[];
 
@@ -541,96 +614,7 @@ BOOL zGetAdverbs(PSTR pTaskName)
    
    if (pFile)
       {
-      while (!feof(pFile))
-         {
-         parseAdverb(pFile, sizeof(szAdverb), szAdverb);
-
-         if (szAdverb[0] != NUL)
-            {
-            indexAdverb = -1;
-            for (i = 0; i < ADVCOUNT; ++i)
-               {
-               if (strcmp(szAdverb, ADVSTR[i]) == 0) indexAdverb = i;
-               }
-
-            switch (indexAdverb)
-               {
-// Strings
-               case 0: // TASKNAME
-               case 1: // INNAME
-               case 2: // INCLASS
-               case 3: // INPATH
-               case 4: // IN2NAME
-               case 5: // IN2CLASS
-               case 6: // IN2PATH
-               case 7: // IN3NAME
-               case 8: // IN3CLASS
-               case 9: // IN3PATH
-               case 10: // OUTNAME
-               case 11: // OUTCLASS
-               case 12: // OUTPATH
-               case 20: // TFORMAT
-               case 21: // YFORMAT
-               case 22: // ZFORMAT
-               case 23: // DEVICE
-               case 27: // PARITY
-               case 37: // TLABEL
-               case 38: // YLABEL
-               case 39: // ZLABEL
-               case 40: // TITLE
-                  parseString(pFile, ADVSIZE[indexAdverb], ADVPNTR[indexAdverb]);
-                  break;
-// short scalars
-               case 13: // CODE
-               case 14: // ITYPE
-               case 24: // BAUD
-               case 25: // STOPBITS
-               case 26: // PROGRESS
-               case 28: // FRAME
-               case 29: // BORDER
-               case 31: // TMINOR
-               case 32: // YMINOR
-               case 33: // ZMINOR
-               case 42: // QUIET
-                  fscanf(pFile, "%hd\n", (short*)ADVPNTR[indexAdverb]);
-                  break;
-// long scalars
-               case 30: // COLOR
-                  fscanf(pFile, "%d\n", (LONG*)ADVPNTR[indexAdverb]);
-                  break;
-// double scalars
-               case 15: // FACTOR
-                  fscanf(pFile, "%lg\n", (double*)ADVPNTR[indexAdverb]);
-                  break;
-// double vectors [2]
-               case 16: // TRANGE
-               case 17: // YRANGE
-               case 18: // ZRANGE
-               case 34: // TMAJOR
-               case 35: // YMAJOR
-               case 36: // ZMAJOR
-               case 43: // POINT
-               case 44: // ZFACTOR
-                  pDouble = (double*)ADVPNTR[indexAdverb];
-                  fscanf(pFile, "%lg,%lg\n", pDouble, pDouble+1);
-                  break;
-// short Arrays [4]
-               case 19: // WINDOW
-                  pShort = (short*)ADVPNTR[indexAdverb];
-                  fscanf(pFile, "%hd,%hd,%hd,%hd\n", pShort, pShort+1, pShort+2, pShort+3);
-                  break;
-// double Arrays [10]
-               case 41: // PARMS
-                  pDouble = (double*)ADVPNTR[indexAdverb];
-                  fscanf(pFile, "%lg,%lg,%lg,%lg,%lg,%lg,%lg,%lg,%lg,%lg\n", pDouble, pDouble+1, pDouble+2, pDouble+3, pDouble+4, pDouble+5, pDouble+6, pDouble+7, pDouble+8, pDouble+9);
-                  break;
-             
-               default:
-                  printf("Unknown Adverb '%s' in INP File for task '%s' in function zGetAdverbs\n", szAdverb, TASKNAME);
-                  bError=TRUE;
-               } // switch (indexAdverb)
-            } // if (szAdverb[0] != NUL)
-         } // while (!feof(pFile))
+      bError = zReadAdverbs(pFile);
 
       if (ferror(pFile) != 0)
          {
@@ -652,33 +636,33 @@ BOOL zGetAdverbs(PSTR pTaskName)
 
 /*********************************************************************
 *
-* Put Adverbs to the file name pointed to by pTaskName.
+* Read adverbs in the inputs file format (ADVERB=value lines) from pFile.
+* Used for the inputs files and for adverbs passed to a resident task.
 * FALSE is returned if no errors.
-* TRUE is returned otherwise and an error message is printed.
-* Input file names are of the form inputs\filename.inp
+* TRUE is returned if an unknown adverb is found and a message is printed.
 *
 */
-BOOL zPutAdverbs(PSTR pTaskName)
+BOOL zReadAdverbs(FILE *pFile)
    {
-   char dir[_MAX_DIR];
-   char path[_MAX_PATH];
-   FILE *pFile;
+   int i;
+   char szAdverb[16];
    double* pDouble;
    short* pShort;
    int indexAdverb;
    BOOL bError=FALSE;
-   extern const char szTask[];
-   
-   strcpy(dir,TisanDir);
-   strcat(dir,INPUTSDIR);
-   makePath(path,TisanDrive,dir,pTaskName,INPUTSEXT);
 
-   pFile = fopen(path,"wt");
-   
-   if (pFile)
+   while (!feof(pFile))
       {
-      for (indexAdverb = 0; indexAdverb < ADVCOUNT; ++indexAdverb)
+      parseAdverb(pFile, sizeof(szAdverb), szAdverb);
+
+      if (szAdverb[0] != NUL)
          {
+         indexAdverb = -1;
+         for (i = 0; i < ADVCOUNT; ++i)
+            {
+            if (strcmp(szAdverb, ADVSTR[i]) == 0) indexAdverb = i;
+            }
+
          switch (indexAdverb)
             {
 // Strings
@@ -704,7 +688,7 @@ BOOL zPutAdverbs(PSTR pTaskName)
             case 38: // YLABEL
             case 39: // ZLABEL
             case 40: // TITLE
-               fprintf(pFile, "%s=%s\n", ADVSTR[indexAdverb], ADVPNTR[indexAdverb]);
+               parseString(pFile, ADVSIZE[indexAdverb], ADVPNTR[indexAdverb]);
                break;
 // short scalars
             case 13: // CODE
@@ -718,15 +702,15 @@ BOOL zPutAdverbs(PSTR pTaskName)
             case 32: // YMINOR
             case 33: // ZMINOR
             case 42: // QUIET
-               fprintf(pFile, "%s=%hd\n", ADVSTR[indexAdverb], *(short*)ADVPNTR[indexAdverb]);
+               fscanf(pFile, "%hd\n", (short*)ADVPNTR[indexAdverb]);
                break;
 // long scalars
             case 30: // COLOR
-               fprintf(pFile, "%s=%d\n", ADVSTR[indexAdverb], *(LONG*)ADVPNTR[indexAdverb]);
+               fscanf(pFile, "%d\n", (LONG*)ADVPNTR[indexAdverb]);
                break;
 // double scalars
             case 15: // FACTOR
-               fprintf(pFile, "%s=%.12lg\n", ADVSTR[indexAdverb], *(double*)ADVPNTR[indexAdverb]);
+               fscanf(pFile, "%lg\n", (double*)ADVPNTR[indexAdverb]);
                break;
 // double vectors [2]
             case 16: // TRANGE
@@ -738,25 +722,151 @@ BOOL zPutAdverbs(PSTR pTaskName)
             case 43: // POINT
             case 44: // ZFACTOR
                pDouble = (double*)ADVPNTR[indexAdverb];
-               fprintf(pFile, "%s=%.12lg,%.12lg\n", ADVSTR[indexAdverb], *pDouble, *(pDouble+1));
+               fscanf(pFile, "%lg,%lg\n", pDouble, pDouble+1);
                break;
 // short Arrays [4]
             case 19: // WINDOW
                pShort = (short*)ADVPNTR[indexAdverb];
-               fprintf(pFile, "%s=%hd,%hd,%hd,%hd\n", ADVSTR[indexAdverb], *pShort, *(pShort+1), *(pShort+2), *(pShort+3));
+               fscanf(pFile, "%hd,%hd,%hd,%hd\n", pShort, pShort+1, pShort+2, pShort+3);
                break;
 // double Arrays [10]
             case 41: // PARMS
                pDouble = (double*)ADVPNTR[indexAdverb];
-               fprintf(pFile, "%s=%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg\n", ADVSTR[indexAdverb],
-                             *pDouble, *(pDouble+1), *(pDouble+2), *(pDouble+3), *(pDouble+4), *(pDouble+5), *(pDouble+6), *(pDouble+7), *(pDouble+8), *(pDouble+9));
+               fscanf(pFile, "%lg,%lg,%lg,%lg,%lg,%lg,%lg,%lg,%lg,%lg\n", pDouble, pDouble+1, pDouble+2, pDouble+3, pDouble+4, pDouble+5, pDouble+6, pDouble+7, pDouble+8, pDouble+9);
                break;
-             
+          
             default:
-               printf("Error Should Not Occur %d! Writing INP File for task '%s' in function Zputadv\n", indexAdverb, TASKNAME);
+               printf("Unknown Adverb '%s' in INP File for task '%s' in function zGetAdverbs\n", szAdverb, TASKNAME);
                bError=TRUE;
             } // switch (indexAdverb)
-         } // for (indexAdverb = 0; i < ADVCOUNT; ++indexAdverb)
+         } // if (szAdverb[0] != NUL)
+      } // while (!feof(pFile))
+
+   return(bError);
+   }
+
+/*********************************************************************
+*
+* Write all the adverbs to pFile in the inputs file format.
+* FALSE is returned if no errors.
+*
+*/
+BOOL zWriteAdverbs(FILE *pFile)
+   {
+   double* pDouble;
+   short* pShort;
+   int indexAdverb;
+   BOOL bError=FALSE;
+
+   for (indexAdverb = 0; indexAdverb < ADVCOUNT; ++indexAdverb)
+      {
+      switch (indexAdverb)
+         {
+// Strings
+         case 0: // TASKNAME
+         case 1: // INNAME
+         case 2: // INCLASS
+         case 3: // INPATH
+         case 4: // IN2NAME
+         case 5: // IN2CLASS
+         case 6: // IN2PATH
+         case 7: // IN3NAME
+         case 8: // IN3CLASS
+         case 9: // IN3PATH
+         case 10: // OUTNAME
+         case 11: // OUTCLASS
+         case 12: // OUTPATH
+         case 20: // TFORMAT
+         case 21: // YFORMAT
+         case 22: // ZFORMAT
+         case 23: // DEVICE
+         case 27: // PARITY
+         case 37: // TLABEL
+         case 38: // YLABEL
+         case 39: // ZLABEL
+         case 40: // TITLE
+            fprintf(pFile, "%s=%s\n", ADVSTR[indexAdverb], ADVPNTR[indexAdverb]);
+            break;
+// short scalars
+         case 13: // CODE
+         case 14: // ITYPE
+         case 24: // BAUD
+         case 25: // STOPBITS
+         case 26: // PROGRESS
+         case 28: // FRAME
+         case 29: // BORDER
+         case 31: // TMINOR
+         case 32: // YMINOR
+         case 33: // ZMINOR
+         case 42: // QUIET
+            fprintf(pFile, "%s=%hd\n", ADVSTR[indexAdverb], *(short*)ADVPNTR[indexAdverb]);
+            break;
+// long scalars
+         case 30: // COLOR
+            fprintf(pFile, "%s=%d\n", ADVSTR[indexAdverb], *(LONG*)ADVPNTR[indexAdverb]);
+            break;
+// double scalars
+         case 15: // FACTOR
+            fprintf(pFile, "%s=%.12lg\n", ADVSTR[indexAdverb], *(double*)ADVPNTR[indexAdverb]);
+            break;
+// double vectors [2]
+         case 16: // TRANGE
+         case 17: // YRANGE
+         case 18: // ZRANGE
+         case 34: // TMAJOR
+         case 35: // YMAJOR
+         case 36: // ZMAJOR
+         case 43: // POINT
+         case 44: // ZFACTOR
+            pDouble = (double*)ADVPNTR[indexAdverb];
+            fprintf(pFile, "%s=%.12lg,%.12lg\n", ADVSTR[indexAdverb], *pDouble, *(pDouble+1));
+            break;
+// short Arrays [4]
+         case 19: // WINDOW
+            pShort = (short*)ADVPNTR[indexAdverb];
+            fprintf(pFile, "%s=%hd,%hd,%hd,%hd\n", ADVSTR[indexAdverb], *pShort, *(pShort+1), *(pShort+2), *(pShort+3));
+            break;
+// double Arrays [10]
+         case 41: // PARMS
+            pDouble = (double*)ADVPNTR[indexAdverb];
+            fprintf(pFile, "%s=%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg,%.12lg\n", ADVSTR[indexAdverb],
+                          *pDouble, *(pDouble+1), *(pDouble+2), *(pDouble+3), *(pDouble+4), *(pDouble+5), *(pDouble+6), *(pDouble+7), *(pDouble+8), *(pDouble+9));
+            break;
+          
+         default:
+            printf("Error Should Not Occur %d! Writing INP File for task '%s' in function Zputadv\n", indexAdverb, TASKNAME);
+            bError=TRUE;
+         } // switch (indexAdverb)
+      } // for (indexAdverb = 0; i < ADVCOUNT; ++indexAdverb)
+
+   return(bError);
+   }
+
+/*********************************************************************
+*
+* Put Adverbs to the file name pointed to by pTaskName.
+* FALSE is returned if no errors.
+* TRUE is returned otherwise and an error message is printed.
+* Input file names are of the form inputs\filename.inp
+*
+*/
+BOOL zPutAdverbs(PSTR pTaskName)
+   {
+   char dir[_MAX_DIR];
+   char path[_MAX_PATH];
+   FILE *pFile;
+   BOOL bError=FALSE;
+   extern const char szTask[];
+   
+   strcpy(dir,TisanDir);
+   strcat(dir,INPUTSDIR);
+   makePath(path,TisanDrive,dir,pTaskName,INPUTSEXT);
+
+   pFile = fopen(path,"wt");
+   
+   if (pFile)
+      {
+      bError = zWriteAdverbs(pFile);
 
       if (ferror(pFile))
          {
@@ -783,6 +893,8 @@ BOOL zPutAdverbs(PSTR pTaskName)
 *  Put a file header to disk.
 *  The signature and identifying text is added to the header.
 *  The text fields end in \0\r\n so that they can be easily seen in an editor on any system
+*  The flags are written only if this task set them with zSetSorted. A header
+*  copied from an input file has its flags dropped, since the data may have changed.
 *
 *  Returns 0 if no errors.
 *  Returns 1 on error and prints a message.
@@ -790,10 +902,16 @@ BOOL zPutAdverbs(PSTR pTaskName)
 */
 short Zputhead(FILE *stream, struct FILEHDR *pHeader)
      {
+     struct FILEHDR header;
+
      memcpy(pHeader->szTISAN, szTisanSignature, 8);   // Always set the signature
 
+     header = *pHeader;
+     if (!hasHeaderFlags(&header, (PSTR)szHeaderWrite))      // Only flags set with zSetSorted are written
+        memset(header.szVersion, 0, 6);
+
      rewind(stream);
-     fwrite(pHeader,sizeof(struct FILEHDR),1,stream);
+     fwrite(&header,sizeof(struct FILEHDR),1,stream);
 
      if (ferror(stream))
         {
@@ -831,6 +949,8 @@ struct FILEHDR *Zgethead(FILE *INSTR, struct FILEHDR *HeadStruct)
          zTaskMessage(10,"Not a TISAN Data File.\n");
          HeadStruct = NULL;
          }
+      else
+         readHeaderFlags(HeadStruct);
       }
 
    if (ferror(INSTR))
@@ -863,6 +983,116 @@ BOOL isTisanHeader(struct FILEHDR *pHeader)
    return(bTisanHeader);
    }
 
+/*******************************************
+*
+* The header flags live in what used to be padding after the type, so
+* they only count when szVersion and check agree. Headers read from a
+* file are marked R1, so that a task that copies the header of its input
+* to its output does not pass the flags on. zSetSorted marks them V1, the
+* only flags Zputhead writes.
+*/
+static BOOL hasHeaderFlags(struct FILEHDR *pHeader, PSTR szVersion)
+   {
+   return(!memcmp(pHeader->szVersion, szVersion, 3) && (pHeader->check == (BYTE)~pHeader->flags));
+   }
+
+static void readHeaderFlags(struct FILEHDR *pHeader)
+   {
+   if (hasHeaderFlags(pHeader, (PSTR)szHeaderWrite))
+      memcpy(pHeader->szVersion, szHeaderRead, 3);
+   else if (!hasHeaderFlags(pHeader, (PSTR)szHeaderRead))
+      memset(pHeader->szVersion, 0, 6);         // An older file, or one written without flags
+
+   return;
+   }
+
+/*
+* TRUE if the records are known to be in time order. Time series are
+* in order whenever the time step is positive.
+*/
+BOOL isSortedHeader(struct FILEHDR *pHeader)
+   {
+   if ((pHeader->type == R_Data) || (pHeader->type == X_Data)) return(pHeader->m > 0.);
+
+   return((hasHeaderFlags(pHeader, (PSTR)szHeaderWrite) || hasHeaderFlags(pHeader, (PSTR)szHeaderRead)) &&
+          (pHeader->flags & ZSORTED));
+   }
+
+/*
+* Set or clear the sorted flag of a header this task is going to write.
+* Tasks that cannot change the order of the records pass on
+* isSortedHeader() of their input.
+*/
+void zSetSorted(struct FILEHDR *pHeader, BOOL bSorted)
+   {
+   if (!hasHeaderFlags(pHeader, (PSTR)szHeaderRead) && !hasHeaderFlags(pHeader, (PSTR)szHeaderWrite)) pHeader->flags = 0;
+
+   if (bSorted)
+      pHeader->flags |= ZSORTED;
+   else
+      pHeader->flags &= (BYTE)~ZSORTED;
+
+   memcpy(pHeader->szVersion, szHeaderWrite, 3);
+   pHeader->check = (BYTE)~pHeader->flags;
+   pHeader->spare = 0;
+
+   return;
+   }
+
+/*
+* Index of the first record of a sorted file with a time of at least time,
+* found by a binary search of the file (or directly for a time series).
+* The stream is left positioned at that record, which may be the end of the file.
+* Returns -1 and prints a message if the file is not known to be sorted.
+*/
+long zFindTime(FILE *stream, struct FILEHDR *pHeader, double time)
+   {
+   long N, low, high, mid;
+   double midTime;
+   long lSize = (long)Zsize(pHeader->type);
+
+   if (!isSortedHeader(pHeader))
+      {
+      zTaskMessage(10,"zFindTime needs a sorted file.\n");
+      return(-1L);
+      }
+
+   N = countDataRecords(stream);
+
+   if ((pHeader->type == R_Data) || (pHeader->type == X_Data))
+      {
+      midTime = ceil((time - pHeader->b) / pHeader->m);
+      low = (midTime <= 0.) ? 0L : ((midTime >= (double)N) ? N : (long)midTime);
+      }
+   else
+      {
+      for (low = 0L, high = N; low < high; )   // The time is the first field of TR_Data and TX_Data
+         {
+         mid = low + (high - low) / 2L;
+
+         if (fseek(stream, (long)sizeof(struct FILEHDR) + mid * lSize, SEEK_SET) ||
+             (fread(&midTime, sizeof(double), 1, stream) != 1))
+            {
+            zError();
+            return(-1L);
+            }
+
+         if (midTime < time)
+            low = mid + 1L;
+         else
+            high = mid;
+         }
+      }
+
+   if (fseek(stream, (long)sizeof(struct FILEHDR) + low * lSize, SEEK_SET))
+      {
+      zError();
+      return(-1L);
+      }
+
+   return(low);
+   }
+
 /*******************************************
 *
 * sets the header text fields based on
@@ -896,11 +1126,127 @@ void getHeaderText(struct FILEHDR *pHeader)
    return;
    }
 
+/*********************************************************************
+*
+*  Read or write exactly N bytes on a pipe.
+*  Returns FALSE if no errors.
+*  Returns TRUE on error or end of file.
+*/
+BOOL zReadPipe(int hPipe, void *pData, size_t N)
+   {
+   ssize_t nBytes;
+
+   for ( ; N; N -= (size_t)nBytes, pData = (char *)pData + nBytes)
+      {
+      if ((nBytes = read(hPipe, pData, N)) <= 0)
+         {
+         if ((nBytes < 0) && (errno == EINTR))
+            nBytes = 0;
+         else
+            return(TRUE);
+         }
+      }
+
+   return(FALSE);
+   }
+
+BOOL zWritePipe(int hPipe, void *pData, size_t N)
+   {
+   ssize_t nBytes;
+
+   for ( ; N; N -= (size_t)nBytes, pData = (char *)pData + nBytes)
+      {
+      if ((nBytes = write(hPipe, pData, N)) < 0)
+         {
+         if (errno == EINTR)
+            nBytes = 0;
+         else
+            return(TRUE);
+         }
+      }
+
+   return(FALSE);
+   }
+
+/*********************************************************************
+*
+*  Resident task server.
+*  When TISAN starts a task in resident mode (see goResident in pverbs.c) it
+*  puts the request and reply pipe handles in the RESIDENTENV environment
+*  variable. The task then stays in this loop instead of running once:
+*
+*     read a request (the adverbs in inputs file format, preceded by their length)
+*     fork a copy of the task and give it the adverbs
+*     wait for the copy to finish and send back its exit status
+*
+*  Each run gets a fresh copy of the task's memory, so the task does not need
+*  to reset its globals and Zexit() still ends the run. The server exits when
+*  TISAN closes the request pipe.
+*
+*  Returns FALSE at once if the task was not started in resident mode.
+*  Returns TRUE in the forked copy, where *pbError is the result of reading the adverbs.
+*/
+BOOL zTaskServe(BOOL *pbError)
+   {
+   char *pEnv, *pAdverbs;
+   int hRequest, hReply, status;
+   long length;
+   pid_t pid;
+   FILE *pFile;
+   void (*oldHandler)(int);
+
+   if (!(pEnv = getenv(RESIDENTENV)) || (sscanf(pEnv, "%d,%d", &hRequest, &hReply) != 2)) return(FALSE);
+
+   unsetenv(RESIDENTENV);                      // Programs the task runs are not resident servers
+
+   oldHandler = signal(SIGINT, SIG_IGN);       // ^C stops the current run, not the server
+
+   while (!zReadPipe(hRequest, &length, sizeof(length)))
+      {
+      if (!(pAdverbs = (char *)malloc(length + 1)) || zReadPipe(hRequest, pAdverbs, (size_t)length)) break;
+
+      fflush(stdout);
+
+      if ((pid = fork()) == 0)                 // The copy that does the work
+         {
+         close(hRequest);
+         close(hReply);
+         signal(SIGINT, oldHandler);
+
+         if ((pFile = fmemopen(pAdverbs, (size_t)length, "r")))
+            {
+            *pbError = zReadAdverbs(pFile);
+            fclose(pFile);
+            }
+         else
+            {
+            zError();
+            *pbError = TRUE;
+            }
+
+         free(pAdverbs);
+         return(TRUE);
+         }
+
+      free(pAdverbs);
+
+      if ((pid < 0) || (waitpid(pid, &status, 0) < 0))
+         {
+         zError();
+         status = 1 << 8;                      // Same as exit(1) from the task
+         }
+
+      if (zWritePipe(hReply, &status, sizeof(status))) break;
+      }
+
+   exit(0);
+   }
+
 /*********************************************************************
 *
 *  Initialize Task.
-*  Gets the adverbs from the inputs file, prints a message
-*  and displays the inputs.
+*  Gets the adverbs from the inputs file, or from TISAN when the
+*  task is resident, prints a message and displays the inputs.
 *  Returns FALSE if no errors.
 *  Returns TRUE on error.
 */
@@ -908,16 +1254,18 @@ BOOL zTaskInit(PSTR Argv0)
    {
    long LTIME;
    char fname[_MAX_FNAME], ext[_MAX_EXT];
-   BOOL bError;
+   BOOL bError, bResident;
    extern const char szTask[];
    
    initializeAdverbArrays();
 
    splitPath(Argv0,TisanDrive,TisanDir,fname,ext);
 
+   bResident = zTaskServe(&bError);           // Only returns in the process that runs the task
+
    zTaskMessage(0,"Task %s Begins\n",szTask);
 
-   bError = zGetAdverbs((PSTR)szTask);
+   if (!bResident) bError = zGetAdverbs((PSTR)szTask);
 
    strcpy(TASKNAME,szTask);
    
@@ -1075,45 +1423,418 @@ short Zsize(short dataType)
    }
 
 /*********************************************************************
-**
-** Command to sound bell
+*
+*  Buffered record streams.
+*
+*  A ZSTREAM sits on top of a TISAN file that has already had its
+*  header read (or written) and moves the data records to and from
+*  disk ZBLOCKRECORDS at a time. Tasks that walk a file one record at
+*  a time use zStreamRead and zStreamWrite exactly as they would use
+*  Zread and Zwrite, but only pay for one fread or fwrite per block.
+*  zStreamGetBlock hands out the records of the current block directly.
+*
+*  The stream does not own the FILE. A write stream must be flushed
+*  (zStreamFlush or zStreamClose) before the file header is rewritten
+*  with Zputhead or the file is closed.
+*
+*  Returns NULL and prints a message on error.
 */
-void BEEP()
+struct ZSTREAM *zStreamOpen(FILE *stream, short dataType, short mode)
    {
-   printf("\a");
-   return;
-   }
+   struct ZSTREAM *pStream;
 
-/*********************************************************************
-**
-** Exit a task
-*/
-void Zexit(int N)
-   {
-   extern const char szTask[];
-   long LTIME;
-   
-   ZCatFiles(NULL);  /* Possibly Deallocate CatFiles Memory */
-   
-   time(&LTIME);
-
-   if (N == 256)
-      printf("%-8s: Task %s ABORTS on %s", szTask, szTask, ctime(&LTIME));
-   else if (N == 255)
-      printf("%-8s: Task %s Dies of a Floating Point Exception on %s",szTask, szTask, ctime(&LTIME));
-   else if (N)
+   if (Zsize(dataType) == 0)
       {
-      printf("%-8s: Task %s Dies Unexpectedly on %s",szTask, szTask, ctime(&LTIME));
+      zTaskMessage(10,"Unknown data type %hd in zStreamOpen\n", dataType);
+      return((struct ZSTREAM *)NIL);
       }
-    else
-      {
-      printf("%-8s: Task %s Successfully Completes on %s",szTask, szTask, ctime(&LTIME));      }
 
-   exit(N);
-   }
-   
-/*
-** This library defines the complex equivalents to:
+   if ((mode != O_readb) && (mode != O_writeb))
+      {
+      zTaskMessage(10,"Unknown mode %hd in zStreamOpen\n", mode);
+      return((struct ZSTREAM *)NIL);
+      }
+
+   pStream = (struct ZSTREAM *)malloc(sizeof(struct ZSTREAM));
+
+   if (pStream)
+      {
+      pStream->stream   = stream;
+      pStream->type     = dataType;
+      pStream->size     = Zsize(dataType);
+      pStream->mode     = mode;
+      pStream->nRecords = 0L;
+      pStream->iRecord  = 0L;
+      pStream->block    = (char *)malloc((size_t)ZBLOCKRECORDS * pStream->size);
+
+      if (!pStream->block)
+         {
+         free(pStream);
+         pStream = (struct ZSTREAM *)NIL;
+         }
+      }
+
+   if (!pStream) zTaskMessage(10,"Unable to allocate memory for the record stream.\n");
+
+   return(pStream);
+   }
+
+/*
+** Refill the block of a read stream once all of its records have been handed out.
+** Returns the number of records now available, 0 on EOF or error.
+*/
+static long fillStreamBlock(struct ZSTREAM *pStream)
+   {
+   if (pStream->iRecord >= pStream->nRecords)
+      {
+      pStream->iRecord  = 0L;
+      pStream->nRecords = (long)fread(pStream->block, (size_t)pStream->size, (size_t)ZBLOCKRECORDS, pStream->stream);
+
+      if (ferror(pStream->stream))
+         {
+         zError();
+         pStream->nRecords = 0L;
+         }
+      }
+
+   return(pStream->nRecords - pStream->iRecord);
+   }
+
+/*********************************************************************
+*
+*  Hand out every record left in the current block of a read stream,
+*  reading a new block from disk if needed. *ppRecords points to the
+*  first record. Returns the number of records, 0 on EOF or error.
+*
+*/
+long zStreamGetBlock(struct ZSTREAM *pStream, char **ppRecords)
+   {
+   long N;
+
+   N = fillStreamBlock(pStream);
+
+   *ppRecords = pStream->block + pStream->iRecord * pStream->size;
+   pStream->iRecord = pStream->nRecords;
+
+   return(N);
+   }
+
+/*********************************************************************
+*
+*  Copy the next record of a read stream into DATA.
+*  Return NULL if EOF or ERROR, just like Zread.
+*
+*/
+char *zStreamRead(struct ZSTREAM *pStream, char *DATA)
+   {
+   if (!fillStreamBlock(pStream)) return((char*)NIL);
+
+   memcpy(DATA, pStream->block + pStream->iRecord * pStream->size, (size_t)pStream->size);
+   ++pStream->iRecord;
+
+   return(DATA);
+   }
+
+/*********************************************************************
+*
+*  Add one record to a write stream. The block goes to disk when full.
+*  Returns 0 if no errors.
+*  Returns 1 on error and prints a message.
+*
+*/
+short zStreamWrite(struct ZSTREAM *pStream, char *DATA)
+   {
+   memcpy(pStream->block + pStream->iRecord * pStream->size, DATA, (size_t)pStream->size);
+
+   if (++pStream->iRecord >= ZBLOCKRECORDS) return(zStreamFlush(pStream));
+
+   return(0);
+   }
+
+/*********************************************************************
+*
+*  Write out the records held by a write stream.
+*  Does nothing for a read stream.
+*  Returns 0 if no errors.
+*  Returns 1 on error and prints a message.
+*
+*/
+short zStreamFlush(struct ZSTREAM *pStream)
+   {
+   if ((pStream->mode == O_writeb) && (pStream->iRecord > 0L))
+      {
+      fwrite(pStream->block, (size_t)pStream->size, (size_t)pStream->iRecord, pStream->stream);
+      pStream->iRecord = 0L;
+
+      if (ferror(pStream->stream))
+         {
+         zError();
+         return(1);
+         }
+      }
+
+   return(0);
+   }
+
+/*********************************************************************
+*
+*  Position the stream at the first record of the file, discarding
+*  any buffered records of a read stream.
+*  Returns 0 if no errors.
+*  Returns 1 on error and prints a message.
+*
+*/
+short zStreamRewind(struct ZSTREAM *pStream)
+   {
+   if (zStreamFlush(pStream)) return(1);
+
+   pStream->nRecords = 0L;
+   pStream->iRecord  = 0L;
+
+   if (!Zgethead(pStream->stream,(struct FILEHDR *)NIL)) return(1);
+
+   return(0);
+   }
+
+/*********************************************************************
+*
+*  Flush and release a stream. The FILE is left open.
+*  Returns 0 if no errors.
+*  Returns 1 on error and prints a message.
+*
+*/
+short zStreamClose(struct ZSTREAM *pStream)
+   {
+   short ERRFLAG;
+
+   if (!pStream) return(0);
+
+   ERRFLAG = zStreamFlush(pStream);
+
+   free(pStream->block);
+   free(pStream);
+
+   return(ERRFLAG);
+   }
+
+/*********************************************************************
+*
+*  Memory mapped TISAN files.
+*
+*  zMapOpen maps an entire TISAN data file into memory so the in-memory
+*  tasks can work on the records where they sit in the page cache rather
+*  than allocating a buffer and copying the file into it. The header is
+*  checked just as in Zgethead and copied into *pHeader if pHeader is not
+*  NULL. pMap->records points to the first of pMap->nRecords records.
+*
+*  type O_mapb     : Read only. Writing to the records is an error.
+*  type O_mapcopyb : Private copy-on-write. The records can be changed in
+*                    memory (e.g. sorted in place) without touching the file.
+*
+*  If the file cannot be mapped (e.g. the file system does not support it)
+*  the file is read into allocated memory instead, so callers do not need
+*  a second code path.
+*
+*  Returns NULL on error and prints a message.
+*/
+struct ZMAP *zMapOpen(PSTR fileName, struct FILEHDR *pHeader, short type)
+   {
+   struct ZMAP *pMap;
+   struct stat fileStat;
+   int hFile, protection;
+   long bytesRead, N;
+   BOOL bError = FALSE;
+   extern const char szTask[];
+
+   switch (type)
+      {
+      case O_mapb:      /* Read only map */
+         protection = PROT_READ;
+         break;
+      case O_mapcopyb:  /* Copy-on-write map */
+         protection = PROT_READ | PROT_WRITE;
+         break;
+      default:
+         zMessage(10,"%-8s: Unknown type specified in zMapOpen %hd\n",szTask, type);
+         return((struct ZMAP *)NIL);
+      }
+
+   if ((hFile = open(fileName, O_RDONLY)) == -1)
+      {
+      zError();
+      BEEP();
+      return((struct ZMAP *)NIL);
+      }
+
+   pMap = (struct ZMAP *)calloc(1, sizeof(struct ZMAP));
+
+   if (!pMap)
+      {
+      zTaskMessage(10,"Unable to allocate memory for the file map.\n");
+      close(hFile);
+      return((struct ZMAP *)NIL);
+      }
+
+   pMap->mode = type;
+
+   if (fstat(hFile, &fileStat))
+      {
+      zError();
+      bError = TRUE;
+      }
+   else if (fileStat.st_size < (off_t)sizeof(struct FILEHDR))
+      {
+      zTaskMessage(10,"Not a TISAN Data File.\n");
+      bError = TRUE;
+      }
+   else
+      {
+      pMap->length = (size_t)fileStat.st_size;
+      pMap->base = mmap(NULL, pMap->length, protection, MAP_PRIVATE, hFile, (off_t)0);
+
+      if (pMap->base != (char *)MAP_FAILED)
+         pMap->bMapped = TRUE;
+      else                                     // Fall back to reading the whole file
+         {
+         pMap->base = (char *)malloc(pMap->length);
+
+         if (!pMap->base)
+            {
+            zTaskMessage(10,"Unable to map or allocate %ld bytes for the input file.\n", (long)pMap->length);
+            bError = TRUE;
+            }
+         else
+            {
+            for (bytesRead = 0L; bytesRead < (long)pMap->length; bytesRead += N)   // read() may return less than asked for
+               {
+               if ((N = (long)read(hFile, pMap->base + bytesRead, pMap->length - (size_t)bytesRead)) <= 0L) break;
+               }
+
+            if (bytesRead != (long)pMap->length)
+               {
+               zTaskMessage(10,"Error reading input file.\n");
+               bError = TRUE;
+               }
+            }
+         }
+      }
+
+   close(hFile);                               // The mapping stays valid once the file is closed
+
+   if (!bError)
+      {
+      pMap->header = (struct FILEHDR *)pMap->base;
+
+      if (!isTisanHeader(pMap->header))
+         {
+         zTaskMessage(10,"Not a TISAN Data File.\n");
+         bError = TRUE;
+         }
+      else if (!(pMap->size = Zsize(pMap->header->type)))
+         {
+         zTaskMessage(10,"Unknown File Type.\n");
+         bError = TRUE;
+         }
+      }
+
+   if (bError)
+      {
+      zMapClose(pMap);
+      return((struct ZMAP *)NIL);
+      }
+
+   pMap->type     = pMap->header->type;
+   pMap->records  = pMap->base + sizeof(struct FILEHDR);
+   pMap->nRecords = zRecordCount((long)(pMap->length - sizeof(struct FILEHDR)), pMap->type);
+
+   if (pHeader)
+      {
+      memcpy(pHeader, pMap->header, sizeof(struct FILEHDR));
+      readHeaderFlags(pHeader);
+      }
+
+   return(pMap);
+   }
+
+/*********************************************************************
+*
+*  Release a file mapping made by zMapOpen. Any pointers into the
+*  records are no longer valid.
+*  Returns 0 if no errors.
+*  Returns 1 on error and prints a message.
+*
+*/
+short zMapClose(struct ZMAP *pMap)
+   {
+   short ERRFLAG = 0;
+
+   if (!pMap) return(0);
+
+   if (pMap->base)
+      {
+      if (!pMap->bMapped)
+         free(pMap->base);
+      else if (munmap(pMap->base, pMap->length))
+         {
+         zError();
+         ERRFLAG = 1;
+         }
+      }
+
+   free(pMap);
+
+   return(ERRFLAG);
+   }
+
+/*********************************************************************
+**
+** Command to sound bell
+*/
+void BEEP()
+   {
+   printf("\a");
+   return;
+   }
+
+/*********************************************************************
+**
+** Exit a task
+*/
+void Zexit(int N)
+   {
+   extern const char szTask[];
+   long LTIME;
+   
+   ZCatFiles(NULL);  /* Possibly Deallocate CatFiles Memory */
+
+   if (iWorker)      /* A worker from zParallelFiles just reports back how it went */
+      {
+      fflush(stdout);
+      exit(N);
+      }
+
+   N = zWaitWorkers(N);
+   
+   time(&LTIME);
+
+   if (N == 256)
+      printf("%-8s: Task %s ABORTS on %s", szTask, szTask, ctime(&LTIME));
+   else if (N == 255)
+      printf("%-8s: Task %s Dies of a Floating Point Exception on %s",szTask, szTask, ctime(&LTIME));
+   else if (N)
+      {
+      printf("%-8s: Task %s Dies Unexpectedly on %s",szTask, szTask, ctime(&LTIME));
+      }
+    else
+      {
+      printf("%-8s: Task %s Successfully Completes on %s",szTask, szTask, ctime(&LTIME));
+      }
+
+   exit(N);
+   }
+   
+/*
+** This library defines the complex equivalents to:
 **
 **    addition
 **    subtraction
@@ -1980,26 +2701,1275 @@ struct CATSTRUCT *ZCatFiles(char* pPath)
 
 /*********************************************************************
 *
-*  Make a file name and return a pointer
-*  Create one of 4 types of file names
+* Process the files in a catalog from ZCatFiles in parallel.
 *
-* M_inname  : Primary input file
-* M_in2name : Secondary input file
-* M_outname : Output file
-* M_tmpname : Temporary scratch file
+* WORKERS=n in TISAN.CFG sets the number of processes (0 means one per
+* core). The task forks n-1 copies of itself, the files are dealt out
+* largest first to the least loaded process, and pCatList is cut down
+* in each process to just its own files, so the task's normal loop over
+* the catalog runs unchanged in every process. Temporary file names
+* already include the process ID, so zNameOutputFile stays safe.
+* Zexit() in the original process waits for the workers and fails if
+* any of them failed.
 *
-* The Primary file name is built from INNAME, INCLASS and INPATH directly.
-* The Secondary file name is built from IN2NAME, IN2CLASS and IN2PATH if
-* they are not null strings, if any one is not defined, then INNAME,
-* INCLASS or INPATH is used.
-* The Output file name is built from OUTNAME, OUTCLASS and OUTPATH if
-* they are not null strings, if any one is not defined, then INNAME,
-* INCLASS or INPATH is used.
-* The Temporary file name is built from OUTPATH, an 8 character name based
-* on the current process ID, the TASKNAME and the number of retries in
-* building the name.  The extension .TMP is always used.
+* Nothing is done for a single file, or when OUTNAME is set, since then
+* every file would be written to the same output file.
 *
-* If the file name can be created, a pointer is returned, otherwise
+* Returns the number of processes used.
+*/
+int zParallelFiles(struct CATSTRUCT *pCatList)
+   {
+   if (*OUTNAME) return(1);
+
+   return(zParallelCatalog(pCatList));
+   }
+
+/*********************************************************************
+*
+* zParallelFiles without the OUTNAME check, for a task that gathers the
+* results of its workers into one output file itself. The original process
+* calls zWaitWorkers before it reads what the workers left behind.
+*/
+int zParallelCatalog(struct CATSTRUCT *pCatList)
+   {
+   char szValue[16];
+   char *pName, *pNext, *pList;
+   char **ppNames;
+   int nWorkers, i, j, k, *pOwner;
+   long *pSize, *pLoad;
+   struct stat fileStat;
+   pid_t pid;
+
+   if (!pCatList || (pCatList->N < 2)) return(1);
+
+   if (!getConfigString("WORKERS", sizeof(szValue), szValue)) return(1);   // TRUE if the key was found
+
+   if ((nWorkers = atoi(szValue)) <= 0) nWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   if (nWorkers > pCatList->N) nWorkers = pCatList->N;
+   if (nWorkers < 2) return(1);
+
+   ppNames     = (char **)malloc(pCatList->N * sizeof(char *));
+   pSize       = (long *)malloc(pCatList->N * sizeof(long));
+   pOwner      = (int *)malloc(pCatList->N * sizeof(int));
+   pLoad       = (long *)calloc(nWorkers, sizeof(long));
+   pWorkerPids = (pid_t *)malloc(nWorkers * sizeof(pid_t));
+   pList       = (char *)malloc(pCatList->N * _MAX_PATH);
+
+   if (!ppNames || !pSize || !pOwner || !pLoad || !pWorkerPids || !pList)
+      {
+      zTaskMessage(9,"** WARNING ** Not enough memory to process the files in parallel.\n");
+      nWorkers = 1;
+      }
+   else
+      {
+      for (i = 0, pName = pCatList->pList; i < pCatList->N; ++i, pName = strchr(pName,'\0') + 1)
+         {
+         ppNames[i] = pName;
+         pSize[i]   = stat(pName, &fileStat) ? 0L : (long)fileStat.st_size;
+         pOwner[i]  = -1;
+         }
+   /*
+   ** Largest remaining file goes to the least loaded worker
+   */
+      for (j = 0; j < pCatList->N; ++j)
+         {
+         for (i = 0, k = -1; i < pCatList->N; ++i)
+            {
+            if ((pOwner[i] < 0) && ((k < 0) || (pSize[i] > pSize[k]))) k = i;
+            }
+
+         for (i = 1, pOwner[k] = 0; i < nWorkers; ++i)
+            {
+            if (pLoad[i] < pLoad[pOwner[k]]) pOwner[k] = i;
+            }
+
+         pLoad[pOwner[k]] += pSize[k] + 1L;
+         }
+
+      setvbuf(stdout, (char *)NIL, _IOLBF, 0);  // Whole lines, so the workers' messages do not get mixed together
+      fflush(stdout);
+
+      for (i = 1; i < nWorkers; ++i)
+         {
+         if ((pid = fork()) == 0)
+            {
+            iWorker = i;
+            nWorkerPids = 0;
+            break;
+            }
+         else if (pid < 0)                       // Carry on with the workers we have and keep their files here
+            {
+            zError();
+            for (k = 0; k < pCatList->N; ++k)
+               {
+               if (pOwner[k] >= i) pOwner[k] = 0;
+               }
+            nWorkers = i;
+            }
+         else
+            pWorkerPids[nWorkerPids++] = pid;
+         }
+   /*
+   ** Keep just this process's files, in catalog order
+   */
+      for (i = 0, j = 0, pNext = pList; i < pCatList->N; ++i)
+         {
+         if (pOwner[i] == iWorker)
+            {
+            strcpy(pNext, ppNames[i]);
+            pNext = strchr(pNext,'\0') + 1;
+            ++j;
+            }
+         }
+      *pNext = NUL;
+
+      memcpy(pCatList->pList, pList, (size_t)(pNext - pList) + 1);
+      pCatList->N = j;
+
+      zTaskMessage(2,"Worker %d of %d processing %d files.\n", iWorker + 1, nWorkers, j);
+      }
+
+   if (ppNames) free(ppNames);
+   if (pSize)   free(pSize);
+   if (pOwner)  free(pOwner);
+   if (pLoad)   free(pLoad);
+   if (pList)   free(pList);
+
+   return(nWorkers);
+   }
+
+/*********************************************************************
+*
+* TRUE in a worker process started by zParallelFiles
+*/
+BOOL isWorker()
+   {
+   return(iWorker ? TRUE : FALSE);
+   }
+
+/*********************************************************************
+*
+* Wait for the workers started by zParallelFiles.
+* Returns N, or 1 if N is 0 and a worker failed.
+*/
+int zWaitWorkers(int N)
+   {
+   int status;
+
+   for ( ; nWorkerPids > 0; --nWorkerPids)
+      {
+      if ((waitpid(pWorkerPids[nWorkerPids - 1], &status, 0) < 0) ||
+          !WIFEXITED(status) || WEXITSTATUS(status))
+         {
+         if (!N) N = 1;
+         }
+      }
+
+   if (pWorkerPids) free(pWorkerPids);
+   pWorkerPids = (pid_t *)NIL;
+
+   return(N);
+   }
+
+/*********************************************************************
+*
+* Number of threads a task should use for its compute loops.
+* THREADS=n in TISAN.CFG, where 0 (or no entry) means one per core.
+* TISAN.CFG is only read on the first call.
+*/
+int zThreadCount()
+   {
+   static int nThreads = 0;
+   char szValue[16];
+
+   if (!nThreads)
+      {
+      if (getConfigString("THREADS", sizeof(szValue), szValue)) nThreads = atoi(szValue);   // TRUE if the key was found
+
+      if (nThreads <= 0) nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+      if (nThreads <= 0) nThreads = 1;
+      }
+
+   return(nThreads);
+   }
+
+/*********************************************************************
+*
+* Bytes a task may hold in memory before it works through scratch files.
+* MEMORY=n in TISAN.CFG gives n megabytes, where 0 (or no entry) means half
+* of the physical memory.
+* TISAN.CFG is only read on the first call.
+*/
+long zMemoryBudget()
+   {
+   static long budget = 0L;
+   char szValue[32];
+
+   if (!budget)
+      {
+      if (getConfigString("MEMORY", sizeof(szValue), szValue)) budget = atol(szValue) * 1048576L;   // TRUE if the key was found
+
+      if (budget <= 0L) budget = (long)sysconf(_SC_PHYS_PAGES) / 2L * (long)sysconf(_SC_PAGESIZE);
+      if (budget <= 0L) budget = 1073741824L;
+      }
+
+   return(budget);
+   }
+
+/*********************************************************************
+*
+* Run pWork(iThread, nThreads, pData) on nThreads threads and wait for
+* them all to finish. The calling thread does iThread 0 itself, so with
+* one thread no thread is created. pWork must only touch its own share
+* of pData; task globals are not protected.
+*
+* Returns FALSE if no errors.
+* Returns TRUE if a thread could not be started, after running its share
+* on the calling thread, so the work is always done.
+*/
+static void *zThreadStart(void *pArg)
+   {
+   struct ZTHREAD *pThread = (struct ZTHREAD *)pArg;
+
+   pThread->pWork(pThread->iThread, pThread->nThreads, pThread->pData);
+
+   return(NIL);
+   }
+
+BOOL zRunThreads(int nThreads, void (*pWork)(int iThread, int nThreads, void *pData), void *pData)
+   {
+   pthread_t *pIds;
+   struct ZTHREAD *pThreads;
+   BOOL *pbStarted;
+   BOOL bError = FALSE;
+   int i;
+
+   if (nThreads <= 1)
+      {
+      pWork(0, 1, pData);
+      return(FALSE);
+      }
+
+   pIds      = (pthread_t *)malloc(nThreads * sizeof(pthread_t));
+   pThreads  = (struct ZTHREAD *)malloc(nThreads * sizeof(struct ZTHREAD));
+   pbStarted = (BOOL *)calloc(nThreads, sizeof(BOOL));
+
+   if (!pIds || !pThreads || !pbStarted)
+      {
+      for (i = 0; i < nThreads; ++i) pWork(i, nThreads, pData);
+      bError = TRUE;
+      }
+   else
+      {
+      for (i = 0; i < nThreads; ++i)
+         {
+         pThreads[i].pWork    = pWork;
+         pThreads[i].iThread  = i;
+         pThreads[i].nThreads = nThreads;
+         pThreads[i].pData    = pData;
+         }
+
+      for (i = 1; i < nThreads; ++i)
+         {
+         pbStarted[i] = !pthread_create(&pIds[i], (pthread_attr_t *)NIL, zThreadStart, &pThreads[i]);
+         }
+
+      pWork(0, nThreads, pData);
+
+      for (i = 1; i < nThreads; ++i)
+         {
+         if (pbStarted[i])
+            pthread_join(pIds[i], (void **)NIL);
+         else
+            {
+            pWork(i, nThreads, pData);
+            bError = TRUE;
+            }
+         }
+      }
+
+   if (pIds)      free(pIds);
+   if (pThreads)  free(pThreads);
+   if (pbStarted) free(pbStarted);
+
+   return(bError);
+   }
+
+/*********************************************************************
+*
+* Phase recurrence for evenly spaced data.
+*
+* The Fourier sums need cos and sin of theta0 + k*dtheta for k = 0, 1, ...
+* Rotating the last value by dtheta gives the next one with four
+* multiplies, which is far cheaper than calling cos() and sin().
+* Round off grows slowly with k, so every ZROTORSYNC steps the value is
+* taken from libm again and the difference is kept in maxError. If that
+* difference is ever more than ZROTORTOL the rotor uses libm for every
+* step from then on.
+*
+* zRotorInit clears the error record, once per file.
+* zRotorStart begins a new phase sequence, c and s hold the k = 0 values.
+* zRotorNext moves c and s on to the next k.
+*/
+void zRotorInit(struct ZROTOR *pRotor)
+   {
+   pRotor->maxError = 0.;
+   pRotor->bExact = FALSE;
+   zRotorStart(pRotor, 0., 0.);
+
+   return;
+   }
+
+void zRotorStart(struct ZROTOR *pRotor, double theta0, double dtheta)
+   {
+   pRotor->theta0 = theta0;
+   pRotor->dtheta = dtheta;
+   pRotor->k = 0L;
+   pRotor->nLeft = ZROTORSYNC;
+   pRotor->c  = cos(theta0);
+   pRotor->s  = sin(theta0);
+   pRotor->dc = cos(dtheta);
+   pRotor->ds = sin(dtheta);
+
+   return;
+   }
+
+void zRotorNext(struct ZROTOR *pRotor)
+   {
+   double c = pRotor->c, s = pRotor->s;
+   double theta, error;
+
+   ++pRotor->k;
+
+   if (!pRotor->bExact)
+      {
+      pRotor->c = c * pRotor->dc - s * pRotor->ds;
+      pRotor->s = s * pRotor->dc + c * pRotor->ds;
+
+      if (--pRotor->nLeft > 0) return;
+
+      pRotor->nLeft = ZROTORSYNC;
+      }
+
+   theta = pRotor->theta0 + (double)pRotor->k * pRotor->dtheta;
+   c = cos(theta);
+   s = sin(theta);
+
+   if (!pRotor->bExact)
+      {
+      error = Max(fabs(c - pRotor->c), fabs(s - pRotor->s));
+      if (error > pRotor->maxError) pRotor->maxError = error;
+      if (error > ZROTORTOL) pRotor->bExact = TRUE;
+      }
+
+   pRotor->c = c;
+   pRotor->s = s;
+
+   return;
+   }
+
+/*
+* Report the largest recurrence error over N rotors (one per thread)
+*/
+void zRotorReport(struct ZROTOR *pRotors, int N)
+   {
+   double maxError = 0.;
+   BOOL bExact = FALSE;
+   int i;
+
+   for (i = 0; i < N; ++i)
+      {
+      maxError = Max(maxError, pRotors[i].maxError);
+      bExact |= pRotors[i].bExact;
+      }
+
+   zTaskMessage(2,"Largest phase recurrence error %lG\n", maxError);
+
+   if (bExact)
+      zTaskMessage(9,"** WARNING ** Phase recurrence error above %lG, cos() and sin() were used instead.\n", ZROTORTOL);
+
+   return;
+   }
+
+/*
+* Fill pCos and pSin with the next N values of the rotor
+*/
+void zRotorFill(struct ZROTOR *pRotor, long N, double *pCos, double *pSin)
+   {
+   long I;
+
+   for (I = 0; I < N; ++I)
+      {
+      pCos[I] = pRotor->c;
+      pSin[I] = pRotor->s;
+      zRotorNext(pRotor);
+      }
+
+   return;
+   }
+
+/*********************************************************************
+*
+* TRUE if the records are at evenly spaced times, t = *pT0 + k * *pDt.
+* R_Data and X_Data always are (t = TCNT*m + b). TR_Data and TX_Data are
+* checked against the straight line through the first and last times,
+* allowing a small fraction of the spacing for round off in the file.
+*/
+BOOL isEvenlySpaced(struct FILEHDR *pHeader, char *records, long nRecords, double *pT0, double *pDt)
+   {
+   double t0, dt, t;
+   long I;
+
+   switch (pHeader->type)
+      {
+      case R_Data:
+      case X_Data:
+         *pT0 = pHeader->b;
+         *pDt = pHeader->m;
+         return(TRUE);
+
+      case TR_Data:
+      case TX_Data:
+         if (nRecords < 2) return(FALSE);
+
+         t0 = (pHeader->type == TR_Data) ? ((struct TRData *)records)->t : ((struct TXData *)records)->t;
+         t  = (pHeader->type == TR_Data) ? ((struct TRData *)records)[nRecords - 1].t : ((struct TXData *)records)[nRecords - 1].t;
+         dt = (t - t0) / (double)(nRecords - 1);
+         if (dt == 0.) return(FALSE);
+
+         for (I = 1; I < nRecords - 1; ++I)
+            {
+            t = (pHeader->type == TR_Data) ? ((struct TRData *)records)[I].t : ((struct TXData *)records)[I].t;
+            if (fabs(t - (t0 + (double)I * dt)) > 1.0e-9 * fabs(dt)) return(FALSE);
+            }
+
+         *pT0 = t0;
+         *pDt = dt;
+         return(TRUE);
+
+      default:
+         return(FALSE);
+      }
+   }
+
+/*********************************************************************
+*
+* Unpack N records into separate arrays of times, real parts, imaginary
+* parts and flags, so compute loops can run over contiguous values
+* without a switch on the data type for every sample. Any array not
+* needed may be NIL. Real data have imaginary parts of 0 and time
+* labeled data have flags of 0, as in extractValues.
+*
+* Returns FALSE if no errors.
+* Returns TRUE for an unknown data type.
+*/
+BOOL zUnpackRecords(struct FILEHDR *pHeader, char *records, long N, double *pTime, double *pReal, double *pImag, short *pFlag)
+   {
+   double TIME, Rval;
+   struct complex Zval;
+   short FLAG;
+   short size = Zsize(pHeader->type);
+   BOOL bComplex = (pHeader->type == X_Data) || (pHeader->type == TX_Data);
+   long I;
+
+   for (I = 0; I < N; ++I, records += size)
+      {
+      Zval.x = Zval.y = 0.;
+
+      if (extractValues(records, pHeader, (double)I, &TIME, &Rval, &Zval, &FLAG)) return(TRUE);
+
+      if (pTime) pTime[I] = TIME;
+      if (pReal) pReal[I] = bComplex ? Zval.x : Rval;   // Rval is |z| for complex data
+      if (pImag) pImag[I] = Zval.y;
+      if (pFlag) pFlag[I] = FLAG;
+      }
+
+   return(FALSE);
+   }
+
+/*********************************************************************
+*
+* Sum of pA[0..N-1] and sum of pA[I]*pB[I].
+* ZLANES partial sums are kept side by side and added at the end, so the
+* compiler can put the lanes in SIMD registers without reordering the
+* floating point sums itself.
+*/
+double zSum(double *pA, long N)
+   {
+   double lane[ZLANES] = {0.}, sum = 0.;
+   long I, L;
+
+   for (I = 0; I + ZLANES <= N; I += ZLANES)
+      {
+      for (L = 0; L < ZLANES; ++L) lane[L] += pA[I + L];
+      }
+
+   for (; I < N; ++I) sum += pA[I];
+
+   for (L = 0; L < ZLANES; ++L) sum += lane[L];
+
+   return(sum);
+   }
+
+double zDot(double *pA, double *pB, long N)
+   {
+   double lane[ZLANES] = {0.}, sum = 0.;
+   long I, L;
+
+   for (I = 0; I + ZLANES <= N; I += ZLANES)
+      {
+      for (L = 0; L < ZLANES; ++L) lane[L] += pA[I + L] * pB[I + L];
+      }
+
+   for (; I < N; ++I) sum += pA[I] * pB[I];
+
+   for (L = 0; L < ZLANES; ++L) sum += lane[L];
+
+   return(sum);
+   }
+
+/*********************************************************************
+*
+* In place complex FFT of N values held as real and imaginary parts in
+* adjacent cells, pData[0..2N-1].
+* iSign = 1 sums with exp(+i 2 pi j k / N) and iSign = -1 with exp(-i ...).
+* No scaling is applied.
+*
+* Any N may be used. A power of 2 goes straight to the radix 4 transform,
+* a product of 2, 3, 5 and 7 to the mixed radix one, and anything else is
+* done as a convolution with Bluestein's chirp. All are O(N log N).
+*
+* Returns TRUE if the scratch memory could not be allocated.
+*/
+BOOL zFFT(double *pData, long N, int iSign)
+   {
+   long L;
+
+   if (N < 2L) return(FALSE);
+
+   for (L = 1L; L < N; L *= 2L);
+
+   if (L == N) return(zPow2FFT(pData, N, iSign));
+
+   if (isSmoothLength(N)) return(zMixedFFT(pData, N, iSign));
+
+   return(zBluesteinFFT(pData, N, iSign));
+   }
+
+/*********************************************************************
+*
+* Real input FFT. pData holds N real values (N even) and has room for
+* N+2. On return it holds X(0) to X(N/2) as adjacent real and imaginary
+* parts, X(j) = sum of x(k) exp(iSign 2 pi i j k / N). The rest of the
+* spectrum is conj(X(N-j)). No scaling is applied.
+*
+* The even and odd points are packed as x(2k) + i x(2k+1) and done with
+* one complex transform of N/2 points, E and O are separated using the
+* symmetry of real transforms, then X(j) = E(j) + exp(iSign 2 pi i j/N) O(j)
+* and X(N/2-j) = conj(E(j) - exp(iSign 2 pi i j/N) O(j)).
+*
+* Returns TRUE if the scratch memory could not be allocated.
+*/
+BOOL zRealFFT(double *pData, long N, int iSign)
+   {
+   double twoPI = 2.0 * acos(-1.0);
+   double er, ei, or, oi, vr, vi;
+   struct ZROTOR rotor;
+   long M = N / 2L, J, K;
+
+   if (zFFT(pData, M, iSign)) return(TRUE);
+
+   pData[N]   = pData[0];   // Z(M) = Z(0)
+   pData[N+1] = pData[1];
+
+   zRotorInit(&rotor);
+   zRotorStart(&rotor, 0., (double)iSign * twoPI / (double)N);
+
+   for (J = 0L; J <= M - J; ++J, zRotorNext(&rotor))   // J and M-J together, in place
+      {
+      K = M - J;
+      er = 0.5 * (pData[2L*J]   + pData[2L*K]);     // E = (Z(J) + conj(Z(K)))/2
+      ei = 0.5 * (pData[2L*J+1] - pData[2L*K+1]);
+      or = 0.5 * (pData[2L*J+1] + pData[2L*K+1]);   // O = (Z(J) - conj(Z(K)))/2i
+      oi = 0.5 * (pData[2L*K]   - pData[2L*J]);
+
+      vr = rotor.c * or - rotor.s * oi;
+      vi = rotor.c * oi + rotor.s * or;
+
+      pData[2L*J]   = er + vr;
+      pData[2L*J+1] = ei + vi;
+      if (K != J)
+         {
+         pData[2L*K]   =   er - vr;
+         pData[2L*K+1] = -(ei - vi);
+         }
+      }
+
+   return(FALSE);
+   }
+
+/*
+* Inverse of zRealFFT. pData holds X(0) to X(N/2) of a conjugate symmetric
+* spectrum (N even). On return it holds the N real values
+* x(k) = sum over all j of X(j) exp(iSign 2 pi i j k / N), unscaled.
+*
+* The sums for x(2k) and x(2k+1) are packed into one complex transform of
+* N/2 points of A(j) = P(j) + i exp(iSign 2 pi i j/N) Q(j), with
+* P = X(j) + conj(X(N/2-j)) and Q = X(j) - conj(X(N/2-j)).
+*
+* Returns TRUE if the scratch memory could not be allocated.
+*/
+BOOL zRealIFFT(double *pData, long N, int iSign)
+   {
+   double twoPI = 2.0 * acos(-1.0);
+   double pr, pi, qr, qi, vr, vi;
+   struct ZROTOR rotor;
+   long M = N / 2L, J, K;
+
+   zRotorInit(&rotor);
+   zRotorStart(&rotor, 0., (double)iSign * twoPI / (double)N);
+
+   for (J = 0L; J <= M - J; ++J, zRotorNext(&rotor))
+      {
+      K = M - J;
+      pr = pData[2L*J]   + pData[2L*K];
+      pi = pData[2L*J+1] - pData[2L*K+1];
+      qr = pData[2L*J]   - pData[2L*K];
+      qi = pData[2L*J+1] + pData[2L*K+1];
+
+      vr = rotor.c * qr - rotor.s * qi;            // V = W Q
+      vi = rotor.c * qi + rotor.s * qr;
+
+      pData[2L*J]   = pr - vi;                     // A(J) = P + iV
+      pData[2L*J+1] = pi + vr;
+      if ((K != J) && (K != M))
+         {
+         pData[2L*K]   =   pr + vi;                // A(K) = conj(P - iV)
+         pData[2L*K+1] = -(pi - vr);
+         }
+      }
+
+   return(zFFT(pData, M, iSign));
+   }
+
+/*
+* TRUE if N has no prime factors other than 2, 3, 5 and 7.
+*/
+BOOL isSmoothLength(long N)
+   {
+   static const long radix[] = {2L, 3L, 5L, 7L};
+   int I;
+
+   if (N < 1L) return(FALSE);
+
+   for (I = 0; I < 4; ++I)
+      while (N % radix[I] == 0L) N /= radix[I];
+
+   return(N == 1L);
+   }
+
+/*
+* Smallest length of at least N with no prime factors other than 2, 3, 5
+* and 7, for padding data to a fast FFT length.
+*/
+long zSmoothLength(long N)
+   {
+   if (N < 1L) N = 1L;
+
+   while (!isSmoothLength(N)) ++N;
+
+   return(N);
+   }
+
+/*
+* Power of 2 transform.
+* Up to ZFFTBLOCK points are done in one piece by zStockhamFFT, which works
+* between pData and a scratch array. Longer transforms are split into
+* N1 x N2 blocks (the six step method) so each piece stays in cache.
+*/
+static BOOL zPow2FFT(double *pData, long N, int iSign)
+   {
+   double *work, *table;
+
+   if (N > ZFFTBLOCK) return(zSixStepFFT(pData, N, iSign));
+
+   work  = (double *)malloc(2L * N * sizeof(double));
+   table = zTwiddles(N, iSign);
+
+   if (!work || !table)
+      {
+      if (work) free(work);
+      if (table) free(table);
+      return(TRUE);
+      }
+
+   zStockhamFFT(pData, work, N, table, iSign);
+
+   free(work);
+   free(table);
+
+   return(FALSE);
+   }
+
+/*
+* Table of exp(iSign 2 pi i k / N), k = 0 to N-1, as adjacent real and
+* imaginary parts. Each entry is the product of one from a coarse and one
+* from a fine table of about sqrt(N) exact libm values, which keeps the
+* error to a couple of units in the last place.
+*/
+static double *zTwiddles(long N, int iSign)
+   {
+   double twoPI = 2.0 * acos(-1.0);
+   double *table, *fine, *coarse;
+   long B, K, J;
+
+   for (B = 1L; B * B < N; B *= 2L);
+
+   table  = (double *)malloc(2L * N * sizeof(double));
+   fine   = (double *)malloc(2L * B * sizeof(double));
+   coarse = (double *)malloc(2L * (N / B + 1L) * sizeof(double));
+
+   if (!table || !fine || !coarse)
+      {
+      if (table) free(table);
+      if (fine) free(fine);
+      if (coarse) free(coarse);
+      return((double *)NIL);
+      }
+
+   for (K = 0L; K < B; ++K)
+      {
+      fine[2L*K]   = cos(twoPI * (double)K / (double)N);
+      fine[2L*K+1] = (double)iSign * sin(twoPI * (double)K / (double)N);
+      }
+
+   for (J = 0L; J * B < N; ++J)
+      {
+      coarse[2L*J]   = cos(twoPI * (double)(J * B) / (double)N);
+      coarse[2L*J+1] = (double)iSign * sin(twoPI * (double)(J * B) / (double)N);
+      }
+
+   for (K = 0L; K < N; ++K)
+      {
+      J = K / B;
+      table[2L*K]   = coarse[2L*J] * fine[2L*(K%B)]   - coarse[2L*J+1] * fine[2L*(K%B)+1];
+      table[2L*K+1] = coarse[2L*J] * fine[2L*(K%B)+1] + coarse[2L*J+1] * fine[2L*(K%B)];
+      }
+
+   free(fine);
+   free(coarse);
+
+   return(table);
+   }
+
+/*
+* Self sorting (Stockham) radix 4 passes, with one radix 2 pass at the end
+* when N is an odd power of 2. x holds the data in and out, y is scratch
+* of the same size and table comes from zTwiddles(N, iSign).
+*
+* Each pass splits the n point sub-transforms, s of them side by side,
+* into 4 of length m = n/4. The twiddle factors of a pass depend only on q,
+* so the inner loop over the s sub-transforms is a plain unit stride loop
+* of independent butterflies the compiler can vectorise.
+*/
+static void zStockhamFFT(double *x, double *y, long N, double *table, int iSign)
+   {
+   double *x0, *x1, *x2, *x3, *y0, *y1, *y2, *y3, *t;
+   double w1r, w1i, w2r, w2i, w3r, w3i;
+   double t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+   long n, m, s, q, J;
+   BOOL bSwapped = FALSE;
+
+   for (n = N, s = 1L; n >= 4L; n = m, s *= 4L)
+      {
+      m = n / 4L;
+
+      for (q = 0L; q < m; ++q)
+         {
+         w1r = table[2L*(q*s)];
+         w1i = table[2L*(q*s)+1];
+         w2r = table[2L*(2L*q*s)];
+         w2i = table[2L*(2L*q*s)+1];
+         w3r = table[2L*(3L*q*s)];
+         w3i = table[2L*(3L*q*s)+1];
+
+         x0 = x + 2L * s * q;
+         x1 = x + 2L * s * (q + m);
+         x2 = x + 2L * s * (q + 2L * m);
+         x3 = x + 2L * s * (q + 3L * m);
+         y0 = y + 2L * s * (4L * q);
+         y1 = y0 + 2L * s;
+         y2 = y1 + 2L * s;
+         y3 = y2 + 2L * s;
+
+         for (J = 0L; J < 2L * s; J += 2L)
+            {
+            t0r = x0[J]   + x2[J];
+            t0i = x0[J+1] + x2[J+1];
+            t1r = x0[J]   - x2[J];
+            t1i = x0[J+1] - x2[J+1];
+            t2r = x1[J]   + x3[J];
+            t2i = x1[J+1] + x3[J+1];
+            t3r = (double)-iSign * (x1[J+1] - x3[J+1]);   // (a1 - a3) times iSign i
+            t3i = (double) iSign * (x1[J]   - x3[J]);
+
+            y0[J]   = t0r + t2r;
+            y0[J+1] = t0i + t2i;
+
+            y1[J]   = (t1r + t3r) * w1r - (t1i + t3i) * w1i;
+            y1[J+1] = (t1i + t3i) * w1r + (t1r + t3r) * w1i;
+
+            y2[J]   = (t0r - t2r) * w2r - (t0i - t2i) * w2i;
+            y2[J+1] = (t0i - t2i) * w2r + (t0r - t2r) * w2i;
+
+            y3[J]   = (t1r - t3r) * w3r - (t1i - t3i) * w3i;
+            y3[J+1] = (t1i - t3i) * w3r + (t1r - t3r) * w3i;
+            }
+         }
+
+      t = x;
+      x = y;
+      y = t;
+      bSwapped = !bSwapped;
+      }
+
+   if (n == 2L)   // Last pass is radix 2, its twiddle factors are all 1
+      {
+      for (J = 0L; J < 2L * s; J += 2L)
+         {
+         y[J]         = x[J]   + x[2L*s+J];
+         y[J+1]       = x[J+1] + x[2L*s+J+1];
+         y[2L*s+J]    = x[J]   - x[2L*s+J];
+         y[2L*s+J+1]  = x[J+1] - x[2L*s+J+1];
+         }
+      t = x;
+      x = y;
+      y = t;
+      bSwapped = !bSwapped;
+      }
+
+   if (bSwapped) memcpy(y, x, 2L * N * sizeof(double));   // Result back in the caller's x
+
+   return;
+   }
+
+/*
+* Six step transform for N beyond ZFFTBLOCK. With n = N2*n1 + n2 and
+* k = k1 + N1*k2 the sum becomes N2 transforms of length N1, a twiddle
+* exp(i 2 pi n2 k1 / N), then N1 transforms of length N2. Blocked
+* transposes put every short transform in a contiguous row.
+*/
+static BOOL zSixStepFFT(double *pData, long N, int iSign)
+   {
+   double *work, *row, *table1, *table2, *fine, *coarse;
+   double twoPI = 2.0 * acos(-1.0);
+   double re, im, wr, wi;
+   long N1, N2, n2, k1, K, J;
+   BOOL bFail = FALSE;
+
+   for (N1 = 1L; N1 * N1 < N; N1 *= 2L);
+   N2 = N / N1;
+
+   work   = (double *)malloc(2L * N * sizeof(double));
+   row    = (double *)malloc(2L * N1 * sizeof(double));
+   table1 = zTwiddles(N1, iSign);
+   table2 = zTwiddles(N2, iSign);
+   fine   = (double *)malloc(2L * N1 * sizeof(double));   // exp(i 2 pi K / N), K < N1
+   coarse = (double *)malloc(2L * N2 * sizeof(double));   // exp(i 2 pi J N1 / N), J < N2
+
+   if (!work || !row || !table1 || !table2 || !fine || !coarse) bFail = TRUE;
+
+   if (!bFail)
+      {
+      for (K = 0L; K < N1; ++K)
+         {
+         fine[2L*K]   = cos(twoPI * (double)K / (double)N);
+         fine[2L*K+1] = (double)iSign * sin(twoPI * (double)K / (double)N);
+         }
+      for (J = 0L; J < N2; ++J)
+         {
+         coarse[2L*J]   = cos(twoPI * (double)J / (double)N2);
+         coarse[2L*J+1] = (double)iSign * sin(twoPI * (double)J / (double)N2);
+         }
+
+      zTranspose(pData, work, N1, N2);               // work[n2][n1]
+
+      for (n2 = 0L; n2 < N2; ++n2)
+         {
+         zStockhamFFT(work + 2L * N1 * n2, row, N1, table1, iSign);
+
+         for (k1 = 0L; k1 < N1; ++k1)
+            {
+            K = n2 * k1;
+            J = K / N1;
+            K = K % N1;
+            wr = coarse[2L*J] * fine[2L*K]   - coarse[2L*J+1] * fine[2L*K+1];
+            wi = coarse[2L*J] * fine[2L*K+1] + coarse[2L*J+1] * fine[2L*K];
+            re = work[2L*(N1*n2+k1)];
+            im = work[2L*(N1*n2+k1)+1];
+            work[2L*(N1*n2+k1)]   = re * wr - im * wi;
+            work[2L*(N1*n2+k1)+1] = im * wr + re * wi;
+            }
+         }
+
+      zTranspose(work, pData, N2, N1);               // pData[k1][n2]
+
+      for (k1 = 0L; k1 < N1; ++k1) zStockhamFFT(pData + 2L * N2 * k1, work, N2, table2, iSign);
+
+      zTranspose(pData, work, N1, N2);               // work[k2][k1]
+      memcpy(pData, work, 2L * N * sizeof(double));
+      }
+
+   if (work) free(work);
+   if (row) free(row);
+   if (table1) free(table1);
+   if (table2) free(table2);
+   if (fine) free(fine);
+   if (coarse) free(coarse);
+
+   return(bFail);
+   }
+
+/*
+* Out of place transpose of a rows x cols array of complex values,
+* a tile at a time so both arrays are walked through cache lines.
+*/
+static void zTranspose(double *pSrc, double *pDst, long rows, long cols)
+   {
+   long R, C, r, c;
+
+   for (R = 0L; R < rows; R += ZFFTTILE)
+      for (C = 0L; C < cols; C += ZFFTTILE)
+         for (r = R; (r < R + ZFFTTILE) && (r < rows); ++r)
+            for (c = C; (c < C + ZFFTTILE) && (c < cols); ++c)
+               {
+               pDst[2L*(c*rows+r)]   = pSrc[2L*(r*cols+c)];
+               pDst[2L*(c*rows+r)+1] = pSrc[2L*(r*cols+c)+1];
+               }
+
+   return;
+   }
+
+/*
+* Mixed radix transform, N a product of 2, 3, 5 and 7.
+* Self sorting (Stockham) passes between pData and a scratch array, so no
+* bit reversal is needed. Each pass takes a factor p off the length n of
+* the sub-transforms, does the p point sums and applies the twiddles after
+* them (decimation in frequency), then doubles up the stride s.
+*/
+static BOOL zMixedFFT(double *pData, long N, int iSign)
+   {
+   static const long radix[] = {4L, 2L, 3L, 5L, 7L};
+   double twoPI = 2.0 * acos(-1.0);
+   double omr[7], omi[7], twr[7], twi[7], ar[7], ai[7];
+   double *work, *x, *y, *t;
+   double sr, si, theta, w;
+   long n, m, p, s, q, s0, j, k, I;
+
+   if (!(work = (double *)malloc(2L * N * sizeof(double)))) return(TRUE);
+
+   x = pData;
+   y = work;
+
+   for (n = N, s = 1L; n > 1L; n = m, s *= p)
+      {
+      for (I = 0, p = 0L; !p; ++I)
+         if (n % radix[I] == 0L) p = radix[I];
+
+      m = n / p;
+
+      for (j = 0L; j < p; ++j)   // p-th roots of unity
+         {
+         omr[j] = cos(twoPI * (double)j / (double)p);
+         omi[j] = (double)iSign * sin(twoPI * (double)j / (double)p);
+         }
+
+      for (q = 0L; q < m; ++q)
+         {
+         theta = (double)iSign * twoPI * (double)q / (double)n;
+         twr[0] = 1.;
+         twi[0] = 0.;
+         twr[1] = cos(theta);
+         twi[1] = sin(theta);
+         for (j = 2L; j < p; ++j)
+            {
+            twr[j] = twr[j-1] * twr[1] - twi[j-1] * twi[1];
+            twi[j] = twi[j-1] * twr[1] + twr[j-1] * twi[1];
+            }
+
+         for (s0 = 0L; s0 < s; ++s0)
+            {
+            for (k = 0L; k < p; ++k)
+               {
+               ar[k] = x[2L * (s0 + s * (q + m * k))];
+               ai[k] = x[2L * (s0 + s * (q + m * k)) + 1L];
+               }
+
+            for (j = 0L; j < p; ++j)
+               {
+               sr = si = 0.;
+               for (k = 0L; k < p; ++k)
+                  {
+                  I = (j * k) % p;
+                  sr += ar[k] * omr[I] - ai[k] * omi[I];
+                  si += ai[k] * omr[I] + ar[k] * omi[I];
+                  }
+               w = sr;
+               sr = w  * twr[j] - si * twi[j];
+               si = si * twr[j] + w  * twi[j];
+
+               y[2L * (s0 + s * (p * q + j))]      = sr;
+               y[2L * (s0 + s * (p * q + j)) + 1L] = si;
+               }
+            }
+         }
+
+      t = x;
+      x = y;
+      y = t;
+      }
+
+   if (x != pData) memcpy(pData, x, 2L * N * sizeof(double));
+
+   free(work);
+
+   return(FALSE);
+   }
+
+/*
+* Bluestein's transform for any N.
+* With jk = (j*j + k*k - (j-k)*(j-k))/2 the sum becomes c(j) times the
+* convolution of x(k)c(k) with conj(c), where c(k) = exp(i pi k*k / N).
+* The convolution is done with power of 2 transforms of length M >= 2N-1.
+*/
+static BOOL zBluesteinFFT(double *pData, long N, int iSign)
+   {
+   double Pi = acos(-1.0);
+   double *a, *b, *c;
+   double re, im, theta;
+   long M, K, K2;
+
+   for (M = 1L; M < 2L * N - 1L; M *= 2L);
+
+   a = (double *)calloc(2L * M, sizeof(double));
+   b = (double *)calloc(2L * M, sizeof(double));
+   c = (double *)malloc(2L * N * sizeof(double));
+
+   if (!a || !b || !c)
+      {
+      if (a) free(a);
+      if (b) free(b);
+      if (c) free(c);
+      return(TRUE);
+      }
+
+   for (K = 0L, K2 = 0L; K < N; ++K)
+      {
+      theta = (double)iSign * Pi * (double)K2 / (double)N;   // K*K is kept modulo 2N so the phase stays exact
+      c[2L*K]   = cos(theta);
+      c[2L*K+1] = sin(theta);
+
+      a[2L*K]   = pData[2L*K] * c[2L*K]   - pData[2L*K+1] * c[2L*K+1];
+      a[2L*K+1] = pData[2L*K] * c[2L*K+1] + pData[2L*K+1] * c[2L*K];
+
+      b[2L*K]   =  c[2L*K];
+      b[2L*K+1] = -c[2L*K+1];
+      if (K)
+         {
+         b[2L*(M-K)]   = b[2L*K];
+         b[2L*(M-K)+1] = b[2L*K+1];
+         }
+
+      K2 = (K2 + 2L * K + 1L) % (2L * N);
+      }
+
+   if (zPow2FFT(a, M, -1) || zPow2FFT(b, M, -1))
+      {
+      free(a);
+      free(b);
+      free(c);
+      return(TRUE);
+      }
+
+   for (K = 0L; K < M; ++K)
+      {
+      re = a[2L*K] * b[2L*K]   - a[2L*K+1] * b[2L*K+1];
+      im = a[2L*K] * b[2L*K+1] + a[2L*K+1] * b[2L*K];
+      a[2L*K]   = re;
+      a[2L*K+1] = im;
+      }
+
+   if (zPow2FFT(a, M, 1))
+      {
+      free(a);
+      free(b);
+      free(c);
+      return(TRUE);
+      }
+
+   for (K = 0L; K < N; ++K)
+      {
+      pData[2L*K]   = (a[2L*K] * c[2L*K]   - a[2L*K+1] * c[2L*K+1]) / (double)M;
+      pData[2L*K+1] = (a[2L*K] * c[2L*K+1] + a[2L*K+1] * c[2L*K])   / (double)M;
+      }
+
+   free(a);
+   free(b);
+   free(c);
+
+   return(FALSE);
+   }
+
+/*********************************************************************
+*
+* Accuracy asked of the fast (ITYPE 1) transforms, relative to the sum of
+* the magnitudes of the input terms. FASTTOL=x in TISAN.CFG, default 1E-10.
+* TISAN.CFG is only read on the first call.
+*/
+double zFastTolerance()
+   {
+   static double tolerance = 0.;
+   char szValue[32];
+
+   if (!tolerance)
+      {
+      if (getConfigString("FASTTOL", sizeof(szValue), szValue)) tolerance = atof(szValue);   // TRUE if the key was found
+
+      if ((tolerance <= 0.) || (tolerance >= 1.)) tolerance = 1.0E-10;
+      }
+
+   return(tolerance);
+   }
+
+/*********************************************************************
+*
+* Non-uniform FFT. For nFreq evenly spaced frequencies nu(j) = nu0 + j*dNu
+* this finds
+*
+*    pOut[j] = sum over k of (pReal[k] + i pImag[k]) exp(-i 2 pi nu(j) pTime[k])
+*
+* for any times, in O(N + nFreq log nFreq) instead of O(N nFreq). pImag
+* may be NIL for real data.
+*
+* The terms are spread onto an oversampled (x2) grid with a Gaussian, the
+* grid is transformed with zFFT and the Gaussian is divided out again, see
+* Greengard, L. and Lee, J.-Y. 2004, SIAM Review, 46, p. 443. The Gaussian
+* width and the number of grid points it covers are set from tolerance.
+*
+* Returns FALSE if no errors.
+* Returns TRUE if the grid could not be allocated.
+*/
+BOOL zNUFFT(double *pTime, double *pReal, double *pImag, long N, double nu0, double dNu, long nFreq, double tolerance, struct complex *pOut)
+   {
+   double Pi = acos(-1.0), twoPi = 2.0 * Pi;
+   double *grid, E3[32];
+   double nuC, tau, h, phase, cr, ci, re, im, x, dx, E1, E2, E2l, E2m, e, scale;
+   long M, MR, K, J, m0, m;
+   int nSpread, l;
+
+   M = 1L;
+   while (M < nFreq) M *= 2L;
+   MR = 2L * M;                                      // Grid points, oversampled by 2
+
+   nSpread = (int)ceil(-log(tolerance) * 3. / twoPi);   // Error is about exp(-2 pi nSpread / 3)
+   nSpread = Max(2, Min(nSpread, 30));
+
+   tau = Pi * (double)nSpread / (3. * (double)M * (double)M);
+   h = twoPi / (double)MR;
+
+   if (!(grid = (double *)calloc(2L * MR, sizeof(double)))) return(TRUE);
+
+   for (l = 0; l <= nSpread; ++l) E3[l] = exp(-Square((double)l * h) / (4. * tau));
+
+   nuC = nu0 + (double)(nFreq / 2L) * dNu;           // Frequencies are taken about the middle one
+/*
+** Spread each term onto the grid
+*/
+   for (K = 0L; K < N; ++K)
+      {
+      phase = -twoPi * nuC * pTime[K];
+      cr = cos(phase);
+      ci = sin(phase);
+      re = pReal[K];
+      im = pImag ? pImag[K] : 0.;
+      x = re;
+      re = x * cr - im * ci;
+      im = x * ci + im * cr;
+
+      x = dNu * pTime[K];
+      x = twoPi * (x - floor(x));                    // Position on the periodic grid, 0 to 2 pi
+
+      m0 = (long)floor(x / h);
+      dx = x - (double)m0 * h;
+      E1 = exp(-dx * dx / (4. * tau));
+      E2 = exp(dx * h / (2. * tau));
+
+      e = E1;
+      m = ((m0 % MR) + MR) % MR;
+      grid[2L*m]   += re * e;
+      grid[2L*m+1] += im * e;
+
+      for (l = 1, E2l = E2, E2m = 1. / E2; l <= nSpread; ++l, E2l *= E2, E2m /= E2)
+         {
+         e = E1 * E2l * E3[l];                       // Grid point m0 + l
+         m = (((m0 + l) % MR) + MR) % MR;
+         grid[2L*m]   += re * e;
+         grid[2L*m+1] += im * e;
+
+         if (l < nSpread)
+            {
+            e = E1 * E2m * E3[l];                    // Grid point m0 - l
+            m = (((m0 - l) % MR) + MR) % MR;
+            grid[2L*m]   += re * e;
+            grid[2L*m+1] += im * e;
+            }
+         }
+      }
+
+   if (zFFT(grid, MR, -1))
+      {
+      free(grid);
+      return(TRUE);
+      }
+/*
+** Divide out the Gaussian, mode K = J - nFreq/2
+*/
+   for (J = 0L; J < nFreq; ++J)
+      {
+      K = J - nFreq / 2L;
+      m = (K + MR) % MR;
+      scale = sqrt(Pi / tau) * exp((double)K * (double)K * tau) / (double)MR;
+      pOut[J].x = grid[2L*m]   * scale;
+      pOut[J].y = grid[2L*m+1] * scale;
+      }
+
+   free(grid);
+
+   return(FALSE);
+   }
+
+/*********************************************************************
+*
+*  Make a file name and return a pointer
+*  Create one of 4 types of file names
+*
+* M_inname  : Primary input file
+* M_in2name : Secondary input file
+* M_outname : Output file
+* M_tmpname : Temporary scratch file
+*
+* The Primary file name is built from INNAME, INCLASS and INPATH directly.
+* The Secondary file name is built from IN2NAME, IN2CLASS and IN2PATH if
+* they are not null strings, if any one is not defined, then INNAME,
+* INCLASS or INPATH is used.
+* The Output file name is built from OUTNAME, OUTCLASS and OUTPATH if
+* they are not null strings, if any one is not defined, then INNAME,
+* INCLASS or INPATH is used.
+* The Temporary file name is built from OUTPATH, an 8 character name based
+* on the current process ID, the TASKNAME and the number of retries in
+* building the name.  The extension .TMP is always used.
+*
+* If the file name can be created, a pointer is returned, otherwise
 * an error message is printed and the TASK dies.
 */
 PSTR zBuildFileName(short TYPE, PSTR cPointer)
@@ -2140,7 +4110,10 @@ short zTaskMessage(short level, const char *format, ...)
 
    if ((QUIET<0) || (level >= (abs(QUIET)-1)))
       {
-      printf("%-8s: ",szTask);
+      if (nWorkerPids || iWorker)       // Files are being processed in parallel, so say which file this is about
+         printf("%-8s: [%s.%s] ",szTask,INNAME,INCLASS);
+      else
+         printf("%-8s: ",szTask);
       N = vprintf(format, arg_ptr);
       }
 